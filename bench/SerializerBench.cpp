@@ -0,0 +1,357 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Serializers.h"
+
+#include "amm_std.h"
+
+/*
+  SerializerBench:
+                Formats representative samples of every frame type, event-style
+                ones with allFields, through Serializers and through the
+                ostringstream code it replaced, checks both give the same
+                bytes, and reports the time per message of each. Runs without
+                a DDS peer. Exits non-zero on the first mismatch.
+
+                serializer_bench [iterations]
+*/
+
+namespace {
+
+std::string StreamValue(const AMM::PhysiologyValue &n) {
+    std::ostringstream messageOut;
+    messageOut << n.name() << "=" << n.value() << "|" << std::endl;
+    return messageOut.str();
+}
+
+std::string StreamWaveform(const AMM::PhysiologyWaveform &n) {
+    std::ostringstream messageOut;
+    messageOut << n.name() << "=" << n.value() << "|" << std::endl;
+    return messageOut.str();
+}
+
+std::string StreamEventRecord(const AMM::EventRecord &er) {
+    std::ostringstream messageOut;
+    messageOut << "[AMM_EventRecord]"
+               << "id=" << er.id().id() << ";"
+               << "type=" << er.type() << ";"
+               << "location=" << er.location().name() << ";"
+               << "participant_id=" << er.agent_id().id() << ";"
+               << "participant_type=" << AMM::Utility::EEventAgentTypeStr(er.agent_type()) << ";"
+               << "data=" << er.data() << ";"
+               << std::endl;
+    return messageOut.str();
+}
+
+std::string StreamPhysiologyModification(const std::pair<AMM::PhysiologyModification, EventContext> &sample) {
+    const AMM::PhysiologyModification &pm = sample.first;
+    std::ostringstream messageOut;
+    messageOut << "[AMM_Physiology_Modification]"
+               << "id=" << pm.id().id() << ";"
+               << "event_id=" << pm.event_id().id() << ";"
+               << "type=" << pm.type() << ";"
+               << "location=" << sample.second.location << ";"
+               << "participant_id=" << sample.second.participant << ";"
+               << "payload=" << pm.data()
+               << std::endl;
+    return messageOut.str();
+}
+
+std::string StreamAssessment(const std::pair<AMM::Assessment, EventContext> &sample) {
+    const AMM::Assessment &a = sample.first;
+    std::ostringstream messageOut;
+    messageOut << "[AMM_Assessment]"
+               << "id=" << a.id().id() << ";"
+               << "event_id=" << a.event_id().id() << ";"
+               << "type=" << sample.second.type << ";"
+               << "location=" << sample.second.location << ";"
+               << "participant_id=" << sample.second.participant << ";"
+               << "value=" << AMM::Utility::EAssessmentValueStr(a.value()) << ";"
+               << "comment=" << a.comment()
+               << std::endl;
+    return messageOut.str();
+}
+
+std::string StreamRenderModification(const std::pair<AMM::RenderModification, EventContext> &sample) {
+    const AMM::RenderModification &rendMod = sample.first;
+    std::ostringstream messageOut;
+    std::string rendModPayload;
+    std::string rendModType;
+    if (rendMod.data().empty()) {
+        rendModPayload = "<RenderModification type='" + rendMod.type() + "'/>";
+        rendModType = "";
+    } else {
+        rendModPayload = rendMod.data();
+        rendModType = rendMod.type();
+    }
+    messageOut << "[AMM_Render_Modification]"
+               << "id=" << rendMod.id().id() << ";"
+               << "event_id=" << rendMod.event_id().id() << ";"
+               << "type=" << rendModType << ";"
+               << "location=" << sample.second.location << ";"
+               << "participant_id=" << sample.second.participant << ";"
+               << "payload=" << rendModPayload
+               << std::endl;
+    return messageOut.str();
+}
+
+std::string StreamOperationalDescription(const AMM::OperationalDescription &opD) {
+    std::ostringstream messageOut;
+    messageOut << "[AMM_OperationalDescription]"
+               << "name=" << opD.name() << ";"
+               << "description=" << opD.description() << ";"
+               << "manufacturer=" << opD.manufacturer() << ";"
+               << "model=" << opD.model() << ";"
+               << "serial_number=" << opD.serial_number() << ";"
+               << "module_id=" << opD.module_id().id() << ";"
+               << "module_version=" << opD.module_version() << ";"
+               << "configuration_version=" << opD.configuration_version() << ";"
+               << "AMM_version=" << opD.AMM_version() << ";"
+               << "capabilities_configuration=";
+    return messageOut.str() + AMM::Utility::encode64(opD.capabilities_schema()) + "\n";
+}
+
+// Typical vitals plus the values where %g and iostreams could disagree
+const double sampleValues[] = {
+        0.0, -0.0, 1.0, 72.0, 98.6, 120.25, -0.5, 0.1, 1.0 / 3.0, 1e-5, 0.0001, 123456.0, 1234567.0,
+        1e21, -2.5e-12, std::numeric_limits<double>::max(), std::numeric_limits<double>::denorm_min(),
+        std::numeric_limits<double>::infinity(), -std::numeric_limits<double>::infinity(),
+        std::numeric_limits<double>::quiet_NaN()
+};
+
+std::vector<AMM::PhysiologyValue> Values() {
+    const char *names[] = {"Cardiovascular_HeartRate", "Respiratory_RespirationRate", "BloodChemistry_Oxygen_Saturation"};
+    std::vector<AMM::PhysiologyValue> values;
+    for (double value : sampleValues) {
+        for (const char *name : names) {
+            AMM::PhysiologyValue n;
+            n.name(name);
+            n.value(value);
+            values.push_back(n);
+        }
+    }
+    return values;
+}
+
+std::vector<AMM::PhysiologyWaveform> Waveforms() {
+    const char *names[] = {"ECG", "Cardiovascular_Arterial_Pressure", "Respiratory_CarbonDioxide_Exhaled"};
+    std::vector<AMM::PhysiologyWaveform> waveforms;
+    for (double value : sampleValues) {
+        for (const char *name : names) {
+            AMM::PhysiologyWaveform n;
+            n.name(name);
+            n.value(value);
+            waveforms.push_back(n);
+        }
+    }
+    return waveforms;
+}
+
+std::vector<AMM::EventRecord> EventRecords() {
+    std::vector<AMM::EventRecord> records;
+    const char *types[] = {"", "NEEDLE_DECOMPRESSION", "TOURNIQUET_APPLIED"};
+    const std::string data[] = {"", "<data side='left'/>", std::string(2048, 'x')};
+    for (int i = 0; i < 3; i++) {
+        AMM::EventRecord er;
+        AMM::UUID id;
+        id.id("3c6a8f4e-7b1d-4c55-9e0a-" + std::to_string(100000000000 + i));
+        er.id(id);
+        er.type(types[i]);
+        AMM::FMA_Location location;
+        location.name(i ? "Left_Chest" : "");
+        er.location(location);
+        AMM::UUID agent;
+        agent.id(i ? "learner-" + std::to_string(i) : "");
+        er.agent_id(agent);
+        er.agent_type(AMM::EventAgentType::LEARNER);
+        er.data(data[i]);
+        records.push_back(er);
+    }
+    return records;
+}
+
+// Samples of the event-style frames, with and without the context of their EventRecord
+std::vector<EventContext> Contexts() {
+    std::vector<EventContext> contexts(2);
+    contexts[1].location = "Left_Chest";
+    contexts[1].participant = "learner-1";
+    contexts[1].type = "NEEDLE_DECOMPRESSION";
+    return contexts;
+}
+
+AMM::UUID Uuid(const std::string &id) {
+    AMM::UUID uuid;
+    uuid.id(id);
+    return uuid;
+}
+
+std::vector<std::pair<AMM::PhysiologyModification, EventContext>> PhysiologyModifications() {
+    const std::string data[] = {"", "<PhysiologyModification type='Hemorrhage'><Rate>12.5</Rate></PhysiologyModification>",
+                                std::string(2048, 'x')};
+    std::vector<std::pair<AMM::PhysiologyModification, EventContext>> samples;
+    for (auto &ctx : Contexts()) {
+        for (auto &payload : data) {
+            AMM::PhysiologyModification pm;
+            pm.id(Uuid("8d0f1a2b-0c3d-4e5f-8a9b-" + std::to_string(100000000000 + samples.size())));
+            pm.event_id(Uuid(ctx.type.empty() ? "" : "3c6a8f4e-7b1d-4c55-9e0a-100000000001"));
+            pm.type(payload.empty() ? "" : "Hemorrhage");
+            pm.data(payload);
+            samples.emplace_back(pm, ctx);
+        }
+    }
+    return samples;
+}
+
+std::vector<std::pair<AMM::Assessment, EventContext>> Assessments() {
+    const char *comments[] = {"", "Applied too low; moved above the wound", "semi;colons=and equals"};
+    std::vector<std::pair<AMM::Assessment, EventContext>> samples;
+    for (auto &ctx : Contexts()) {
+        for (const char *comment : comments) {
+            AMM::Assessment a;
+            a.id(Uuid("5e2b7c90-1d4a-4f3b-b6c8-" + std::to_string(100000000000 + samples.size())));
+            a.event_id(Uuid(ctx.type.empty() ? "" : "3c6a8f4e-7b1d-4c55-9e0a-100000000001"));
+            a.comment(comment);
+            samples.emplace_back(a, ctx);
+        }
+    }
+    return samples;
+}
+
+// Empty data takes the other branch: the type moves into a generated payload
+std::vector<std::pair<AMM::RenderModification, EventContext>> RenderModifications() {
+    const char *types[] = {"", "PATIENT_STATE_TENSION_PNEUMOTHORAX", "TOURNIQUET_APPLIED"};
+    const std::string data[] = {"", "<RenderModification type='TOURNIQUET_APPLIED'/>", std::string(2048, 'x')};
+    std::vector<std::pair<AMM::RenderModification, EventContext>> samples;
+    for (auto &ctx : Contexts()) {
+        for (const char *type : types) {
+            for (auto &payload : data) {
+                AMM::RenderModification rendMod;
+                rendMod.id(Uuid("a47c3e15-6b2d-4e80-9f1a-" + std::to_string(100000000000 + samples.size())));
+                rendMod.event_id(Uuid(ctx.type.empty() ? "" : "3c6a8f4e-7b1d-4c55-9e0a-100000000001"));
+                rendMod.type(type);
+                rendMod.data(payload);
+                samples.emplace_back(rendMod, ctx);
+            }
+        }
+    }
+    return samples;
+}
+
+std::vector<AMM::OperationalDescription> OperationalDescriptions() {
+    const std::string schemas[] = {"", "<AMMModuleConfiguration><module name='TCP Bridge'/></AMMModuleConfiguration>",
+                                   std::string(16384, 'x')};
+    std::vector<AMM::OperationalDescription> descriptions;
+    for (auto &schema : schemas) {
+        AMM::OperationalDescription od;
+        od.name(schema.empty() ? "" : "AMM_TCP_Bridge");
+        od.description(schema.empty() ? "" : "Bridges AMM topics to TCP clients");
+        od.manufacturer("Vcom3D");
+        od.model("TCP Bridge");
+        od.serial_number(schema.empty() ? "" : "0012");
+        od.module_id(Uuid("f3b0c442-98fc-4c14-9af3-" + std::to_string(100000000000 + descriptions.size())));
+        od.module_version("1.2.0");
+        od.configuration_version(schema.empty() ? "" : "1.0");
+        od.AMM_version("1.2.0");
+        od.capabilities_schema(schema);
+        descriptions.push_back(od);
+    }
+    return descriptions;
+}
+
+// The full frame, allFields, of each sample; an event-style sample carries its context
+template<typename T>
+auto Write(const T &sample) -> decltype(Serialize(sample)) {
+    return Serialize(sample);
+}
+
+template<typename T>
+MessageBuffer Write(const std::pair<T, EventContext> &sample) {
+    return Serialize(sample.first, sample.second, allFields);
+}
+
+std::string Text(const MessageBuffer &frame) {
+    return std::string(frame->data(), frame->size());
+}
+
+std::string Text(const GatherMessage &message) {
+    return message.Flatten();
+}
+
+size_t Size(const MessageBuffer &frame) {
+    return frame->size();
+}
+
+size_t Size(const GatherMessage &message) {
+    return message.Size();
+}
+
+// Frames for every sample through both paths; reports the mismatch if any
+template<typename T, typename Stream>
+bool Check(const char *label, const std::vector<T> &samples, Stream stream) {
+    for (const T &sample : samples) {
+        std::string written = Text(Write(sample));
+        std::string expected = stream(sample);
+        if (written != expected) {
+            std::cerr << label << ": serializer wrote \"" << written
+                      << "\", ostringstream wrote \"" << expected << "\"" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename T, typename Format>
+double NanosPerMessage(const std::vector<T> &samples, int iterations, Format format) {
+    size_t bytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        for (const T &sample : samples) {
+            bytes += format(sample);
+        }
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    // Keeps the loop from being optimized away
+    volatile size_t sink = bytes;
+    (void) sink;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / ((double) iterations * samples.size());
+}
+
+template<typename T, typename Stream>
+bool Run(const char *label, const std::vector<T> &samples, int iterations, Stream stream) {
+    if (!Check(label, samples, stream)) {
+        return false;
+    }
+    double serializer = NanosPerMessage(samples, iterations, [](const T &sample) {
+        return Size(Write(sample));
+    });
+    double ostream = NanosPerMessage(samples, iterations, [&stream](const T &sample) {
+        return stream(sample).size();
+    });
+    std::cout << label << ": " << samples.size() << " samples identical, serializer " << serializer
+              << " ns/msg, ostringstream " << ostream << " ns/msg" << std::endl;
+    return true;
+}
+
+}
+
+int main(int argc, const char *argv[]) {
+    int iterations = argc > 1 ? std::atoi(argv[1]) : 20000;
+    if (iterations < 1) {
+        iterations = 1;
+    }
+
+    bool ok = Run("PhysiologyValue", Values(), iterations, StreamValue);
+    ok = Run("PhysiologyWaveform", Waveforms(), iterations, StreamWaveform) && ok;
+    ok = Run("EventRecord", EventRecords(), iterations, StreamEventRecord) && ok;
+    ok = Run("PhysiologyModification", PhysiologyModifications(), iterations, StreamPhysiologyModification) && ok;
+    ok = Run("Assessment", Assessments(), iterations, StreamAssessment) && ok;
+    ok = Run("RenderModification", RenderModifications(), iterations, StreamRenderModification) && ok;
+    ok = Run("OperationalDescription", OperationalDescriptions(), iterations, StreamOperationalDescription) && ok;
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,151 @@
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "StateSnapshot.h"
+
+/*
+  StateSnapshotTest:
+                Writes a few generations, then damages the file the way a
+                crash can leave it and checks Open() restores the right one:
+                a half-written older slot still yields the newest generation,
+                and a newest slot whose descriptor was committed before its
+                data reached the disk falls back to the previous generation.
+                Exits non-zero if any case fails.
+
+                state_snapshot_test [file]
+*/
+
+namespace {
+
+int failures = 0;
+
+void Expect(bool ok, const std::string &what) {
+    if (!ok) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+// The on-disk layout StateSnapshot keeps private
+const off_t headerSize = 4096;
+
+struct Slot {
+    uint64_t generation;
+    uint64_t length;
+    uint64_t checksum;
+};
+
+struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t slotSize;
+    Slot slots[2];
+};
+
+bool ReadHeader(const std::string &path, Header &header) {
+    int fd = open(path.c_str(), O_RDONLY);
+    bool ok = fd >= 0 && pread(fd, &header, sizeof(header), 0) == (ssize_t) sizeof(header);
+    if (fd >= 0) {
+        close(fd);
+    }
+    return ok;
+}
+
+// Overwrites the start of a slot's data, as a write cut short would
+bool Tear(const std::string &path, const Header &header, int slot) {
+    std::string garbage(16, '\xa5');
+    int fd = open(path.c_str(), O_WRONLY);
+    bool ok = fd >= 0 && pwrite(fd, garbage.data(), garbage.size(),
+                                headerSize + slot * (off_t) header.slotSize) == (ssize_t) garbage.size();
+    if (fd >= 0) {
+        close(fd);
+    }
+    return ok;
+}
+
+int Newest(const Header &header) {
+    return header.slots[0].generation > header.slots[1].generation ? 0 : 1;
+}
+
+// Generations 1..3, each with its own heart rate
+void WriteGenerations(const std::string &path) {
+    StateSnapshot::Sections restored;
+    StateSnapshot snapshot;
+    Expect(snapshot.Open(path, restored) && restored.empty(), "a new file opens empty");
+    for (int rate = 71; rate <= 73; rate++) {
+        snapshot.Put("labs", "Cardiovascular_HeartRate", std::to_string(rate));
+        snapshot.Put("settings", "Monitor\tvolume", "3");
+        Expect(snapshot.Flush(), "generation for rate " + std::to_string(rate) + " is written");
+    }
+    Expect(snapshot.Generation() == 3, "three generations written");
+}
+
+std::string Restore(const std::string &path, uint64_t &generation) {
+    StateSnapshot::Sections restored;
+    StateSnapshot snapshot;
+    if (!snapshot.Open(path, restored)) {
+        return "";
+    }
+    generation = snapshot.Generation();
+    Expect(restored["settings"]["Monitor\tvolume"] == "3", "restored generation holds every section");
+    return restored["labs"]["Cardiovascular_HeartRate"];
+}
+
+}
+
+int main(int argc, const char *argv[]) {
+    std::string path = argc > 1 ? argv[1] : "state_snapshot_test.snapshot";
+    unlink(path.c_str());
+
+    WriteGenerations(path);
+    Header header{};
+    Expect(ReadHeader(path, header) && header.slots[Newest(header)].generation == 3, "header names generation 3");
+
+    uint64_t generation = 0;
+    Expect(Restore(path, generation) == "73" && generation == 3, "intact file restores the newest generation");
+
+    // Crash while overwriting the older slot: its descriptor still has the old checksum
+    Expect(Tear(path, header, 1 - Newest(header)), "older slot torn");
+    Expect(Restore(path, generation) == "73" && generation == 3, "torn older slot leaves the newest generation");
+
+    // Crash after the descriptor was committed but before the data was: the
+    // newest checksum fails and the other slot takes over
+    unlink(path.c_str());
+    WriteGenerations(path);
+    Expect(ReadHeader(path, header), "header read back");
+    int torn = Newest(header);
+    Expect(Tear(path, header, torn), "newest slot torn");
+    Expect(Restore(path, generation) == "72" && generation == 2, "torn newest slot falls back to generation 2");
+
+    // Writing resumes after the recovered generation, into the torn slot, so
+    // a crash during that write still leaves generation 2
+    {
+        StateSnapshot::Sections restored;
+        StateSnapshot snapshot;
+        Expect(snapshot.Open(path, restored), "recovered file reopens");
+        snapshot.Put("labs", "Cardiovascular_HeartRate", "80");
+        Expect(snapshot.Flush() && snapshot.Generation() == 3, "next flush writes generation 3");
+    }
+    Expect(ReadHeader(path, header) && Newest(header) == torn && header.slots[1 - torn].generation == 2,
+           "generation 3 replaced the torn slot, not the recovered one");
+    Expect(Restore(path, generation) == "80" && generation == 3, "generation written after recovery is restored");
+
+    // Both slots torn: nothing to restore, the snapshot starts empty
+    Expect(ReadHeader(path, header) && Tear(path, header, 0) && Tear(path, header, 1), "both slots torn");
+    {
+        StateSnapshot::Sections restored;
+        StateSnapshot snapshot;
+        Expect(snapshot.Open(path, restored) && restored.empty() && snapshot.Generation() == 0,
+               "no intact slot starts empty");
+    }
+
+    unlink(path.c_str());
+    if (failures == 0) {
+        std::cout << "StateSnapshot: all cases passed" << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "TopicMatcher.h"
+
+/*
+  TopicMatcherTest:
+                Wildcard matching of subscription patterns against topic
+                names, directly through Matches() and through the prefix trie
+                Match() walks. Exits non-zero if any case fails.
+*/
+
+namespace {
+
+int failures = 0;
+
+void Expect(bool ok, const std::string &what) {
+    if (!ok) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+void ExpectMatch(const std::string &pattern, const std::string &topic, bool expected) {
+    Expect(TopicMatcher::Matches(pattern, topic) == expected,
+           "\"" + pattern + "\" " + (expected ? "matches" : "does not match") + " \"" + topic + "\"");
+}
+
+ClientHandle Handle(uint32_t slot) {
+    ClientHandle handle;
+    handle.slot = slot;
+    handle.generation = 1;
+    return handle;
+}
+
+bool Lists(const std::vector<ClientHandle> &clients, std::vector<uint32_t> slots) {
+    std::vector<uint32_t> found;
+    for (auto &client : clients) {
+        found.push_back(client.slot);
+    }
+    std::sort(found.begin(), found.end());
+    std::sort(slots.begin(), slots.end());
+    return found == slots;
+}
+
+void Glob() {
+    ExpectMatch("HF_ECG", "HF_ECG", true);
+    ExpectMatch("HF_ECG", "HF_ECG2", false);
+    ExpectMatch("HF_ECG", "HF_EC", false);
+    ExpectMatch("HF_*", "HF_ECG", true);
+    ExpectMatch("HF_*", "HF_", true);
+    ExpectMatch("HF_*", "HF", false);
+    ExpectMatch("*", "", true);
+    ExpectMatch("*", "Cardiovascular_HeartRate", true);
+    ExpectMatch("**", "x", true);
+    ExpectMatch("", "", true);
+    ExpectMatch("", "x", false);
+    ExpectMatch("?", "", false);
+    ExpectMatch("?", "x", true);
+    ExpectMatch("?", "xy", false);
+    ExpectMatch("HF_???", "HF_ECG", true);
+    ExpectMatch("HF_???", "HF_ECG_Lead2", false);
+    ExpectMatch("Substance_*_Concentration", "Substance_Epinephrine_Concentration", true);
+    ExpectMatch("Substance_*_Concentration", "Substance__Concentration", true);
+    ExpectMatch("Substance_*_Concentration", "Substance_Epinephrine_Concentration_Plasma", false);
+    // Needs backtracking past a partial match of the literal after the star
+    ExpectMatch("*_Concentration", "Substance_Concentration_Concentration", true);
+    ExpectMatch("a*b*c", "axxbyyc", true);
+    ExpectMatch("a*b*c", "axxbyy", false);
+    ExpectMatch("a*b?d", "abbbcd", true);
+    ExpectMatch("*?", "", false);
+    ExpectMatch("BloodChemistry_*", "bloodchemistry_BloodPH", false);
+}
+
+void MayMatchPrefix() {
+    Expect(TopicMatcher::MayMatchPrefix("HF_*", "HF_"), "HF_* reaches into HF_");
+    Expect(TopicMatcher::MayMatchPrefix("HF_ECG", "HF_"), "HF_ECG reaches into HF_");
+    Expect(TopicMatcher::MayMatchPrefix("*", "HF_"), "* reaches into HF_");
+    Expect(TopicMatcher::MayMatchPrefix("H?_x", "HF_"), "H?_x reaches into HF_");
+    Expect(!TopicMatcher::MayMatchPrefix("HF", "HF_"), "HF does not reach into HF_");
+    Expect(!TopicMatcher::MayMatchPrefix("Blood*", "HF_"), "Blood* does not reach into HF_");
+    Expect(TopicMatcher::IsPattern("HF_*") && TopicMatcher::IsPattern("H?") && !TopicMatcher::IsPattern("HF_ECG"),
+           "IsPattern spots * and ?");
+}
+
+void Trie() {
+    TopicMatcher matcher;
+    matcher.Add("HF_*", Handle(1));
+    matcher.Add("HF_E*", Handle(2));
+    matcher.Add("*", Handle(3));
+    matcher.Add("HF_ECG", Handle(4));
+    matcher.Add("HF_?CG", Handle(5));
+    // Two patterns of one client matching the same topic list it once
+    matcher.Add("HF_*G", Handle(1));
+    matcher.Add("HF_*", Handle(1));
+
+    Expect(Lists(matcher.Match("HF_ECG"), {1, 2, 3, 4, 5}), "Match(HF_ECG) lists every matching client once");
+    Expect(Lists(matcher.Match("HF_Pleth"), {1, 3}), "Match(HF_Pleth)");
+    Expect(Lists(matcher.Match("HF"), {3}), "Match(HF) stops at the end of the topic");
+    Expect(Lists(matcher.Match(""), {3}), "Match of the empty name");
+
+    matcher.Remove(Handle(3));
+    Expect(Lists(matcher.Match("Cardiovascular_HeartRate"), {}), "Remove drops a client's patterns");
+    matcher.Remove(Handle(1));
+    Expect(Lists(matcher.Match("HF_ECG"), {2, 4, 5}), "Remove leaves other clients on shared nodes");
+    matcher.Remove(Handle(2));
+    matcher.Remove(Handle(4));
+    matcher.Remove(Handle(5));
+    Expect(Lists(matcher.Match("HF_ECG"), {}), "Removing every client empties the trie");
+}
+
+}
+
+int main() {
+    Glob();
+    MayMatchPrefix();
+    Trie();
+    if (failures == 0) {
+        std::cout << "TopicMatcher: all cases passed" << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
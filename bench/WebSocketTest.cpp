@@ -0,0 +1,241 @@
+#include <iostream>
+#include <string>
+
+#include "WebSocket.h"
+
+/*
+  WebSocketTest:
+                Drives WebSocketSession with hand-built client frames: the
+                upgrade and version negotiation, masking, fragmentation with
+                interleaved control frames, 16 and 64 bit lengths, oversized
+                messages, and the protocol errors that must close the
+                connection. Also checks the length encoding of outbound
+                frames. Exits non-zero if any case fails.
+*/
+
+namespace {
+
+int failures = 0;
+
+void Expect(bool ok, const std::string &what) {
+    if (!ok) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+const char fin = (char) 0x80;
+const char text = 0x1;
+const char binary = 0x2;
+const char continuation = 0x0;
+const char ping = 0x9;
+
+const std::string closeProtocolError = std::string("\x88\x02\x03\xea", 4);
+const std::string closeTooBig = std::string("\x88\x02\x03\xf1", 4);
+
+std::string Request(const std::string &version) {
+    return "GET /ws HTTP/1.1\r\n"
+           "Host: bridge\r\n"
+           "Upgrade: websocket\r\n"
+           "Connection: keep-alive, Upgrade\r\n"
+           "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+           "Sec-WebSocket-Version: " + version + "\r\n\r\n";
+}
+
+// A client frame; masked unless told otherwise, the length in the shortest encoding
+std::string ClientFrame(char first, const std::string &body, bool masked = true) {
+    const unsigned char mask[4] = {0x37, 0xfa, 0x21, 0x3d};
+    std::string frame(1, first);
+    char maskBit = masked ? (char) 0x80 : 0;
+    if (body.size() < 126) {
+        frame += (char) (maskBit | body.size());
+    } else if (body.size() <= 0xffff) {
+        frame += (char) (maskBit | 126);
+        frame += (char) (body.size() >> 8);
+        frame += (char) body.size();
+    } else {
+        frame += (char) (maskBit | 127);
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            frame += (char) ((uint64_t) body.size() >> shift);
+        }
+    }
+    if (!masked) {
+        return frame + body;
+    }
+    frame.append((const char *) mask, 4);
+    for (size_t i = 0; i < body.size(); i++) {
+        frame += (char) (body[i] ^ mask[i & 3]);
+    }
+    return frame;
+}
+
+// A session past the upgrade
+struct Session {
+    WebSocketSession ws;
+    std::string payload;
+    std::string reply;
+
+    Session() {
+        ws.Receive(Request("13").data(), Request("13").size(), payload, reply);
+        reply.clear();
+    }
+
+    bool Receive(const std::string &bytes) {
+        return ws.Receive(bytes.data(), bytes.size(), payload, reply);
+    }
+};
+
+void Upgrade() {
+    WebSocketSession ws;
+    std::string payload;
+    std::string reply;
+    std::string request = Request("13");
+    // The request head may arrive in pieces
+    Expect(ws.Receive(request.data(), 20, payload, reply) && reply.empty() && !ws.Upgraded(),
+           "partial request head waits for the rest");
+    std::string hello = ClientFrame(fin | text, "Hello");
+    std::string rest = request.substr(20) + hello;
+    Expect(ws.Receive(rest.data(), rest.size(), payload, reply) && ws.Upgraded(), "upgrade accepted");
+    Expect(reply.compare(0, 12, "HTTP/1.1 101") == 0 &&
+           reply.find("Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n") != std::string::npos,
+           "101 carries the RFC 6455 accept key");
+    Expect(payload == "Hello\n", "frame sent right behind the request head is delivered");
+
+    WebSocketSession old;
+    reply.clear();
+    request = Request("8");
+    Expect(!old.Receive(request.data(), request.size(), payload, reply), "version 8 is refused");
+    Expect(reply.compare(0, 12, "HTTP/1.1 426") == 0 && reply.find("Sec-WebSocket-Version: 13\r\n") != std::string::npos,
+           "426 names the supported version");
+
+    WebSocketSession bad;
+    reply.clear();
+    request = "GET /ws HTTP/1.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Version: 13\r\n\r\n";
+    Expect(!bad.Receive(request.data(), request.size(), payload, reply) && reply.compare(0, 12, "HTTP/1.1 400") == 0,
+           "missing key is a 400");
+
+    WebSocketSession huge;
+    reply.clear();
+    request = "GET /ws HTTP/1.1\r\n" + std::string(9000, 'x');
+    Expect(!huge.Receive(request.data(), request.size(), payload, reply) && reply.compare(0, 12, "HTTP/1.1 431") == 0,
+           "endless request head is a 431");
+}
+
+void Masking() {
+    Session s;
+    // The masked "Hello" example of RFC 6455 section 5.7
+    Expect(s.Receive(std::string("\x81\x85\x37\xfa\x21\x3d\x7f\x9f\x4d\x51\x58", 11)) && s.payload == "Hello\n",
+           "RFC example frame unmasks to Hello");
+
+    Session unmasked;
+    Expect(!unmasked.Receive(ClientFrame(fin | text, "Hello", false)) && unmasked.reply == closeProtocolError,
+           "unmasked client frame closes with 1002");
+
+    Session reserved;
+    Expect(!reserved.Receive(ClientFrame(fin | 0x40 | text, "Hello")) && reserved.reply == closeProtocolError,
+           "reserved bit closes with 1002");
+
+    Session opcode;
+    Expect(!opcode.Receive(ClientFrame(fin | 0x3, "Hello")) && opcode.reply == closeProtocolError,
+           "reserved opcode closes with 1002");
+}
+
+void Fragmentation() {
+    Session s;
+    Expect(s.Receive(ClientFrame(text, "Hel")) && s.payload.empty(), "first fragment is held");
+    Expect(s.Receive(ClientFrame(fin | ping, "probe")) && s.reply == ClientFrame(fin | 0xa, "probe", false),
+           "ping between fragments is answered with a pong");
+    Expect(s.Receive(ClientFrame(continuation, "lo, ")) && s.payload.empty(), "middle fragment is held");
+    Expect(s.Receive(ClientFrame(fin | continuation, "world\n")) && s.payload == "Hello, world\n",
+           "fragments are joined into one line");
+
+    // Byte at a time, across frames
+    Session slow;
+    std::string bytes = ClientFrame(binary, "a=1") + ClientFrame(fin | continuation, "|") + ClientFrame(fin | text, "b");
+    bool ok = true;
+    for (char c : bytes) {
+        ok = slow.Receive(std::string(1, c)) && ok;
+    }
+    Expect(ok && slow.payload == "a=1|\nb\n", "frames fed one byte at a time");
+
+    Session orphan;
+    Expect(!orphan.Receive(ClientFrame(fin | continuation, "x")) && orphan.reply == closeProtocolError,
+           "continuation with no message started closes with 1002");
+
+    Session interleaved;
+    Expect(!interleaved.Receive(ClientFrame(text, "a") + ClientFrame(fin | text, "b")) &&
+           interleaved.reply == closeProtocolError, "new message inside a fragmented one closes with 1002");
+
+    Session control;
+    Expect(!control.Receive(ClientFrame(ping, "x")) && control.reply == closeProtocolError,
+           "fragmented control frame closes with 1002");
+
+    Session longControl;
+    Expect(!longControl.Receive(ClientFrame(fin | ping, std::string(126, 'x'))) &&
+           longControl.reply == closeProtocolError, "control frame over 125 bytes closes with 1002");
+}
+
+void Lengths() {
+    Session medium;
+    std::string body(300, 'm');
+    Expect(medium.Receive(ClientFrame(fin | text, body)) && medium.payload == body + "\n", "16 bit length");
+
+    Session large;
+    body.assign(70000, 'l');
+    Expect(large.Receive(ClientFrame(fin | text, body)) && large.payload == body + "\n", "64 bit length");
+
+    size_t limit = WebSocketSession::maxMessage;
+    WebSocketSession::maxMessage = 1024;
+
+    Session oversized;
+    std::string frame = ClientFrame(fin | text, std::string(2000, 'o'));
+    // Refused from the header alone, before the body arrives
+    Expect(!oversized.Receive(frame.substr(0, 8)) && oversized.reply == closeTooBig,
+           "oversized message closes with 1009");
+
+    Session fragments;
+    Expect(fragments.Receive(ClientFrame(text, std::string(600, 'f'))) &&
+           !fragments.Receive(ClientFrame(fin | continuation, std::string(600, 'f'))) &&
+           fragments.reply == closeTooBig, "fragments adding up past the limit close with 1009");
+
+    WebSocketSession::maxMessage = limit;
+
+    for (size_t length : {(size_t) 5, (size_t) 125, (size_t) 126, (size_t) 300, (size_t) 65535, (size_t) 65536}) {
+        std::string out = WebSocketSession::Frame(GatherMessage(MakeMessageBuffer(std::string(length, 'x'))), false)
+                .Flatten();
+        size_t header = length < 126 ? 2 : length <= 0xffff ? 4 : 10;
+        uint64_t encoded = 0;
+        if (header == 2) {
+            encoded = (unsigned char) out[1];
+        } else {
+            for (size_t i = 2; i < header; i++) {
+                encoded = (encoded << 8) | (unsigned char) out[i];
+            }
+        }
+        Expect(out.size() == header + length && (unsigned char) out[0] == 0x81 && encoded == length &&
+               ((unsigned char) out[1] & 0x80) == 0, "outbound frame of " + std::to_string(length) + " bytes");
+    }
+    std::string binaryFrame = WebSocketSession::Frame(GatherMessage(MakeMessageBuffer(std::string("z"))), true)
+            .Flatten();
+    Expect(binaryFrame == std::string("\x82\x01z", 3), "compressed sessions get binary frames");
+}
+
+void Closing() {
+    Session s;
+    Expect(!s.Receive(ClientFrame(fin | 0x8, std::string("\x03\xe8", 2) + "bye")) &&
+           s.reply == std::string("\x88\x02\x03\xe8", 4), "close is echoed with its status code");
+}
+
+}
+
+int main() {
+    Upgrade();
+    Masking();
+    Fragmentation();
+    Lengths();
+    Closing();
+    if (failures == 0) {
+        std::cout << "WebSocket: all cases passed" << std::endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
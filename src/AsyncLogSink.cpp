@@ -0,0 +1,219 @@
+#include "AsyncLogSink.h"
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+
+#include <unistd.h>
+
+std::atomic<int> AsyncLogSink::currentLevel(plog::info);
+std::atomic<int> AsyncLogSink::requestedLevel(-1);
+
+AsyncLogSink::AsyncLogSink() : slots(new Slot[capacity]), tail(0), dropped(0), running(true) {
+    for (size_t i = 0; i < capacity; i++) {
+        slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    colors = isatty(STDOUT_FILENO) != 0;
+    worker = std::thread(&AsyncLogSink::Run, this);
+}
+
+AsyncLogSink::~AsyncLogSink() {
+    Stop();
+}
+
+/*
+  Stop():
+                Writes out whatever is queued and ends the sink thread. Records
+                logged afterwards stay in the ring unwritten.
+*/
+void AsyncLogSink::Stop() {
+    running.store(false);
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+/*
+  write():
+                Called by plog on the logging thread. Claims a slot the way a
+                bounded MPMC ring does (per-slot sequence numbers), copies the
+                record in and publishes it; never allocates or takes a lock.
+*/
+void AsyncLogSink::write(const plog::Record &record) {
+    size_t pos = tail.load(std::memory_order_relaxed);
+    Slot *slot;
+    for (;;) {
+        slot = &slots[pos & (capacity - 1)];
+        size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t) sequence - (intptr_t) pos;
+        if (diff == 0) {
+            if (tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    Entry &entry = slot->entry;
+    entry.severity = record.getSeverity();
+    entry.tid = record.getTid();
+    entry.time = record.getTime().time;
+    entry.millitm = record.getTime().millitm;
+    entry.line = record.getLine();
+
+    const char *func = record.getFunc();
+    size_t funcLength = strnlen(func, funcSize - 1);
+    memcpy(entry.func, func, funcLength);
+    entry.func[funcLength] = '\0';
+
+    const char *message = record.getMessage();
+    entry.length = strnlen(message, messageSize);
+    entry.truncated = entry.length == messageSize;
+    memcpy(entry.message, message, entry.length);
+
+    slot->sequence.store(pos + 1, std::memory_order_release);
+}
+
+uint64_t AsyncLogSink::Dropped() const {
+    return dropped.load(std::memory_order_relaxed);
+}
+
+void AsyncLogSink::SetLevel(plog::Severity level) {
+    plog::get()->setMaxSeverity(level);
+    currentLevel.store(level);
+}
+
+void AsyncLogSink::RequestMoreVerbose() {
+    int pending = requestedLevel.load();
+    int level = (pending >= 0 ? pending : currentLevel.load()) + 1;
+    requestedLevel.store(level > plog::verbose ? (int) plog::verbose : level);
+}
+
+void AsyncLogSink::RequestLessVerbose() {
+    int pending = requestedLevel.load();
+    int level = (pending >= 0 ? pending : currentLevel.load()) - 1;
+    requestedLevel.store(level < plog::fatal ? (int) plog::fatal : level);
+}
+
+/*
+  InstallSignalHandlers():
+                SIGUSR1 makes logging one level more verbose, SIGUSR2 one
+                level quieter, without restarting the bridge.
+*/
+void AsyncLogSink::InstallSignalHandlers() {
+    signal(SIGUSR1, OnSignal);
+    signal(SIGUSR2, OnSignal);
+}
+
+void AsyncLogSink::OnSignal(int signal) {
+    if (signal == SIGUSR1) {
+        RequestMoreVerbose();
+    } else if (signal == SIGUSR2) {
+        RequestLessVerbose();
+    }
+}
+
+void AsyncLogSink::Run() {
+    std::string out;
+    out.reserve(64 * 1024);
+
+    for (;;) {
+        int level = requestedLevel.exchange(-1);
+        if (level >= 0) {
+            SetLevel((plog::Severity) level);
+            out.append("Log level set to ").append(plog::severityToString((plog::Severity) level)).append("\n");
+        }
+
+        bool stopping = !running.load();
+        bool any = Drain(out);
+
+        uint64_t lost = dropped.load(std::memory_order_relaxed);
+        if (lost != reported) {
+            out.append("Log queue full, dropped ").append(std::to_string(lost - reported)).append(" messages\n");
+            reported = lost;
+        }
+
+        if (!out.empty()) {
+            fwrite(out.data(), 1, out.size(), stdout);
+            fflush(stdout);
+            out.clear();
+        }
+
+        if (stopping) {
+            return;
+        }
+        if (!any) {
+            // Polling keeps producers from ever paying for a wakeup
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+}
+
+bool AsyncLogSink::Drain(std::string &out) {
+    bool any = false;
+    for (;;) {
+        Slot &slot = slots[head & (capacity - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != head + 1) {
+            return any;
+        }
+        Format(slot.entry, out);
+        slot.sequence.store(head + capacity, std::memory_order_release);
+        head++;
+        any = true;
+    }
+}
+
+/*
+  Format():
+                Same layout as plog's TxtFormatter, with the console colors
+                of ColorConsoleAppender when writing to a terminal.
+*/
+void AsyncLogSink::Format(const Entry &entry, std::string &out) const {
+    const char *color = nullptr;
+    if (colors) {
+        switch (entry.severity) {
+            case plog::fatal:
+                color = "\x1B[97m\x1B[41m";
+                break;
+            case plog::error:
+                color = "\x1B[91m";
+                break;
+            case plog::warning:
+                color = "\x1B[93m";
+                break;
+            case plog::debug:
+            case plog::verbose:
+                color = "\x1B[96m";
+                break;
+            default:
+                break;
+        }
+    }
+    if (color) {
+        out.append(color);
+    }
+
+    tm t{};
+    localtime_r(&entry.time, &t);
+    char prefix[128];
+    int n = snprintf(prefix, sizeof(prefix), "%04d-%02d-%02d %02d:%02d:%02d.%03u %-5s [%u] [",
+                     t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec,
+                     (unsigned) entry.millitm, plog::severityToString(entry.severity), entry.tid);
+    out.append(prefix, n < 0 ? 0 : std::min((size_t) n, sizeof(prefix) - 1));
+    out.append(entry.func).append("@").append(std::to_string(entry.line)).append("] ");
+    out.append(entry.message, entry.length);
+    if (entry.truncated) {
+        out.append("...");
+    }
+
+    if (color) {
+        out.append("\x1B[0m\x1B[0K");
+    }
+    out.append("\n");
+}
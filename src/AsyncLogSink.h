@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <memory>
+#include <thread>
+
+#include "amm/BaseLogger.h"
+
+/*
+  Debug logging on the DDS-to-TCP delivery path. Building with
+  TCP_BRIDGE_STRIP_HOT_LOGS removes these statements, operands included.
+*/
+#ifdef TCP_BRIDGE_STRIP_HOT_LOGS
+#define HOT_LOG_DEBUG if (true) {} else LOG_DEBUG
+#else
+#define HOT_LOG_DEBUG LOG_DEBUG
+#endif
+
+/*
+  AsyncLogSink:
+                plog appender that only copies the record into a bounded
+                lock-free ring; a background thread formats and writes it to
+                the console. A full ring drops the record and counts it, so
+                the thread delivering data never waits on the terminal.
+*/
+class AsyncLogSink : public plog::IAppender {
+public:
+    AsyncLogSink();
+
+    ~AsyncLogSink() override;
+
+    void write(const plog::Record &record) override;
+
+    void Stop();
+
+    uint64_t Dropped() const;
+
+    // Applies immediately; only call from a normal thread context
+    static void SetLevel(plog::Severity level);
+
+    // Async-signal-safe: one step more or less verbose, applied by the sink thread
+    static void RequestMoreVerbose();
+
+    static void RequestLessVerbose();
+
+    static void InstallSignalHandlers();
+
+private:
+    static const size_t capacity = 2048;
+    static const size_t messageSize = 1024;
+    static const size_t funcSize = 64;
+
+    struct Entry {
+        plog::Severity severity;
+        unsigned int tid;
+        time_t time;
+        unsigned short millitm;
+        size_t line;
+        char func[funcSize];
+        char message[messageSize];
+        size_t length;
+        bool truncated;
+    };
+
+    struct Slot {
+        std::atomic<size_t> sequence;
+        Entry entry;
+    };
+
+    void Run();
+
+    bool Drain(std::string &out);
+
+    void Format(const Entry &entry, std::string &out) const;
+
+    static void OnSignal(int signal);
+
+    std::unique_ptr<Slot[]> slots;
+    std::atomic<size_t> tail;
+    size_t head = 0;
+
+    std::atomic<uint64_t> dropped;
+    uint64_t reported = 0;
+
+    bool colors;
+    std::atomic<bool> running;
+    std::thread worker;
+
+    static std::atomic<int> currentLevel;
+    static std::atomic<int> requestedLevel;
+};
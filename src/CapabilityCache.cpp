@@ -0,0 +1,50 @@
+#include "CapabilityCache.h"
+
+#include <functional>
+
+CapabilityCache::CapabilityCache(size_t capacity) : capacity(capacity) {
+}
+
+std::shared_ptr<const CapabilityCache::Entry> CapabilityCache::Find(const std::string &payload) {
+    size_t key = std::hash<std::string>()(payload);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(key);
+    // The payload is compared too, a hash collision is a miss
+    if (it != entries.end() && it->second->second->payload == payload) {
+        hits++;
+        recency.splice(recency.begin(), recency, it->second);
+        return it->second->second;
+    }
+    misses++;
+    return nullptr;
+}
+
+void CapabilityCache::Insert(std::shared_ptr<const Entry> entry) {
+    size_t key = std::hash<std::string>()(entry->payload);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+        it->second->second = std::move(entry);
+        recency.splice(recency.begin(), recency, it->second);
+        return;
+    }
+    if (capacity == 0) {
+        return;
+    }
+    if (entries.size() >= capacity) {
+        entries.erase(recency.back().first);
+        recency.pop_back();
+    }
+    recency.emplace_front(key, std::move(entry));
+    entries[key] = recency.begin();
+}
+
+std::pair<size_t, size_t> CapabilityCache::TakeCounts() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::pair<size_t, size_t> counts(hits, misses);
+    hits = 0;
+    misses = 0;
+    return counts;
+}
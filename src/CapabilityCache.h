@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "EventFilterIndex.h"
+#include "ProjectionIndex.h"
+#include "TopicRegistry.h"
+
+// Capability name and its settings, in document order
+typedef std::vector<std::pair<std::string, std::map<std::string, std::string>>> SettingsList;
+
+/*
+  What a module's CAPABILITY document declares, parsed off the read path
+  and applied to the routing tables in one step.
+*/
+struct CapabilityProfile {
+    std::string name;
+    std::string manufacturer;
+    std::string model;
+    std::string serialNumber;
+    std::string moduleVersion;
+    SettingsList startingSettings;
+    // Distinct topic ids
+    std::vector<TopicId> subscribed;
+    std::vector<TopicId> published;
+    // Wildcard subscriptions such as "BloodChemistry_*", expanded by SubscriptionIndex
+    std::vector<std::string> subscribedPatterns;
+    // Event topics subscribed with predicates, routed by EventFilterIndex
+    std::vector<std::pair<TopicId, EventFilter>> eventFilters;
+    // Fields wanted from event topics, for clients that do not want the full frame
+    std::vector<std::pair<TopicId, FieldMask>> projections;
+};
+
+/*
+  CapabilityCache:
+                Parsed profiles keyed by a hash of the raw base64 payload.
+                Modules of one type announce byte-identical capabilities on
+                every connect, so after the first one a reconnect skips both
+                the base64 decode and the XML walk. When full, the entry hit
+                least recently makes room.
+*/
+class CapabilityCache {
+public:
+    struct Entry {
+        std::string payload;
+        // Decoded XML, still published as the module's capabilities schema
+        std::string document;
+        CapabilityProfile profile;
+    };
+
+    explicit CapabilityCache(size_t capacity);
+
+    std::shared_ptr<const Entry> Find(const std::string &payload);
+
+    void Insert(std::shared_ptr<const Entry> entry);
+
+    // Lookups since the last call: hits first, misses second
+    std::pair<size_t, size_t> TakeCounts();
+
+private:
+    typedef std::list<std::pair<size_t, std::shared_ptr<const Entry>>> Recency;
+
+    size_t capacity;
+    size_t hits = 0;
+    size_t misses = 0;
+    // Most recently hit or inserted first
+    Recency recency;
+    std::unordered_map<size_t, Recency::iterator> entries;
+    std::mutex mutex;
+};
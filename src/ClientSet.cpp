@@ -0,0 +1,26 @@
+#include "ClientSet.h"
+
+#include <algorithm>
+
+void ClientSet::Set(ClientHandle client, bool member) {
+    boost::unique_lock<boost::shared_mutex> lock(mutex);
+    if (member) {
+        clients.insert(client);
+    } else {
+        clients.erase(client);
+    }
+    size.store(clients.size(), std::memory_order_relaxed);
+}
+
+bool ClientSet::Take(std::vector<ClientHandle> &subscribers) const {
+    if (size.load(std::memory_order_relaxed) == 0) {
+        return false;
+    }
+    boost::shared_lock<boost::shared_mutex> lock(mutex);
+    auto end = std::remove_if(subscribers.begin(), subscribers.end(), [this](ClientHandle client) {
+        return clients.count(client) > 0;
+    });
+    bool any = end != subscribers.end();
+    subscribers.erase(end, subscribers.end());
+    return any;
+}
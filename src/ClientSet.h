@@ -0,0 +1,30 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <boost/thread/shared_mutex.hpp>
+
+#include "Net/ClientHandle.h"
+
+/*
+  ClientSet:
+                Clients that take a topic family over another transport than
+                their session, such as the shared memory ring or multicast.
+                A listener calls Take() on its subscriber list to split them
+                out; while the set is empty that costs one atomic load.
+*/
+class ClientSet {
+public:
+    void Set(ClientHandle client, bool member);
+
+    // Removes the members from subscribers; true if there were any
+    bool Take(std::vector<ClientHandle> &subscribers) const;
+
+private:
+    std::unordered_set<ClientHandle> clients;
+    std::atomic<size_t> size{0};
+    mutable boost::shared_mutex mutex;
+};
@@ -0,0 +1,27 @@
+#include "DurationStat.h"
+
+void DurationStat::Add(std::chrono::steady_clock::duration duration) {
+    std::lock_guard<std::mutex> lock(mutex);
+    count++;
+    total += duration;
+    if (duration > max) {
+        max = duration;
+    }
+}
+
+DurationStat::Summary DurationStat::Take() {
+    std::lock_guard<std::mutex> lock(mutex);
+    typedef std::chrono::duration<double, std::milli> Millis;
+
+    Summary summary{};
+    summary.count = count;
+    if (count > 0) {
+        summary.meanMs = Millis(total).count() / count;
+        summary.maxMs = Millis(max).count();
+    }
+
+    count = 0;
+    total = std::chrono::steady_clock::duration(0);
+    max = std::chrono::steady_clock::duration(0);
+    return summary;
+}
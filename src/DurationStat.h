@@ -0,0 +1,29 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+/*
+  DurationStat:
+                Count, mean and maximum of a duration, reset each time it is
+                read. Meant for periodic log lines, not for histograms.
+*/
+class DurationStat {
+public:
+    struct Summary {
+        uint64_t count;
+        double meanMs;
+        double maxMs;
+    };
+
+    void Add(std::chrono::steady_clock::duration duration);
+
+    Summary Take();
+
+private:
+    std::mutex mutex;
+    uint64_t count = 0;
+    std::chrono::steady_clock::duration total{0};
+    std::chrono::steady_clock::duration max{0};
+};
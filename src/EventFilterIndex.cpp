@@ -0,0 +1,109 @@
+#include "EventFilterIndex.h"
+
+#include <algorithm>
+#include <functional>
+#include <mutex>
+
+bool EventFilter::Empty() const {
+    for (auto &values : accepted) {
+        if (!values.empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool EventFilter::Accepts(const std::string *const *values) const {
+    for (int field = 0; field < FieldCount; field++) {
+        const std::vector<std::string> &allowed = accepted[field];
+        if (!allowed.empty() && std::find(allowed.begin(), allowed.end(), *values[field]) == allowed.end()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t EventFilterIndex::KeyHash::operator()(const Key &key) const {
+    size_t h = std::hash<std::string>()(key.value);
+    return h ^ ((size_t) key.topic * 31 + (size_t) key.field + 0x9e3779b9 + (h << 6) + (h >> 2));
+}
+
+void EventFilterIndex::Replace(ClientHandle client,
+                               const std::vector<std::pair<TopicId, EventFilter>> &filters) {
+    std::unique_lock<boost::shared_mutex> lock(mutex);
+    ClearLocked(client);
+
+    // Most selective field first
+    const EventFilter::Field anchors[] = {EventFilter::Participant, EventFilter::Location, EventFilter::Type};
+
+    for (auto &filter : filters) {
+        if (filter.second.Empty()) {
+            continue;
+        }
+        std::unique_ptr<Entry> entry(new Entry{client, filter.first, filter.second, EventFilter::Type});
+        for (EventFilter::Field field : anchors) {
+            if (!entry->filter.accepted[field].empty()) {
+                entry->anchor = field;
+                break;
+            }
+        }
+        for (auto &value : entry->filter.accepted[entry->anchor]) {
+            byValue[Key{entry->topic, entry->anchor, value}].push_back(entry.get());
+        }
+        byClient[client].push_back(std::move(entry));
+    }
+}
+
+void EventFilterIndex::Clear(ClientHandle client) {
+    std::unique_lock<boost::shared_mutex> lock(mutex);
+    ClearLocked(client);
+}
+
+void EventFilterIndex::ClearLocked(ClientHandle client) {
+    auto it = byClient.find(client);
+    if (it == byClient.end()) {
+        return;
+    }
+    for (auto &entry : it->second) {
+        for (auto &value : entry->filter.accepted[entry->anchor]) {
+            auto bucket = byValue.find(Key{entry->topic, entry->anchor, value});
+            if (bucket == byValue.end()) {
+                continue;
+            }
+            std::vector<const Entry *> &entries = bucket->second;
+            entries.erase(std::remove(entries.begin(), entries.end(), entry.get()), entries.end());
+            if (entries.empty()) {
+                byValue.erase(bucket);
+            }
+        }
+    }
+    byClient.erase(it);
+}
+
+void EventFilterIndex::AddMatches(const std::vector<TopicId> &topics, const std::string &type,
+                                  const std::string &location, const std::string &participant,
+                                  std::vector<ClientHandle> &recipients) const {
+    const std::string *values[EventFilter::FieldCount] = {&type, &location, &participant};
+
+    boost::shared_lock<boost::shared_mutex> lock(mutex);
+    if (byValue.empty()) {
+        return;
+    }
+    for (TopicId topic : topics) {
+        for (int field = 0; field < EventFilter::FieldCount; field++) {
+            if (values[field]->empty()) {
+                continue;
+            }
+            auto bucket = byValue.find(Key{topic, (EventFilter::Field) field, *values[field]});
+            if (bucket == byValue.end()) {
+                continue;
+            }
+            for (const Entry *entry : bucket->second) {
+                if (entry->filter.Accepts(values) &&
+                    std::find(recipients.begin(), recipients.end(), entry->client) == recipients.end()) {
+                    recipients.push_back(entry->client);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/thread/shared_mutex.hpp>
+
+#include "Net/ClientHandle.h"
+#include "TopicRegistry.h"
+
+/*
+  EventFilter:
+                Subscription-time predicates on an event stream. Each field
+                lists the values a client accepts; an empty list accepts any
+                value. An event must pass every field that has values.
+*/
+struct EventFilter {
+    enum Field {
+        Type,
+        Location,
+        Participant,
+        FieldCount
+    };
+
+    std::vector<std::string> accepted[FieldCount];
+
+    bool Empty() const;
+
+    // One value per field, in Field order
+    bool Accepts(const std::string *const *values) const;
+};
+
+/*
+  EventFilterIndex:
+                Filtered subscriptions to event topics. Each filter is hashed
+                under the values of one anchor field (the most selective one
+                it declares: participant, then location, then type), so an
+                event costs one lookup per field and a check of only the
+                filters that share one of its values, however many clients
+                are connected.
+*/
+class EventFilterIndex {
+public:
+    // Swaps in a client's filtered subscriptions; unfiltered ones stay in SubscriptionIndex
+    void Replace(ClientHandle client, const std::vector<std::pair<TopicId, EventFilter>> &filters);
+
+    void Clear(ClientHandle client);
+
+    // Appends the clients whose filter on one of the topics accepts the event, skipping any already listed
+    void AddMatches(const std::vector<TopicId> &topics, const std::string &type, const std::string &location,
+                    const std::string &participant, std::vector<ClientHandle> &recipients) const;
+
+private:
+    struct Entry {
+        ClientHandle client;
+        TopicId topic;
+        EventFilter filter;
+        EventFilter::Field anchor;
+    };
+
+    struct Key {
+        TopicId topic;
+        EventFilter::Field field;
+        std::string value;
+
+        bool operator==(const Key &other) const {
+            return topic == other.topic && field == other.field && value == other.value;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key &key) const;
+    };
+
+    void ClearLocked(ClientHandle client);
+
+    std::unordered_map<ClientHandle, std::vector<std::unique_ptr<Entry>>> byClient;
+    std::unordered_map<Key, std::vector<const Entry *>, KeyHash> byValue;
+    mutable boost::shared_mutex mutex;
+};
@@ -0,0 +1,95 @@
+#include "AdmissionControl.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+double AdmissionControl::acceptRate = 200;
+size_t AdmissionControl::acceptBurst = 50;
+size_t AdmissionControl::maxHandshakes = 64;
+std::chrono::seconds AdmissionControl::handshakeTimeout(10);
+
+const std::chrono::milliseconds AdmissionControl::retryInterval(10);
+
+AdmissionControl::State &AdmissionControl::Admission() {
+    static State *state = new State();
+    return *state;
+}
+
+std::chrono::milliseconds AdmissionControl::Wait() {
+    State &s = Admission();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto now = std::chrono::steady_clock::now();
+
+    if (maxHandshakes > 0 && s.handshakes.size() >= maxHandshakes) {
+        Expire(s, now);
+        if (s.handshakes.size() >= maxHandshakes) {
+            // Slots free up when a handshake completes, check back shortly
+            return retryInterval;
+        }
+    }
+
+    if (acceptRate > 0) {
+        Refill(s, now);
+        if (s.tokens < 1) {
+            double seconds = (1 - s.tokens) / acceptRate;
+            return std::chrono::milliseconds((int64_t) std::ceil(seconds * 1000));
+        }
+    }
+    return std::chrono::milliseconds(0);
+}
+
+void AdmissionControl::Admit(Client *c) {
+    State &s = Admission();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto now = std::chrono::steady_clock::now();
+
+    if (acceptRate > 0) {
+        Refill(s, now);
+        s.tokens = std::max(s.tokens - 1, 0.0);
+    }
+    if (maxHandshakes > 0) {
+        s.handshakes[c] = now;
+    }
+}
+
+void AdmissionControl::Completed(Client *c) {
+    State &s = Admission();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.handshakes.erase(c);
+}
+
+size_t AdmissionControl::Handshaking() {
+    State &s = Admission();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    return s.handshakes.size();
+}
+
+void AdmissionControl::Refill(State &s, std::chrono::steady_clock::time_point now) {
+    double burst = (double) std::max<size_t>(acceptBurst, 1);
+    if (!s.filled) {
+        s.tokens = burst;
+        s.filled = true;
+    } else {
+        double elapsed = std::chrono::duration<double>(now - s.refilled).count();
+        s.tokens = std::min(burst, s.tokens + elapsed * acceptRate);
+    }
+    s.refilled = now;
+}
+
+/*
+  Expire():
+                Stops counting handshakes older than handshakeTimeout, so
+                clients that never send capabilities (or a lost completion)
+                cannot hold the gate shut.
+*/
+void AdmissionControl::Expire(State &s, std::chrono::steady_clock::time_point now) {
+    for (auto it = s.handshakes.begin(); it != s.handshakes.end();) {
+        if (now - it->second >= handshakeTimeout) {
+            it = s.handshakes.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+
+#include "Client.h"
+
+using namespace std;
+
+/*
+  AdmissionControl:
+                Paces new sessions during a reconnect storm. A token bucket
+                caps how fast connections are taken off the listen backlog,
+                and at most maxHandshakes sessions may be between connecting
+                and having their capabilities applied. Connections that are
+                not admitted yet stay queued in the kernel (or parked by the
+                io_uring backend) instead of all handshaking at once.
+*/
+class AdmissionControl {
+public:
+    // New sessions per second, 0 disables the rate limit
+    static double acceptRate;
+    static size_t acceptBurst;
+
+    // Concurrent handshakes, 0 disables the cap
+    static size_t maxHandshakes;
+
+    // A session that never completes stops counting after this long
+    static std::chrono::seconds handshakeTimeout;
+
+    // Time until the next session may be admitted, zero if one may now
+    static std::chrono::milliseconds Wait();
+
+    // Takes a token and starts counting the client's handshake
+    static void Admit(Client *c);
+
+    // The client's handshake finished or the client went away
+    static void Completed(Client *c);
+
+    static size_t Handshaking();
+
+private:
+    static const std::chrono::milliseconds retryInterval;
+
+    struct State {
+        double tokens = 0;
+        bool filled = false;
+        std::chrono::steady_clock::time_point refilled;
+        std::unordered_map<Client *, std::chrono::steady_clock::time_point> handshakes;
+        std::mutex mutex;
+    };
+
+    static void Refill(State &s, std::chrono::steady_clock::time_point now);
+
+    static void Expire(State &s, std::chrono::steady_clock::time_point now);
+
+    static State &Admission();
+};
@@ -0,0 +1,133 @@
+#include "BufferPool.h"
+
+#include <new>
+
+using namespace std;
+
+// Set once this thread's cache is gone; buffers released during static
+// destruction after that go straight back to the heap
+static thread_local bool cacheRetired = false;
+
+void BufferPool::FreeList::Push(FreeBlock *block) {
+    block->next = head;
+    head = block;
+    count++;
+}
+
+BufferPool::FreeBlock *BufferPool::FreeList::Pop() {
+    FreeBlock *block = head;
+    if (block) {
+        head = block->next;
+        count--;
+    }
+    return block;
+}
+
+BufferPool::ThreadCache::~ThreadCache() {
+    // Hand everything to the depot so other threads can reuse it
+    cacheRetired = true;
+
+    Depot &depot = SharedDepot();
+    std::lock_guard<std::mutex> lock(depot.mutex);
+    for (int i = 0; i < classCount; i++) {
+        while (FreeBlock *block = lists[i].Pop()) {
+            depot.lists[i].Push(block);
+        }
+    }
+}
+
+void *BufferPool::Allocate(size_t bytes) {
+    if (bytes > maxPooledSize) {
+        return ::operator new(bytes);
+    }
+
+    int sizeClass = SizeClass(bytes);
+    ThreadCache *cache = Cache();
+    if (!cache) {
+        return ::operator new(ClassSize(sizeClass));
+    }
+    FreeList &list = cache->lists[sizeClass];
+
+    if (!list.head) {
+        Depot &depot = SharedDepot();
+        std::lock_guard<std::mutex> lock(depot.mutex);
+        for (size_t i = 0; i < batchSize; i++) {
+            FreeBlock *block = depot.lists[sizeClass].Pop();
+            if (!block) {
+                break;
+            }
+            list.Push(block);
+        }
+    }
+
+    if (FreeBlock *block = list.Pop()) {
+        return block;
+    }
+    return ::operator new(ClassSize(sizeClass));
+}
+
+void BufferPool::Release(void *block, size_t bytes) {
+    if (!block) {
+        return;
+    }
+    if (bytes > maxPooledSize) {
+        ::operator delete(block);
+        return;
+    }
+
+    int sizeClass = SizeClass(bytes);
+    ThreadCache *cache = Cache();
+    if (!cache) {
+        ::operator delete(block);
+        return;
+    }
+    FreeList &list = cache->lists[sizeClass];
+    list.Push((FreeBlock *) block);
+
+    if (list.count <= CacheLimit(sizeClass)) {
+        return;
+    }
+
+    // Over this thread's share, move a batch to the depot
+    Depot &depot = SharedDepot();
+    std::lock_guard<std::mutex> lock(depot.mutex);
+    for (size_t i = 0; i < batchSize; i++) {
+        FreeBlock *spare = list.Pop();
+        if (depot.lists[sizeClass].count >= 4 * CacheLimit(sizeClass)) {
+            ::operator delete(spare);
+        } else {
+            depot.lists[sizeClass].Push(spare);
+        }
+    }
+}
+
+int BufferPool::SizeClass(size_t bytes) {
+    int sizeClass = 0;
+    while (ClassSize(sizeClass) < bytes) {
+        sizeClass++;
+    }
+    return sizeClass;
+}
+
+size_t BufferPool::ClassSize(int sizeClass) {
+    return (size_t) 64 << sizeClass;
+}
+
+size_t BufferPool::CacheLimit(int sizeClass) {
+    size_t limit = cacheBytes / ClassSize(sizeClass);
+    return limit < batchSize ? batchSize : limit;
+}
+
+BufferPool::ThreadCache *BufferPool::Cache() {
+    if (cacheRetired) {
+        return nullptr;
+    }
+    thread_local ThreadCache cache;
+    return &cache;
+}
+
+BufferPool::Depot &BufferPool::SharedDepot() {
+    // Never destroyed, thread caches may flush into it during exit
+    static Depot *depot = new Depot();
+    return *depot;
+}
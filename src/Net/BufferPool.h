@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+
+using namespace std;
+
+/*
+  BufferPool:
+                Size-classed free lists for outbound message memory. Each
+                thread keeps its own lists, so allocating and recycling a
+                buffer takes no lock; a thread that only frees (e.g. the
+                sender) hands its surplus to a shared depot that allocating
+                threads refill from in batches.
+*/
+class BufferPool {
+public:
+    static void *Allocate(size_t bytes);
+
+    static void Release(void *block, size_t bytes);
+
+    // Larger requests go straight to the heap
+    static const size_t maxPooledSize = 64 * 1024;
+
+private:
+    static const int classCount = 11;   // 64 bytes .. 64 KiB
+    static const size_t cacheBytes = 256 * 1024;
+    static const size_t batchSize = 16;
+
+    struct FreeBlock {
+        FreeBlock *next;
+    };
+
+    struct FreeList {
+        FreeBlock *head = nullptr;
+        size_t count = 0;
+
+        void Push(FreeBlock *block);
+
+        FreeBlock *Pop();
+    };
+
+    struct ThreadCache {
+        FreeList lists[classCount];
+
+        ~ThreadCache();
+    };
+
+    struct Depot {
+        FreeList lists[classCount];
+        std::mutex mutex;
+    };
+
+    static int SizeClass(size_t bytes);
+
+    static size_t ClassSize(int sizeClass);
+
+    static size_t CacheLimit(int sizeClass);
+
+    static ThreadCache *Cache();
+
+    static Depot &SharedDepot();
+};
+
+/*
+  Standard allocator backed by BufferPool, for the strings, control blocks
+  and segment lists that make up outbound messages.
+*/
+template<typename T>
+class PoolAllocator {
+public:
+    typedef T value_type;
+
+    PoolAllocator() = default;
+
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U> &) {}
+
+    T *allocate(size_t n) {
+        return (T *) BufferPool::Allocate(n * sizeof(T));
+    }
+
+    void deallocate(T *p, size_t n) {
+        BufferPool::Release(p, n * sizeof(T));
+    }
+};
+
+template<typename T, typename U>
+bool operator==(const PoolAllocator<T> &, const PoolAllocator<U> &) {
+    return true;
+}
+
+template<typename T, typename U>
+bool operator!=(const PoolAllocator<T> &, const PoolAllocator<U> &) {
+    return false;
+}
+
+typedef std::basic_string<char, std::char_traits<char>, PoolAllocator<char>> OutboundString;
@@ -20,3 +20,47 @@ void Client::SetId(std::string id) { this->id = id; }
 void Client::SetKeepHistory(bool historyflag) {
     this->keepHistory = historyflag;
 }
+
+void Client::SetCompression(CompressionCodec codec) {
+    this->compression = codec;
+}
+
+void Client::Reset() {
+    id.clear();
+    name.clear();
+    uuid.clear();
+    clientType.clear();
+    handle = ClientHandle();
+    keepHistory = false;
+    compression = CompressionCodec::None;
+    websocket.reset();
+    sock = 0;
+    lastReceived.store(0);
+}
+
+std::mutex ClientPool::mutex;
+std::vector<Client *> ClientPool::idle;
+
+Client *ClientPool::Acquire() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!idle.empty()) {
+            Client *c = idle.back();
+            idle.pop_back();
+            return c;
+        }
+    }
+    return new Client();
+}
+
+void ClientPool::Release(Client *c) {
+    c->Reset();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (idle.size() < maxIdle) {
+            idle.push_back(c);
+            return;
+        }
+    }
+    delete c;
+}
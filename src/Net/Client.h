@@ -1,11 +1,19 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <iostream>
 #include <sstream>
 #include <cstdio>
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
+#include <mutex>
+
+#include "ClientHandle.h"
+#include "Compression.h"
+#include "WebSocket.h"
 
 #define MAX_NAME_LENGTH 40
 
@@ -16,11 +24,22 @@ public:
     std::string uuid;
     std::string clientType;
 
+    // Assigned while the client is in Server::clients
+    ClientHandle handle;
+
     bool keepHistory = false;
 
+    CompressionCodec compression = CompressionCodec::None;
+
+    // Set for sessions accepted on the WebSocket port
+    std::unique_ptr<WebSocketSession> websocket;
+
     // Socket stuff
     int sock{};
 
+    // Milliseconds on ConnectionMonitor's clock, stamped on every read
+    std::atomic<int64_t> lastReceived{0};
+
     Client() {};
 
     void SetId(std::string id);
@@ -32,5 +51,30 @@ public:
     void SetClientType(std::string &clientType);
 
     void SetKeepHistory(bool historyflag);
+
+    void SetCompression(CompressionCodec codec);
+
+    // Back to the state of a freshly constructed client
+    void Reset();
+};
+
+/*
+  ClientPool:
+                Recycles Client objects across connections so a reconnect
+                storm does not allocate per-session state for every socket.
+                A client may only be released once nothing refers to it any
+                more: it is out of Server::clients and its socket is closed.
+*/
+class ClientPool {
+public:
+    static Client *Acquire();
+
+    static void Release(Client *c);
+
+private:
+    static const size_t maxIdle = 256;
+
+    static std::mutex mutex;
+    static std::vector<Client *> idle;
 };
 
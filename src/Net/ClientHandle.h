@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+/*
+  ClientHandle:
+                Names a session in the routing indexes without its id string.
+                The slot is dense and reused once a session has left; the
+                generation tells a later session in the same slot apart, so a
+                stale handle resolves to no client instead of the wrong one.
+*/
+struct ClientHandle {
+    uint32_t slot = 0;
+    // 0 for a client that has no slot
+    uint32_t generation = 0;
+
+    bool Valid() const {
+        return generation != 0;
+    }
+
+    bool operator==(const ClientHandle &other) const {
+        return slot == other.slot && generation == other.generation;
+    }
+
+    bool operator!=(const ClientHandle &other) const {
+        return !(*this == other);
+    }
+};
+
+namespace std {
+template<>
+struct hash<ClientHandle> {
+    size_t operator()(const ClientHandle &handle) const {
+        return std::hash<uint64_t>()(((uint64_t) handle.generation << 32) | handle.slot);
+    }
+};
+}
@@ -0,0 +1,121 @@
+#include "Compression.h"
+
+#include <sstream>
+#include <vector>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
+using namespace std;
+
+// Small name=value| frames are cheaper to send than to compress
+size_t Compressor::threshold = 512;
+
+/*
+  Negotiate():
+                Picks the first codec in the client's preference list that
+                this build supports. Spaces around the names are ignored, so
+                "lz4, deflate" reads the same as "lz4,deflate".
+*/
+CompressionCodec Compressor::Negotiate(const std::string &offer) {
+    std::istringstream in(offer);
+    std::string token;
+    while (std::getline(in, token, ',')) {
+        size_t first = token.find_first_not_of(" \t\r\n");
+        if (first == std::string::npos) {
+            continue;
+        }
+        size_t last = token.find_last_not_of(" \t\r\n");
+        std::string name = token.substr(first, last - first + 1);
+#ifdef HAVE_LZ4
+        if (name == "lz4") {
+            return CompressionCodec::LZ4;
+        }
+#endif
+#ifdef HAVE_ZLIB
+        if (name == "deflate") {
+            return CompressionCodec::Deflate;
+        }
+#endif
+    }
+    return CompressionCodec::None;
+}
+
+std::string Compressor::Name(CompressionCodec codec) {
+    switch (codec) {
+        case CompressionCodec::Deflate:
+            return "deflate";
+        case CompressionCodec::LZ4:
+            return "lz4";
+        default:
+            return "none";
+    }
+}
+
+GatherMessage Compressor::Apply(CompressionCodec codec, const GatherMessage &message) {
+    if (codec == CompressionCodec::None || message.Size() < threshold) {
+        return message;
+    }
+
+    std::string raw = message.Flatten();
+    OutboundString packed;
+    bool ok = false;
+    switch (codec) {
+        case CompressionCodec::Deflate:
+            ok = Deflate(raw, packed);
+            break;
+        case CompressionCodec::LZ4:
+            ok = Lz4(raw, packed);
+            break;
+        default:
+            break;
+    }
+
+    // Not worth it when the payload does not shrink
+    if (!ok || packed.size() >= raw.size()) {
+        return message;
+    }
+
+    std::ostringstream header;
+    header << "COMPRESSED=" << Name(codec) << ";" << raw.size() << ";" << packed.size() << "\n";
+
+    GatherMessage compressed;
+    compressed.Append(header.str());
+    compressed.Append(std::move(packed));
+    compressed.SetTrace(message.Trace());
+    return compressed;
+}
+
+bool Compressor::Deflate(const std::string &in, OutboundString &out) {
+#ifdef HAVE_ZLIB
+    uLongf length = compressBound(in.size());
+    out.resize(length);
+    if (compress2((Bytef *) &out[0], &length, (const Bytef *) in.data(), in.size(),
+                  Z_DEFAULT_COMPRESSION) != Z_OK) {
+        return false;
+    }
+    out.resize(length);
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool Compressor::Lz4(const std::string &in, OutboundString &out) {
+#ifdef HAVE_LZ4
+    out.resize(LZ4_compressBound((int) in.size()));
+    int length = LZ4_compress_default(in.data(), &out[0], (int) in.size(), (int) out.size());
+    if (length <= 0) {
+        return false;
+    }
+    out.resize(length);
+    return true;
+#else
+    return false;
+#endif
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+
+#include "MessageBuffer.h"
+
+using namespace std;
+
+enum class CompressionCodec {
+    None = 0,
+    Deflate = 1,
+    LZ4 = 2
+};
+
+/*
+  Compressor:
+                Per-message compression for clients that negotiated it with
+                COMPRESSION=<codec>[,<codec>...]. Messages of at least
+                `threshold` bytes are replaced by a frame of the form
+
+                    COMPRESSED=<codec>;<original length>;<compressed length>\n
+                    <compressed bytes>
+
+                whose payload inflates to the original protocol lines. Each
+                message is compressed on its own so one compressed copy can be
+                shared by every client using the same codec.
+*/
+class Compressor {
+public:
+    static CompressionCodec Negotiate(const std::string &offer);
+
+    static std::string Name(CompressionCodec codec);
+
+    static GatherMessage Apply(CompressionCodec codec, const GatherMessage &message);
+
+    static size_t threshold;
+
+private:
+    static bool Deflate(const std::string &in, OutboundString &out);
+
+    static bool Lz4(const std::string &in, OutboundString &out);
+};
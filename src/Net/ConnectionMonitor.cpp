@@ -0,0 +1,205 @@
+#include "ConnectionMonitor.h"
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+#include <linux/sockios.h>
+#include <linux/tcp.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+using namespace std;
+
+std::chrono::seconds ConnectionMonitor::idleTimeout(0);
+std::chrono::seconds ConnectionMonitor::writeTimeout(30);
+
+const std::chrono::milliseconds ConnectionMonitor::tick(10);
+const std::chrono::milliseconds ConnectionMonitor::writeCheckInterval(1000);
+
+void ConnectionMonitor::Start() {
+    State &m = Monitor();
+    std::lock_guard<std::mutex> lock(m.mutex);
+    if (m.started) {
+        return;
+    }
+    m.started = true;
+    std::thread(Run).detach();
+}
+
+void ConnectionMonitor::Watch(Client *c) {
+    Received(c);
+
+    State &m = Monitor();
+    std::lock_guard<std::mutex> lock(m.mutex);
+    auto *w = new Watched();
+    w->client = c;
+    w->lastProgress = Now();
+    m.watched[c].reset(w);
+
+    if (idleTimeout.count() > 0) {
+        w->idleTimer.callback = [w] { CheckIdle(w); };
+        m.wheel.Schedule(w->idleTimer, idleTimeout);
+    }
+    if (writeTimeout.count() > 0) {
+        w->writeTimer.callback = [w] { CheckWrites(w); };
+        m.wheel.Schedule(w->writeTimer, writeCheckInterval);
+    }
+}
+
+void ConnectionMonitor::Forget(Client *c) {
+    State &m = Monitor();
+    std::lock_guard<std::mutex> lock(m.mutex);
+    auto it = m.watched.find(c);
+    if (it == m.watched.end()) {
+        return;
+    }
+    m.wheel.Cancel(it->second->idleTimer);
+    m.wheel.Cancel(it->second->writeTimer);
+    m.watched.erase(it);
+}
+
+/*
+  Received():
+                Called by the transports for every read. Only stamps the
+                client; the idle timer compares against it when it fires
+                instead of being rescheduled per message.
+*/
+void ConnectionMonitor::Received(Client *c) {
+    c->lastReceived.store(Now(), std::memory_order_relaxed);
+}
+
+void ConnectionMonitor::Every(std::chrono::milliseconds interval, std::function<void()> task) {
+    Add(interval, std::move(task), false);
+}
+
+void ConnectionMonitor::After(std::chrono::milliseconds delay, std::function<void()> task) {
+    Add(delay, std::move(task), true);
+}
+
+void ConnectionMonitor::Add(std::chrono::milliseconds interval, std::function<void()> task, bool once) {
+    State &m = Monitor();
+    std::lock_guard<std::mutex> lock(m.mutex);
+    auto *t = new Task();
+    t->interval = interval;
+    t->run = std::move(task);
+    t->once = once;
+    t->timer.callback = [t] { t->due = true; };
+    m.tasks.emplace_back(t);
+    m.wheel.Schedule(t->timer, interval);
+}
+
+int64_t ConnectionMonitor::Now() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void ConnectionMonitor::Run() {
+    State &m = Monitor();
+    std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+    std::vector<Task *> due;
+
+    while (true) {
+        std::this_thread::sleep_until(next);
+
+        {
+            std::lock_guard<std::mutex> lock(m.mutex);
+            m.wheel.Advance(std::chrono::steady_clock::now());
+            for (auto &t : m.tasks) {
+                if (t->due) {
+                    due.push_back(t.get());
+                }
+            }
+            next = m.wheel.NextTick();
+        }
+
+        // Tasks run unlocked so they may call back into the monitor
+        for (Task *t : due) {
+            t->run();
+
+            std::lock_guard<std::mutex> lock(m.mutex);
+            if (t->once) {
+                m.tasks.erase(std::find_if(m.tasks.begin(), m.tasks.end(), [t](const std::unique_ptr<Task> &task) {
+                    return task.get() == t;
+                }));
+                continue;
+            }
+            t->due = false;
+            m.wheel.Schedule(t->timer, t->interval);
+        }
+        due.clear();
+    }
+}
+
+/*
+  Should be called with the monitor mutex held.
+*/
+void ConnectionMonitor::CheckIdle(Watched *w) {
+    int64_t idle = Now() - w->client->lastReceived.load(std::memory_order_relaxed);
+    int64_t limit = std::chrono::duration_cast<std::chrono::milliseconds>(idleTimeout).count();
+
+    if (idle >= limit) {
+        Evict(w, "nothing received before the idle timeout");
+        return;
+    }
+    Monitor().wheel.Schedule(w->idleTimer, std::chrono::milliseconds(limit - idle));
+}
+
+/*
+  CheckWrites():
+                The connection is making progress while the kernel send queue
+                is empty or the peer keeps acknowledging bytes. A queue that
+                sits still for writeTimeout means the peer stopped reading or
+                is gone. Should be called with the monitor mutex held.
+*/
+void ConnectionMonitor::CheckWrites(Watched *w) {
+    int sock = w->client->sock;
+
+    int queued = 0;
+    ioctl(sock, SIOCOUTQ, &queued);
+
+    tcp_info info{};
+    socklen_t infoSize = sizeof(info);
+    bool haveAcked = getsockopt(sock, IPPROTO_TCP, TCP_INFO, &info, &infoSize) == 0 &&
+                     infoSize >= offsetof(tcp_info, tcpi_bytes_acked) + sizeof(info.tcpi_bytes_acked);
+
+    bool progress = queued == 0 || (haveAcked ? info.tcpi_bytes_acked != w->acked : queued < w->queued);
+    w->queued = queued;
+    if (haveAcked) {
+        w->acked = info.tcpi_bytes_acked;
+    }
+
+    int64_t now = Now();
+    if (progress) {
+        w->lastProgress = now;
+    } else if (now - w->lastProgress >= std::chrono::duration_cast<std::chrono::milliseconds>(writeTimeout).count()) {
+        Evict(w, "no write progress before the write timeout");
+        return;
+    }
+    Monitor().wheel.Schedule(w->writeTimer, writeCheckInterval);
+}
+
+/*
+  Evict():
+                Shutting the socket down (not closing it) keeps the descriptor
+                valid for the transport, which sees end-of-stream and cleans
+                up as for any other disconnect. Should be called with the
+                monitor mutex held.
+*/
+void ConnectionMonitor::Evict(Watched *w, const char *reason) {
+    if (w->evicted) {
+        return;
+    }
+    w->evicted = true;
+    Monitor().wheel.Cancel(w->idleTimer);
+    Monitor().wheel.Cancel(w->writeTimer);
+
+    cerr << "Disconnecting client " << w->client->id << ": " << reason << endl;
+    shutdown(w->client->sock, SHUT_RDWR);
+}
+
+ConnectionMonitor::State &ConnectionMonitor::Monitor() {
+    static State *state = new State();
+    return *state;
+}
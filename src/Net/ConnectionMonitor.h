@@ -0,0 +1,89 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "Client.h"
+#include "TimerWheel.h"
+
+using namespace std;
+
+/*
+  ConnectionMonitor:
+                One thread turning a TimerWheel for every connection. Each
+                client gets an idle timer (nothing received, keepalives
+                included, for idleTimeout) and a write-progress timer (kernel
+                send queue not draining for writeTimeout). A client that
+                misses either deadline has its socket shut down, which wakes
+                any send blocked on it and lets the transport run its normal
+                disconnect path. The same wheel runs periodic housekeeping
+                tasks registered with Every(), and one-off ones with After().
+*/
+class ConnectionMonitor {
+public:
+    // 0 disables the check
+    static std::chrono::seconds idleTimeout;
+    static std::chrono::seconds writeTimeout;
+
+    static void Start();
+
+    static void Watch(Client *c);
+
+    // Must be called before the client's socket is closed
+    static void Forget(Client *c);
+
+    static void Received(Client *c);
+
+    static void Every(std::chrono::milliseconds interval, std::function<void()> task);
+
+    static void After(std::chrono::milliseconds delay, std::function<void()> task);
+
+    static int64_t Now();
+
+private:
+    struct Watched {
+        Client *client;
+        TimerWheel::Timer idleTimer;
+        TimerWheel::Timer writeTimer;
+        int queued = 0;
+        uint64_t acked = 0;
+        int64_t lastProgress = 0;
+        bool evicted = false;
+    };
+
+    struct Task {
+        std::chrono::milliseconds interval;
+        std::function<void()> run;
+        TimerWheel::Timer timer;
+        bool due = false;
+        bool once = false;
+    };
+
+    static void Add(std::chrono::milliseconds interval, std::function<void()> task, bool once);
+
+    static void Run();
+
+    static void CheckIdle(Watched *w);
+
+    static void CheckWrites(Watched *w);
+
+    static void Evict(Watched *w, const char *reason);
+
+    static const std::chrono::milliseconds tick;
+    static const std::chrono::milliseconds writeCheckInterval;
+
+    struct State {
+        TimerWheel wheel{tick};
+        std::unordered_map<Client *, std::unique_ptr<Watched>> watched;
+        std::vector<std::unique_ptr<Task>> tasks;
+        std::mutex mutex;
+        bool started = false;
+    };
+
+    // Never destroyed, the monitor thread outlives static destruction
+    static State &Monitor();
+};
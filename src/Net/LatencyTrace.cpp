@@ -0,0 +1,260 @@
+#include "LatencyTrace.h"
+
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+
+using namespace std;
+
+unsigned LatencyTrace::sampleEvery = 0;
+std::string LatencyTrace::traceFile;
+
+namespace {
+
+// Bucket i holds intervals below 2^i microseconds
+const int bucketCount = 32;
+const size_t keptSpans = 4096;
+
+const char *const intervalNames[] = {"dds", "format", "queue", "wait", "write", "total"};
+const int intervalCount = 6;
+
+struct Histogram {
+    uint64_t buckets[bucketCount] = {};
+    uint64_t count = 0;
+    int64_t maxNs = 0;
+
+    void Add(int64_t ns) {
+        int64_t us = ns / 1000;
+        int bucket = 0;
+        while (bucket < bucketCount - 1 && us >= (1LL << bucket)) {
+            bucket++;
+        }
+        buckets[bucket]++;
+        count++;
+        if (ns > maxNs) {
+            maxNs = ns;
+        }
+    }
+
+    // Upper bound of the bucket holding the given fraction of samples, in us
+    int64_t Percentile(double fraction) const {
+        uint64_t target = (uint64_t) (fraction * count);
+        uint64_t seen = 0;
+        for (int i = 0; i < bucketCount; i++) {
+            seen += buckets[i];
+            if (seen > target) {
+                return 1LL << i;
+            }
+        }
+        return 1LL << (bucketCount - 1);
+    }
+};
+
+struct Finished {
+    std::string topic;
+    uint64_t sequence;
+    int64_t sourceNs;
+    int64_t entryWallNs;
+    int64_t stamps[LatencySpan::StageCount];
+};
+
+struct State {
+    std::atomic<uint64_t> counter{0};
+    std::mutex mutex;
+    Histogram intervals[intervalCount];
+    std::deque<Finished> recent;
+    int64_t origin = LatencyTrace::SteadyNs();
+};
+
+// Never destroyed, spans may finish during static destruction
+State &Tracing() {
+    static State *state = new State();
+    return *state;
+}
+
+int64_t WallNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+}
+
+LatencySpan::LatencySpan(const std::string &topic, uint64_t sequence, int64_t sourceNs)
+        : topic(topic), sequence(sequence), sourceNs(sourceNs), entryWallNs(WallNs()) {
+    for (auto &stamp : stamps) {
+        stamp.store(0, std::memory_order_relaxed);
+    }
+    stamps[ListenerEntry].store(LatencyTrace::SteadyNs(), std::memory_order_relaxed);
+}
+
+LatencySpan::~LatencySpan() {
+    LatencyTrace::Finish(*this);
+}
+
+void LatencySpan::Stamp(Stage stage) {
+    int64_t expected = 0;
+    stamps[stage].compare_exchange_strong(expected, LatencyTrace::SteadyNs());
+}
+
+void LatencySpan::StampLatest(Stage stage) {
+    int64_t now = LatencyTrace::SteadyNs();
+    int64_t current = stamps[stage].load();
+    while (current < now && !stamps[stage].compare_exchange_weak(current, now)) {
+    }
+}
+
+int64_t LatencyTrace::SteadyNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+LatencySpanPtr LatencyTrace::Begin(const std::string &topic, int64_t sourceNs) {
+    if (sampleEvery == 0) {
+        return nullptr;
+    }
+    uint64_t sequence = Tracing().counter.fetch_add(1, std::memory_order_relaxed);
+    if (sequence % sampleEvery != 0) {
+        return nullptr;
+    }
+    return std::make_shared<LatencySpan>(topic, sequence, sourceNs);
+}
+
+/*
+  Finish():
+                Spans that were never queued to a client (no subscribers
+                left by the time the message was formatted) are not counted.
+*/
+void LatencyTrace::Finish(const LatencySpan &span) {
+    Finished f;
+    for (int i = 0; i < LatencySpan::StageCount; i++) {
+        f.stamps[i] = span.stamps[i].load();
+    }
+    if (f.stamps[LatencySpan::Enqueued] == 0) {
+        return;
+    }
+    f.topic = span.topic;
+    f.sequence = span.sequence;
+    f.sourceNs = span.sourceNs;
+    f.entryWallNs = span.entryWallNs;
+
+    // Stage pairs in intervalNames order; "dds" uses the system clock
+    const int from[] = {-1, LatencySpan::ListenerEntry, LatencySpan::Formatted, LatencySpan::Enqueued,
+                        LatencySpan::FirstByte, LatencySpan::ListenerEntry};
+    const int to[] = {-1, LatencySpan::Formatted, LatencySpan::Enqueued, LatencySpan::FirstByte,
+                      LatencySpan::LastByte, LatencySpan::LastByte};
+
+    State &s = Tracing();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (f.sourceNs > 0 && f.entryWallNs >= f.sourceNs) {
+        s.intervals[0].Add(f.entryWallNs - f.sourceNs);
+    }
+    for (int i = 1; i < intervalCount; i++) {
+        if (f.stamps[from[i]] > 0 && f.stamps[to[i]] >= f.stamps[from[i]]) {
+            s.intervals[i].Add(f.stamps[to[i]] - f.stamps[from[i]]);
+        }
+    }
+
+    s.recent.push_back(std::move(f));
+    if (s.recent.size() > keptSpans) {
+        s.recent.pop_front();
+    }
+}
+
+bool LatencyTrace::TakeSummary(std::string &out) {
+    State &s = Tracing();
+    std::lock_guard<std::mutex> lock(s.mutex);
+
+    std::ostringstream summary;
+    bool any = false;
+    for (int i = 0; i < intervalCount; i++) {
+        Histogram &h = s.intervals[i];
+        if (h.count == 0) {
+            continue;
+        }
+        any = true;
+        summary << "\n  " << intervalNames[i] << ": " << h.count << " samples, p50 <" << h.Percentile(0.5)
+                << " us p90 <" << h.Percentile(0.9) << " us p99 <" << h.Percentile(0.99)
+                << " us max " << h.maxNs / 1000 << " us |";
+        for (int b = 0; b < bucketCount; b++) {
+            if (h.buckets[b] > 0) {
+                summary << " <" << (1LL << b) << "us:" << h.buckets[b];
+            }
+        }
+        h = Histogram();
+    }
+    out = summary.str();
+    return any;
+}
+
+/*
+  Export():
+                Writes the kept spans as Chrome trace events: one async
+                track per message with a slice per stage, the DDS source
+                timestamp and transport delay in its arguments. Written to a
+                temporary file and renamed, so a reader never sees half.
+*/
+void LatencyTrace::Export() {
+    if (traceFile.empty()) {
+        return;
+    }
+
+    static const char *const stageNames[] = {"format", "queue", "wait", "write"};
+
+    std::ostringstream json;
+    // Microseconds with ns resolution, never in exponent notation
+    json << std::fixed << std::setprecision(3);
+    {
+        State &s = Tracing();
+        std::lock_guard<std::mutex> lock(s.mutex);
+
+        json << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        bool first = true;
+        for (auto &f : s.recent) {
+            auto event = [&](const char *name, const char *phase, int64_t ns) {
+                json << (first ? "" : ",") << "\n{\"name\":\"" << name << "\",\"cat\":\"latency\",\"ph\":\""
+                     << phase << "\",\"id\":" << f.sequence << ",\"pid\":1,\"tid\":1,\"ts\":"
+                     << (ns - s.origin) / 1000.0;
+                first = false;
+            };
+
+            int64_t end = f.stamps[LatencySpan::LastByte] ? f.stamps[LatencySpan::LastByte]
+                                                            : f.stamps[LatencySpan::Enqueued];
+            event(f.topic.c_str(), "b", f.stamps[LatencySpan::ListenerEntry]);
+            json << ",\"args\":{\"source_ns\":" << f.sourceNs << ",\"dds_us\":"
+                 << (f.sourceNs > 0 ? (f.entryWallNs - f.sourceNs) / 1000.0 : 0.0) << "}}";
+
+            for (int stage = 0; stage < 4; stage++) {
+                int64_t from = f.stamps[stage];
+                int64_t to = f.stamps[stage + 1];
+                if (from == 0 || to < from) {
+                    continue;
+                }
+                event(stageNames[stage], "b", from);
+                json << "}";
+                event(stageNames[stage], "e", to);
+                json << "}";
+            }
+
+            event(f.topic.c_str(), "e", end);
+            json << "}";
+        }
+        json << "\n]}\n";
+    }
+
+    std::string tmp = traceFile + ".tmp";
+    FILE *file = fopen(tmp.c_str(), "w");
+    if (!file) {
+        cerr << "Could not write latency trace to " << tmp << endl;
+        return;
+    }
+    std::string text = json.str();
+    bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), traceFile.c_str()) != 0) {
+        cerr << "Could not write latency trace to " << traceFile << endl;
+    }
+}
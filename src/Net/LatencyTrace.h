@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+using namespace std;
+
+/*
+  LatencySpan:
+                Timestamps of one sampled message on its way from the DDS
+                listener to the sockets. It travels with the GatherMessage;
+                once the last copy is gone (every recipient written or
+                dropped) the span is handed to LatencyTrace.
+*/
+class LatencySpan {
+public:
+    enum Stage {
+        ListenerEntry,
+        Formatted,
+        Enqueued,
+        FirstByte,
+        LastByte,
+        StageCount
+    };
+
+    LatencySpan(const std::string &topic, uint64_t sequence, int64_t sourceNs);
+
+    ~LatencySpan();
+
+    // Keeps the earliest stamp, e.g. the first recipient to get a byte
+    void Stamp(Stage stage);
+
+    // Keeps the latest stamp, e.g. the last recipient to get every byte
+    void StampLatest(Stage stage);
+
+private:
+    friend class LatencyTrace;
+
+    std::string topic;
+    uint64_t sequence;
+    // DDS source timestamp and listener entry, both on the system clock
+    int64_t sourceNs;
+    int64_t entryWallNs;
+    // Steady clock, 0 when the stage was never reached
+    std::atomic<int64_t> stamps[StageCount];
+};
+
+typedef std::shared_ptr<LatencySpan> LatencySpanPtr;
+
+/*
+  LatencyTrace:
+                Sampled end-to-end latency tracing. One in sampleEvery
+                physiology samples gets a LatencySpan; finished spans feed
+                per-stage histograms and a Chrome trace event file (open it
+                in chrome://tracing or Perfetto). With sampling off, Begin()
+                returns null and every stamp is a null check.
+*/
+class LatencyTrace {
+public:
+    // Trace one in this many samples, 0 turns tracing off
+    static unsigned sampleEvery;
+
+    // Chrome trace of the most recent spans, rewritten by Export()
+    static std::string traceFile;
+
+    static LatencySpanPtr Begin(const std::string &topic, int64_t sourceNs);
+
+    static void Stamp(LatencySpan *span, LatencySpan::Stage stage) {
+        if (span) {
+            span->Stamp(stage);
+        }
+    }
+
+    static void StampLatest(LatencySpan *span, LatencySpan::Stage stage) {
+        if (span) {
+            span->StampLatest(stage);
+        }
+    }
+
+    // One line per stage for the spans finished since the last call
+    static bool TakeSummary(std::string &out);
+
+    static void Export();
+
+    static int64_t SteadyNs();
+
+private:
+    friend class LatencySpan;
+
+    static void Finish(const LatencySpan &span);
+};
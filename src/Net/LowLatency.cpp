@@ -0,0 +1,118 @@
+#include "LowLatency.h"
+
+#include <cerrno>
+#include <iostream>
+#include <stdexcept>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+
+using namespace std;
+
+bool LowLatency::enabled = false;
+std::vector<int> LowLatency::ioCores;
+std::vector<int> LowLatency::ddsCores;
+std::chrono::microseconds LowLatency::busyPoll(0);
+int LowLatency::sendBuffer = 0;
+int LowLatency::receiveBuffer = 0;
+int LowLatency::notSentLowat = 16 * 1024;
+std::atomic<bool> LowLatency::reported(false);
+
+bool LowLatency::ParseCores(const std::string &list, std::vector<int> &cores) {
+    std::vector<int> parsed;
+    size_t at = 0;
+    while (at < list.size()) {
+        size_t end = list.find(',', at);
+        if (end == std::string::npos) {
+            end = list.size();
+        }
+        std::string range = list.substr(at, end - at);
+        size_t dash = range.find('-');
+        try {
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            if (first < 0 || last < first || last >= CPU_SETSIZE) {
+                return false;
+            }
+            for (int core = first; core <= last; core++) {
+                parsed.push_back(core);
+            }
+        } catch (const std::exception &) {
+            return false;
+        }
+        at = end + 1;
+    }
+    if (parsed.empty()) {
+        return false;
+    }
+    cores = parsed;
+    return true;
+}
+
+/*
+  TuneSocket():
+                TCP_NOTSENT_LOWAT keeps the kernel from buffering more than a
+                few messages ahead, so a backlog stays in the outbound queue.
+                Nothing there is replaced by newer samples; the queue only
+                drops the oldest telemetry once a client has more than
+                OutboundQueue::telemetryLimit (4 MiB) waiting.
+*/
+void LowLatency::TuneSocket(int sock) {
+    if (!enabled) {
+        return;
+    }
+
+    int domain = AF_INET;
+    socklen_t size = sizeof(domain);
+    getsockopt(sock, SOL_SOCKET, SO_DOMAIN, &domain, &size);
+    if (domain != AF_UNIX) {
+        Set(sock, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+        if (notSentLowat > 0) {
+            Set(sock, IPPROTO_TCP, TCP_NOTSENT_LOWAT, notSentLowat, "TCP_NOTSENT_LOWAT");
+        }
+    }
+    if (sendBuffer > 0) {
+        Set(sock, SOL_SOCKET, SO_SNDBUF, sendBuffer, "SO_SNDBUF");
+    }
+    if (receiveBuffer > 0) {
+        Set(sock, SOL_SOCKET, SO_RCVBUF, receiveBuffer, "SO_RCVBUF");
+    }
+#ifdef SO_BUSY_POLL
+    if (busyPoll.count() > 0) {
+        // Values above net.core.busy_read need CAP_NET_ADMIN
+        Set(sock, SOL_SOCKET, SO_BUSY_POLL, (int) busyPoll.count(), "SO_BUSY_POLL");
+    }
+#endif
+}
+
+void LowLatency::PinThread(const std::vector<int> &cores) {
+    if (!enabled || cores.empty()) {
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int core : cores) {
+        CPU_SET(core, &set);
+    }
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (ret != 0) {
+        cerr << "Cannot pin thread to the configured cores: " << ret << endl;
+    }
+}
+
+void LowLatency::PinDdsThread() {
+    static thread_local bool pinned = false;
+    if (!pinned) {
+        pinned = true;
+        PinThread(ddsCores);
+    }
+}
+
+void LowLatency::Set(int sock, int level, int option, int value, const char *name) {
+    if (setsockopt(sock, level, option, &value, sizeof(value)) < 0 && !reported.exchange(true)) {
+        cerr << "Low latency mode: cannot set " << name << ": " << errno << endl;
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+  LowLatency:
+                Deployment mode for rooms that care about tail latency more
+                than CPU. Accepted sockets get TCP_NODELAY, fixed buffer
+                sizes and TCP_NOTSENT_LOWAT; with busyPoll set, receives and
+                the io_uring loop spin that long before sleeping. The I/O
+                and DDS threads can be pinned to their own cores. Nothing
+                changes unless enabled is set.
+*/
+class LowLatency {
+public:
+    static bool enabled;
+
+    // Cores for the session I/O threads and for the DDS listener and
+    // publisher threads; empty leaves the thread to the scheduler
+    static std::vector<int> ioCores;
+    static std::vector<int> ddsCores;
+
+    // SO_BUSY_POLL and the event loop spin, 0 always sleeps at once
+    static std::chrono::microseconds busyPoll;
+
+    // 0 keeps the kernel's default
+    static int sendBuffer;
+    static int receiveBuffer;
+
+    // Unsent bytes a socket holds before the kernel stops taking more
+    static int notSentLowat;
+
+    // "2,3,6-7"; false and cores untouched when malformed
+    static bool ParseCores(const std::string &list, std::vector<int> &cores);
+
+    // Called for every accepted socket, TCP options are skipped for Unix sockets
+    static void TuneSocket(int sock);
+
+    // Pins the calling thread; threads it creates afterwards inherit the cores
+    static void PinThread(const std::vector<int> &cores);
+
+    // Once per thread, for threads the middleware creates
+    static void PinDdsThread();
+
+private:
+    // Only the first failed option is reported
+    static std::atomic<bool> reported;
+
+    static void Set(int sock, int level, int option, int value, const char *name);
+};
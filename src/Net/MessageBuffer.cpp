@@ -0,0 +1,77 @@
+#include "MessageBuffer.h"
+
+using namespace std;
+
+MessageBuffer MakeMessageBuffer(OutboundString &&content) {
+    return std::allocate_shared<OutboundString>(PoolAllocator<OutboundString>(), std::move(content));
+}
+
+MessageBuffer MakeMessageBuffer(const std::string &content) {
+    return MakeMessageBuffer(OutboundString(content.data(), content.size()));
+}
+
+MessageBuffer MakeMessageBuffer(const char *content) {
+    return MakeMessageBuffer(OutboundString(content));
+}
+
+GatherMessage::GatherMessage(const MessageBuffer &segment) {
+    Append(segment);
+}
+
+void GatherMessage::Append(const MessageBuffer &segment) {
+    if (!segment || segment->empty()) {
+        return;
+    }
+    segments.push_back(segment);
+    size += segment->size();
+}
+
+void GatherMessage::Append(OutboundString &&segment) {
+    Append(MakeMessageBuffer(std::move(segment)));
+}
+
+void GatherMessage::Append(const std::string &segment) {
+    Append(MakeMessageBuffer(segment));
+}
+
+void GatherMessage::Append(const GatherMessage &message) {
+    for (auto &segment : message.segments) {
+        Append(segment);
+    }
+}
+
+size_t GatherMessage::Size() const {
+    return size;
+}
+
+bool GatherMessage::Empty() const {
+    return size == 0;
+}
+
+void GatherMessage::FillIovec(std::vector<iovec> &iov) const {
+    iov.clear();
+    iov.reserve(segments.size());
+    for (auto &segment : segments) {
+        iovec v{};
+        v.iov_base = (void *) segment->data();
+        v.iov_len = segment->size();
+        iov.push_back(v);
+    }
+}
+
+std::string GatherMessage::Flatten() const {
+    std::string flat;
+    flat.reserve(size);
+    for (auto &segment : segments) {
+        flat.append(segment->data(), segment->size());
+    }
+    return flat;
+}
+
+void GatherMessage::SetTrace(const LatencySpanPtr &span) {
+    trace = span;
+}
+
+const LatencySpanPtr &GatherMessage::Trace() const {
+    return trace;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/uio.h>
+
+#include "BufferPool.h"
+#include "LatencyTrace.h"
+
+using namespace std;
+
+/*
+  Immutable payload shared by every recipient of an outbound message. The
+  text and its reference count both live in BufferPool memory and go back
+  to the pool when the last recipient lets go.
+*/
+typedef std::shared_ptr<const OutboundString> MessageBuffer;
+
+MessageBuffer MakeMessageBuffer(OutboundString &&content);
+
+MessageBuffer MakeMessageBuffer(const std::string &content);
+
+MessageBuffer MakeMessageBuffer(const char *content);
+
+/*
+  GatherMessage:
+                An outbound message assembled from several shared buffers.
+                The segments are handed to sendmsg() as an iovec list, so
+                large payloads are never concatenated or copied per client.
+*/
+class GatherMessage {
+public:
+    GatherMessage() = default;
+
+    explicit GatherMessage(const MessageBuffer &segment);
+
+    void Append(const MessageBuffer &segment);
+
+    void Append(OutboundString &&segment);
+
+    void Append(const std::string &segment);
+
+    // Shares the other message's segments, its trace is not taken over
+    void Append(const GatherMessage &message);
+
+    size_t Size() const;
+
+    bool Empty() const;
+
+    void FillIovec(std::vector<iovec> &iov) const;
+
+    std::string Flatten() const;
+
+    // Sampled messages carry their latency span, null otherwise
+    void SetTrace(const LatencySpanPtr &span);
+
+    const LatencySpanPtr &Trace() const;
+
+private:
+    std::vector<MessageBuffer, PoolAllocator<MessageBuffer>> segments;
+    size_t size = 0;
+    LatencySpanPtr trace;
+};
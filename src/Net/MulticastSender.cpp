@@ -0,0 +1,149 @@
+#include "MulticastSender.h"
+
+#include <cerrno>
+#include <iostream>
+
+#include <arpa/inet.h>
+#include <endian.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+using namespace std;
+
+MulticastSender::~MulticastSender() {
+    if (sock >= 0) {
+        close(sock);
+    }
+}
+
+bool MulticastSender::Open(const std::string &base, uint16_t port, int count, int ttl, const std::string &iface) {
+    in_addr first{};
+    if (inet_pton(AF_INET, base.c_str(), &first) != 1 || !IN_MULTICAST(ntohl(first.s_addr)) || count < 1) {
+        cerr << "Not a multicast group: " << base << endl;
+        return false;
+    }
+
+    sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        cerr << "Failed to create multicast socket" << endl;
+        return false;
+    }
+    unsigned char hops = (unsigned char) ttl;
+    unsigned char loop = 1;
+    setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &hops, sizeof(hops));
+    // Displays on the bridge's own host join the same groups
+    setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+    if (!iface.empty()) {
+        in_addr local{};
+        if (inet_pton(AF_INET, iface.c_str(), &local) != 1 ||
+            setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &local, sizeof(local)) < 0) {
+            cerr << "Cannot send multicast from " << iface << endl;
+            close(sock);
+            sock = -1;
+            return false;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        sockaddr_in group{};
+        group.sin_family = AF_INET;
+        group.sin_port = htons(port);
+        group.sin_addr.s_addr = htonl(ntohl(first.s_addr) + i);
+        groups.push_back(group);
+    }
+    sequences.assign(count, 0);
+    batches.assign(count, std::string());
+    for (auto &batch : batches) {
+        batch.reserve(datagramSize - sizeof(Datagram));
+    }
+    return true;
+}
+
+uint32_t MulticastSender::GroupHash(const std::string &topic) {
+    uint32_t hash = 2166136261u;
+    for (unsigned char c : topic) {
+        hash = (hash ^ c) * 16777619u;
+    }
+    return hash;
+}
+
+/*
+  Send():
+                A frame is never split across datagrams. One that does not
+                fit in a datagram by itself goes out alone, after the batch
+                queued before it, and is fragmented by IP.
+*/
+void MulticastSender::Send(const std::string &topic, const char *frame, size_t length) {
+    if (sock < 0) {
+        return;
+    }
+    uint32_t group = GroupHash(topic) % groups.size();
+    const size_t room = datagramSize - sizeof(Datagram);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string &batch = batches[group];
+    if (!batch.empty() && batch.size() + length > room) {
+        SendDatagram(group, batch.data(), batch.size());
+        batch.clear();
+    }
+    if (length > room) {
+        SendDatagram(group, frame, length);
+        return;
+    }
+    batch.append(frame, length);
+}
+
+void MulticastSender::Flush() {
+    if (sock < 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    for (uint32_t group = 0; group < batches.size(); group++) {
+        if (!batches[group].empty()) {
+            SendDatagram(group, batches[group].data(), batches[group].size());
+            batches[group].clear();
+        }
+    }
+}
+
+// The header and payload go out as one datagram without being copied together
+void MulticastSender::SendDatagram(uint32_t group, const char *payload, size_t length) {
+    Datagram header;
+    header.magic = htobe32(magic);
+    header.group = htobe32(group);
+    header.sequence = htobe64(sequences[group]++);
+
+    iovec iov[2];
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = const_cast<char *>(payload);
+    iov[1].iov_len = length;
+
+    msghdr msg{};
+    msg.msg_name = &groups[group];
+    msg.msg_namelen = sizeof(sockaddr_in);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    if (sendmsg(sock, &msg, MSG_DONTWAIT) < 0) {
+        // Clients see the lost datagram as a gap in the sequence
+        errors.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+std::string MulticastSender::Describe() const {
+    std::string out;
+    for (auto &group : groups) {
+        char address[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &group.sin_addr, address, sizeof(address));
+        if (!out.empty()) {
+            out += ",";
+        }
+        out += std::string(address) + ":" + std::to_string(ntohs(group.sin_port));
+    }
+    return out;
+}
+
+uint64_t MulticastSender::TakeErrors() {
+    return errors.exchange(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <netinet/in.h>
+
+using namespace std;
+
+/*
+  MulticastSender:
+                Publishes waveform frames as UDP datagrams to a small set of
+                multicast groups, so every viewer on the LAN gets a channel
+                from one send instead of one TCP stream each. Topics are
+                spread over the groups by the FNV-1a hash of their name;
+                clients join the group of each topic they want. Every
+                datagram starts with a Datagram header (big endian) whose
+                sequence counts per group, so a client can tell when it
+                missed one and fall back to its TCP session.
+
+                Frames are batched per group: a datagram carries as many
+                whole frames (text lines) as fit in datagramSize, and goes
+                out when the next frame would not fit or on Flush(), which
+                the owner calls on a timer tick.
+*/
+class MulticastSender {
+public:
+    static const uint32_t magic = 0x414d4d57; // "AMMW"
+    // An Ethernet MTU less the IPv4 and UDP headers
+    static const size_t datagramSize = 1472;
+
+    struct Datagram {
+        uint32_t magic;
+        uint32_t group;
+        uint64_t sequence;
+    };
+
+    MulticastSender() = default;
+
+    ~MulticastSender();
+
+    MulticastSender(const MulticastSender &) = delete;
+
+    MulticastSender &operator=(const MulticastSender &) = delete;
+
+    // Groups are consecutive addresses starting at base; iface empty for the default route
+    bool Open(const std::string &base, uint16_t port, int groups, int ttl, const std::string &iface);
+
+    bool Active() const {
+        return sock >= 0;
+    }
+
+    // Queues the frame on its group's batch
+    void Send(const std::string &topic, const char *frame, size_t length);
+
+    // Sends every partly filled batch
+    void Flush();
+
+    // "address:port" of every group, in group order, comma separated
+    std::string Describe() const;
+
+    uint64_t TakeErrors();
+
+    static uint32_t GroupHash(const std::string &topic);
+
+private:
+    void SendDatagram(uint32_t group, const char *payload, size_t length);
+
+    int sock = -1;
+    std::vector<sockaddr_in> groups;
+    // Guards sequences and batches; the listener sends, the timer flushes
+    std::mutex mutex;
+    std::vector<uint64_t> sequences;
+    std::vector<std::string> batches;
+    std::atomic<uint64_t> errors{0};
+};
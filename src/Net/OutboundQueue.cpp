@@ -0,0 +1,258 @@
+#include "OutboundQueue.h"
+
+#include <cerrno>
+#include <iostream>
+#include <thread>
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "LatencyTrace.h"
+#include "ZeroCopySender.h"
+
+using namespace std;
+
+size_t OutboundQueue::telemetryLimit = 4 * 1024 * 1024;
+
+OutboundQueue::State &OutboundQueue::Queues() {
+    static State *state = new State();
+    return *state;
+}
+
+void OutboundQueue::Start() {
+    State &s = Queues();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (s.epollFd >= 0) {
+        return;
+    }
+    s.epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (s.epollFd < 0) {
+        cerr << "epoll_create1 failed: " << errno << endl;
+        return;
+    }
+    std::thread(&OutboundQueue::Run).detach();
+}
+
+void OutboundQueue::Open(int sock) {
+    State &s = Queues();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.queues[sock] = SocketQueue();
+}
+
+void OutboundQueue::Send(int sock, const GatherMessage &message, SendPriority priority) {
+    if (message.Empty()) {
+        return;
+    }
+
+    State &s = Queues();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    // A socket that was never opened or is already forgotten gets nothing,
+    // so a reused fd cannot inherit a stale queue
+    auto it = s.queues.find(sock);
+    if (it == s.queues.end()) {
+        return;
+    }
+    SocketQueue &q = it->second;
+    if (q.broken) {
+        return;
+    }
+
+    if (priority == SendPriority::Telemetry) {
+        std::deque<GatherMessage> &lane = q.lanes[(int) SendPriority::Telemetry];
+        while (!lane.empty() && q.telemetryBytes + message.Size() > telemetryLimit) {
+            q.telemetryBytes -= lane.front().Size();
+            lane.pop_front();
+            s.dropped++;
+        }
+        q.telemetryBytes += message.Size();
+    }
+    q.lanes[(int) priority].push_back(message);
+    LatencyTrace::Stamp(message.Trace().get(), LatencySpan::Enqueued);
+
+    // Already waiting for the socket to become writable
+    if (q.armed) {
+        return;
+    }
+    Flush(sock, q);
+}
+
+void OutboundQueue::Forget(int sock) {
+    State &s = Queues();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto it = s.queues.find(sock);
+    if (it == s.queues.end()) {
+        return;
+    }
+    if (it->second.registered && s.epollFd >= 0) {
+        epoll_ctl(s.epollFd, EPOLL_CTL_DEL, sock, nullptr);
+    }
+    s.queues.erase(it);
+}
+
+uint64_t OutboundQueue::TakeDropped() {
+    State &s = Queues();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    uint64_t dropped = s.dropped;
+    s.dropped = 0;
+    return dropped;
+}
+
+void OutboundQueue::AddDropped(uint64_t count) {
+    State &s = Queues();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.dropped += count;
+}
+
+size_t OutboundQueue::Queued() {
+    State &s = Queues();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    size_t queued = 0;
+    for (auto &entry : s.queues) {
+        const SocketQueue &q = entry.second;
+        queued += q.lanes[0].size() + q.lanes[1].size() + (q.writing ? 1 : 0);
+    }
+    return queued;
+}
+
+/*
+  Flush():
+                Writes without blocking until the socket is full or the
+                queue is empty, picking the control lane first whenever a
+                new message starts. Called with the queue lock held.
+*/
+void OutboundQueue::Flush(int sock, SocketQueue &q) {
+    for (;;) {
+        if (!q.writing) {
+            int lane = !q.lanes[0].empty() ? 0 : !q.lanes[1].empty() ? 1 : -1;
+            if (lane < 0) {
+                return;
+            }
+            q.current = std::move(q.lanes[lane].front());
+            q.lanes[lane].pop_front();
+            if (lane == (int) SendPriority::Telemetry) {
+                q.telemetryBytes -= q.current.Size();
+            }
+            q.offset = 0;
+            q.writing = true;
+        }
+
+        ssize_t n = ZeroCopySender::SendSome(sock, q.current, q.offset);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                Arm(sock, q);
+                return;
+            }
+            // The receive side notices the dead connection and cleans up
+            q.broken = true;
+            q.reaping = false;
+            q.current = GatherMessage();
+            q.writing = false;
+            q.lanes[0].clear();
+            q.lanes[1].clear();
+            q.telemetryBytes = 0;
+            return;
+        }
+
+        if (q.offset == 0) {
+            LatencyTrace::Stamp(q.current.Trace().get(), LatencySpan::FirstByte);
+        }
+        q.offset += (size_t) n;
+        if (q.offset >= q.current.Size()) {
+            LatencyTrace::StampLatest(q.current.Trace().get(), LatencySpan::LastByte);
+            bool large = ZeroCopySender::threshold > 0 && q.current.Size() >= ZeroCopySender::threshold;
+            q.current = GatherMessage();
+            q.writing = false;
+            if (large && !q.reaping && ZeroCopySender::HasPending(sock)) {
+                q.reaping = true;
+                Watch(sock, q);
+            }
+        }
+    }
+}
+
+void OutboundQueue::Arm(int sock, SocketQueue &q) {
+    q.armed = true;
+    Watch(sock, q);
+}
+
+/*
+  Watch():
+                One-shot, so the socket is quiet until it is re-armed.
+                EPOLLERR is reported whatever the event mask, which is how a
+                socket waiting only for zerocopy completions is woken.
+*/
+void OutboundQueue::Watch(int sock, SocketQueue &q) {
+    State &s = Queues();
+    if (s.epollFd < 0 || (!q.armed && !q.reaping)) {
+        q.armed = false;
+        q.reaping = false;
+        return;
+    }
+    epoll_event ev{};
+    ev.events = EPOLLONESHOT | (q.armed ? EPOLLOUT : 0);
+    ev.data.fd = sock;
+    if (epoll_ctl(s.epollFd, q.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, sock, &ev) == 0) {
+        q.registered = true;
+    } else {
+        q.armed = false;
+        q.reaping = false;
+    }
+}
+
+/*
+  Service():
+                An EPOLLERR that released nothing is a socket error rather
+                than a completion; the socket is not watched for errors again,
+                or a dead connection would wake this thread in a loop. Its
+                remaining buffers go when the client is forgotten.
+*/
+void OutboundQueue::Service(int sock, SocketQueue &q, uint32_t events) {
+    bool wasArmed = q.armed;
+    bool wasReaping = q.reaping;
+    q.armed = false;
+    q.reaping = false;
+
+    if (wasReaping && (events & EPOLLERR) && ZeroCopySender::Reap(sock)) {
+        q.reaping = ZeroCopySender::HasPending(sock);
+    } else if (wasReaping && !(events & EPOLLERR)) {
+        // Woken for output only, completions are still to come
+        q.reaping = true;
+    }
+
+    if (wasArmed && !q.broken) {
+        Flush(sock, q);
+    }
+    if (q.broken) {
+        q.armed = false;
+        q.reaping = false;
+        return;
+    }
+    Watch(sock, q);
+}
+
+void OutboundQueue::Run() {
+    State &s = Queues();
+    epoll_event events[maxEvents];
+
+    for (;;) {
+        int n = epoll_wait(s.epollFd, events, maxEvents, -1);
+        if (n < 0) {
+            if (errno != EINTR) {
+                cerr << "epoll_wait failed: " << errno << endl;
+            }
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(s.mutex);
+        for (int i = 0; i < n; i++) {
+            int sock = events[i].data.fd;
+            auto it = s.queues.find(sock);
+            if (it != s.queues.end()) {
+                Service(sock, it->second, events[i].events);
+            }
+        }
+    }
+}
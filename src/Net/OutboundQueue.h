@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+#include "MessageBuffer.h"
+
+using namespace std;
+
+enum class SendPriority {
+    // Simulation control, commands, events and replies to the client
+    Control = 0,
+    // Waveforms and physiology values, superseded by the next sample anyway
+    Telemetry = 1
+};
+
+/*
+  OutboundQueue:
+                Per-socket outbound queues for the threaded backend. Senders
+                never block on a client: whatever the socket does not take
+                right away is queued and written by one epoll thread once the
+                socket is writable again. Each queue has a control lane that
+                always drains before the telemetry lane, so a pause or reset
+                is not stuck behind seconds of samples. A message that has
+                started going out is always finished first. The same thread
+                reaps zerocopy completions, woken by EPOLLERR, so pinned
+                buffers are released even when nothing more is sent.
+*/
+class OutboundQueue {
+public:
+    // Queued telemetry per client beyond this is dropped, oldest first
+    static size_t telemetryLimit;
+
+    static void Start();
+
+    // Starts an empty queue for a newly accepted socket
+    static void Open(int sock);
+
+    // Should be called when vector<Client *> clients is locked!
+    static void Send(int sock, const GatherMessage &message, SendPriority priority);
+
+    // Must be called once the client has left Server::clients, before the
+    // socket is closed; later sends to the fd are dropped until Open()
+    static void Forget(int sock);
+
+    static uint64_t TakeDropped();
+
+    // Drops by the io_uring backend, reported with this queue's own
+    static void AddDropped(uint64_t count);
+
+    // Messages waiting across every socket, the one being written included
+    static size_t Queued();
+
+private:
+    static const int lanes = 2;
+    static const int maxEvents = 64;
+
+    struct SocketQueue {
+        std::deque<GatherMessage> lanes[OutboundQueue::lanes];
+        size_t telemetryBytes = 0;
+
+        // Partly written, finishes before anything else
+        GatherMessage current;
+        size_t offset = 0;
+        bool writing = false;
+
+        // Known to epoll, and waiting for EPOLLOUT
+        bool registered = false;
+        bool armed = false;
+        bool broken = false;
+        // Waiting for EPOLLERR, which signals zerocopy completions
+        bool reaping = false;
+    };
+
+    static void Flush(int sock, SocketQueue &q);
+
+    static void Arm(int sock, SocketQueue &q);
+
+    // Re-registers the socket for what it is waiting on, if anything
+    static void Watch(int sock, SocketQueue &q);
+
+    // Handles one epoll event for the socket; called with the queue lock held
+    static void Service(int sock, SocketQueue &q, uint32_t events);
+
+    static void Run();
+
+    struct State {
+        std::unordered_map<int, SocketQueue> queues;
+        std::mutex mutex;
+        int epollFd = -1;
+        uint64_t dropped = 0;
+    };
+
+    // Never destroyed, the writer thread outlives static destruction
+    static State &Queues();
+};
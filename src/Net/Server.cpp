@@ -1,8 +1,27 @@
 #include "Server.h"
+#include "AdmissionControl.h"
+#include "Compression.h"
+#include "ConnectionMonitor.h"
+#include "LowLatency.h"
+#include "UringServer.h"
+
+#include <cerrno>
+#include <thread>
+
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 
 using namespace std;
 
-vector<Client> Server::clients;
+int Server::listenBacklog = 512;
+bool Server::reusePort = false;
+vector<Client *> Server::clients;
+UringServer *Server::uring = nullptr;
+int Server::webSocketListener = -1;
+vector<Server::Slot> Server::slots;
+vector<uint32_t> Server::freeSlots;
+uint32_t Server::nextGeneration = 1;
 
 Server::Server(int port) {
 
@@ -14,105 +33,463 @@ Server::Server(int port) {
     m_runThread = true;
 
     // Init serverSock and start listen()'ing
-    serverSock = socket(AF_INET, SOCK_STREAM, 0);
+    serverSock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
     memset(&serverAddr, 0, sizeof(sockaddr_in));
     serverAddr.sin_family = AF_INET;
     serverAddr.sin_addr.s_addr = INADDR_ANY;
     serverAddr.sin_port = htons(port);
 
     setsockopt(serverSock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int));
+    if (reusePort && setsockopt(serverSock, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(int)) < 0)
+        cerr << "Failed to set SO_REUSEPORT";
 
     if (bind(serverSock, (struct sockaddr *) &serverAddr, sizeof(sockaddr_in)) < 0)
         cerr << "Failed to bind";
 
-    listen(serverSock, 30);
+    // The kernel caps this at net.core.somaxconn
+    if (listen(serverSock, listenBacklog) < 0)
+        cerr << "Failed to listen";
 }
 
-void Server::AcceptAndDispatch() {
+/*
+  ListenUnix():
+                Same protocol and session handling as TCP, for modules on the
+                same host. A socket file left behind by an earlier run is
+                replaced; any other file at the path is left alone.
+*/
+bool Server::ListenUnix(const std::string &path) {
+    sockaddr_un addr{};
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        cerr << "Unix socket path is empty or too long: " << path << endl;
+        return false;
+    }
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+    struct stat st{};
+    if (lstat(path.c_str(), &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            cerr << path << " exists and is not a socket" << endl;
+            return false;
+        }
+        unlink(path.c_str());
+    }
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        cerr << "Failed to create unix socket" << endl;
+        return false;
+    }
+    if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(sock, listenBacklog) < 0) {
+        cerr << "Failed to listen on " << path << endl;
+        close(sock);
+        return false;
+    }
+    unixSock = sock;
+    return true;
+}
+
+bool Server::ListenWebSocket(int port) {
+    int sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        cerr << "Failed to create WebSocket listener" << endl;
+        return false;
+    }
+    int yes = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int));
+    if (reusePort) {
+        setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(int));
+    }
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+    if (bind(sock, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(sock, listenBacklog) < 0) {
+        cerr << "Failed to listen on WebSocket port " << port << endl;
+        close(sock);
+        return false;
+    }
+    webSocketListener = sock;
+    return true;
+}
+
+void Server::Run(Backend backend) {
+    ConnectionMonitor::Start();
 
-    Client *c;
-    ServerThread *t;
+    // The ring or accept thread, and every session thread it starts, run on the I/O cores
+    LowLatency::PinThread(LowLatency::ioCores);
 
-    socklen_t cliSize = sizeof(sockaddr_in);
+    if (backend == Backend::IoUring) {
+#ifdef HAVE_LIBURING
+        auto *ring = new UringServer();
+        if (UringServer::Supported() && ring->Init()) {
+            cout << "Using io_uring networking backend" << endl;
+            uring = ring;
+            std::vector<int> listeners = {serverSock};
+            if (unixSock >= 0) {
+                listeners.push_back(unixSock);
+            }
+            if (webSocketListener >= 0) {
+                listeners.push_back(webSocketListener);
+            }
+            ring->Run(listeners);
+            uring = nullptr;
+            delete ring;
+            return;
+        }
+        delete ring;
+        cerr << "io_uring is not supported here, falling back to threads" << endl;
+#else
+        cerr << "Built without io_uring support, falling back to threads" << endl;
+#endif
+    }
+
+    OutboundQueue::Start();
+    AcceptAndDispatch();
+}
+
+/*
+  AcceptAndDispatch():
+                Waits for a listen socket (TCP, and the Unix and WebSocket
+                listeners if enabled) to become readable, then drains up to acceptBatch
+                pending connections from it. While AdmissionControl holds
+                new sessions back, the rest stay in the listen backlog.
+*/
+void Server::AcceptAndDispatch() {
 
     while (m_runThread) {
 
-        c = new Client();
-        t = new ServerThread();
+        std::chrono::milliseconds wait = AdmissionControl::Wait();
+        if (wait.count() > 0) {
+            std::this_thread::sleep_for(wait);
+            continue;
+        }
 
         // Blocks here;
-        c->sock = accept(serverSock, (struct sockaddr *) &clientAddr, &cliSize);
-        if (c->sock < 0) {
-            cerr << "Error on accept";
-        } else {
-            t->Create((void *) Server::HandleClient, c);
+        pollfd pfds[3] = {{serverSock, POLLIN, 0}, {unixSock, POLLIN, 0}, {webSocketListener, POLLIN, 0}};
+        if (poll(pfds, 3, -1) < 0) {
+            if (errno != EINTR) {
+                cerr << "Error on poll: " << errno << endl;
+            }
+            continue;
+        }
+
+        for (auto &pfd : pfds) {
+            if (pfd.fd >= 0 && (pfd.revents & POLLIN)) {
+                AcceptBatch(pfd.fd);
+            }
         }
     }
 }
 
-void Server::SendToAll(const std::string &message) {
-    ssize_t n;
+void Server::AcceptBatch(int listenSock) {
+    for (int i = 0; i < acceptBatch && AdmissionControl::Wait().count() == 0; i++) {
+        int sock = accept4(listenSock, nullptr, nullptr, SOCK_CLOEXEC);
+        if (sock < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED) {
+                cerr << "Error on accept: " << errno << endl;
+            }
+            break;
+        }
 
-    ServerThread::LockMutex("'SendToAll()'");
+        Client *c = ClientPool::Acquire();
+        c->sock = sock;
+        Accepted(c, listenSock);
+        AdmissionControl::Admit(c);
 
-    for (auto &client : clients) {
-        n = send(client.sock, message.c_str(), strlen(message.c_str()), 0);
-        // cout << n << " bytes sent." << endl;
+        ServerThread t;
+        if (t.Create((void *) Server::HandleClient, c) != 0) {
+            AdmissionControl::Completed(c);
+            close(sock);
+            ClientPool::Release(c);
+            continue;
+        }
+        t.Detach();
     }
+}
 
-    // Release the lock
-    ServerThread::UnlockMutex("'SendToAll()'");
+bool Server::IsLocal(Client *c) {
+    sockaddr_storage peer{};
+    socklen_t size = sizeof(peer);
+    if (getpeername(c->sock, (struct sockaddr *) &peer, &size) < 0) {
+        return false;
+    }
+    switch (peer.ss_family) {
+        case AF_UNIX:
+            return true;
+        case AF_INET:
+            return (ntohl(((sockaddr_in *) &peer)->sin_addr.s_addr) >> 24) == 127;
+        case AF_INET6:
+            return IN6_IS_ADDR_LOOPBACK(&((sockaddr_in6 *) &peer)->sin6_addr);
+        default:
+            return false;
+    }
 }
 
-void Server::SendToAll(char *message) {
-    ssize_t n;
+void Server::Accepted(Client *c, int listenSock) {
+    LowLatency::TuneSocket(c->sock);
+    if (!uring) {
+        OutboundQueue::Open(c->sock);
+    }
+    if (listenSock == webSocketListener) {
+        c->websocket.reset(new WebSocketSession());
+    }
+}
 
-    // Acquire the lock
-    ServerThread::LockMutex("'SendToAll()'");
+/*
+  Receive():
+                A WebSocket session answers the upgrade and control frames
+                itself and passes only message payloads on. The upgrade
+                response is queued and the session opened under the client
+                lock, so no broadcast can get ahead of it. A failed or closed
+                session has its socket shut down, the backend then runs the
+                usual disconnect path.
+*/
+void Server::Receive(Client *c, const char *data, size_t len) {
+    WebSocketSession *ws = c->websocket.get();
+    if (!ws) {
+        OnClientData(c, data, len);
+        return;
+    }
 
-    for (auto &client : clients) {
-        n = send(client.sock, message, strlen(message), 0);
-        // cout << n << " bytes sent." << endl;
+    std::string payload;
+    std::string reply;
+    bool keep = ws->Receive(data, len, payload, reply);
+    if (!reply.empty()) {
+        ServerThread::LockMutex("'Receive()'");
+        Send(c->sock, GatherMessage(MakeMessageBuffer(reply)), SendPriority::Control);
+        if (ws->Upgraded()) {
+            ws->MarkOpen();
+        }
+        ServerThread::UnlockMutex("'Receive()'");
     }
+    if (!payload.empty()) {
+        OnClientData(c, payload.data(), payload.size());
+    }
+    if (!keep) {
+        shutdown(c->sock, SHUT_RDWR);
+    }
+}
 
-    // Release the lock
+/*
+  Everything goes through the client's outbound queue, writing straight to
+  the socket could interleave with a message that is partly written.
+*/
+void Server::SendToAll(const std::string &message) {
+    SendToAll(GatherMessage(MakeMessageBuffer(message)));
+}
+
+void Server::SendToAll(const GatherMessage &message) {
+    ServerThread::LockMutex("'SendToAll()'");
+    SendShared(clients, message, SendPriority::Control);
     ServerThread::UnlockMutex("'SendToAll()'");
 }
 
+void Server::SendToAll(char *message) {
+    SendToAll(GatherMessage(MakeMessageBuffer(message)));
+}
+
 void Server::SendToClient(Client *c, const std::string &message) {
-    ssize_t n;
-    ServerThread::LockMutex("'SendToClient()'");
+    SendToClient(c, GatherMessage(MakeMessageBuffer(message)));
+}
 
-    // cout << " Sending message to [" << c->name << "](" << c->id << "): " <<
-    // message << endl;
-    n = send(c->sock, message.c_str(), strlen(message.c_str()), 0);
-    // cout << n << " bytes sent." << endl;
+void Server::SendToClient(Client *c, const GatherMessage &message) {
+    ServerThread::LockMutex("'SendToClient()'");
+    Send(c->sock, Encode(c, message), SendPriority::Control);
     ServerThread::UnlockMutex("'SendToClient()'");
 }
 
+/*
+  SetCompression():
+                Both happen under one lock, so no frame queued by another
+                thread can slip in between the reply and the switch.
+*/
+void Server::SetCompression(Client *c, CompressionCodec codec, const std::string &reply) {
+    ServerThread::LockMutex("'SetCompression()'");
+    c->SetCompression(CompressionCodec::None);
+    Send(c->sock, Encode(c, GatherMessage(MakeMessageBuffer(reply))), SendPriority::Control);
+    c->SetCompression(codec);
+    ServerThread::UnlockMutex("'SetCompression()'");
+}
+
+void Server::SendToClients(const std::vector<Client *> &recipients, const GatherMessage &message,
+                           SendPriority priority) {
+    ServerThread::LockMutex("'SendToClients()'");
+    SendShared(recipients, message, priority);
+    ServerThread::UnlockMutex("'SendToClients()'");
+}
+
+void Server::SendToClients(const std::vector<std::string> &clientIds, const GatherMessage &message,
+                           SendPriority priority) {
+    std::vector<Client *> recipients;
+    recipients.reserve(clientIds.size());
+
+    ServerThread::LockMutex("'SendToClients()'");
+    for (auto &id : clientIds) {
+        Client *c = GetClientByIndex(id);
+        if (c) {
+            recipients.push_back(c);
+        }
+    }
+    SendShared(recipients, message, priority);
+    ServerThread::UnlockMutex("'SendToClients()'");
+}
+
+/*
+  SendToClients():
+                Each handle is checked against its slot, so a client that has
+                left, or a later one reusing its slot, is skipped. The
+                resolved list is per thread and reused, a broadcast does not
+                allocate once it has warmed up.
+*/
+void Server::SendToClients(const std::vector<ClientHandle> &handles, const GatherMessage &message,
+                           SendPriority priority) {
+    static thread_local std::vector<Client *> recipients;
+    recipients.clear();
+
+    ServerThread::LockMutex("'SendToClients()'");
+    for (auto &handle : handles) {
+        if (handle.slot < slots.size() && slots[handle.slot].generation == handle.generation &&
+            slots[handle.slot].client) {
+            recipients.push_back(slots[handle.slot].client);
+        }
+    }
+    SendShared(recipients, message, priority);
+    ServerThread::UnlockMutex("'SendToClients()'");
+}
+
+void Server::AssignHandle(Client *c) {
+    uint32_t slot;
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    } else {
+        slot = (uint32_t) slots.size();
+        slots.emplace_back();
+    }
+    if (nextGeneration == 0) {
+        nextGeneration = 1;
+    }
+    slots[slot].client = c;
+    slots[slot].generation = nextGeneration++;
+    c->handle.slot = slot;
+    c->handle.generation = slots[slot].generation;
+}
+
+void Server::ReleaseHandle(Client *c) {
+    if (!c->handle.Valid() || c->handle.slot >= slots.size()) {
+        return;
+    }
+    slots[c->handle.slot] = Slot();
+    freeSlots.push_back(c->handle.slot);
+}
+
+bool Server::SessionMayWait() {
+    return uring == nullptr;
+}
+
+void Server::PauseReads(Client *c) {
+#ifdef HAVE_LIBURING
+    if (uring) {
+        uring->Pause(c->sock);
+    }
+#endif
+}
+
+/*
+  Should be called when vector<Client *> clients is locked!
+*/
+void Server::Send(int sock, const GatherMessage &message, SendPriority priority) {
+#ifdef HAVE_LIBURING
+    if (uring) {
+        uring->Send(sock, message, priority);
+        return;
+    }
+#endif
+    OutboundQueue::Send(sock, message, priority);
+}
+
+/*
+  Encode():
+                A WebSocket session that has not finished its upgrade gets
+                nothing, an empty message is never queued.
+*/
+GatherMessage Server::Encode(Client *c, const GatherMessage &message) {
+    GatherMessage encoded = Compressor::Apply(c->compression, message);
+    if (!c->websocket) {
+        return encoded;
+    }
+    if (!c->websocket->Open()) {
+        return GatherMessage();
+    }
+    return WebSocketSession::Frame(encoded, c->compression != CompressionCodec::None);
+}
+
+/*
+  SendShared():
+                Encodes at most once per codec and transport; every recipient
+                using the same pair shares the result, nothing is copied per
+                client. Should be called when vector<Client *> clients is
+                locked!
+*/
+void Server::SendShared(const std::vector<Client *> &recipients, const GatherMessage &message,
+                        SendPriority priority) {
+    // Indexed by codec, plus 3 for WebSocket sessions; only filled in when a recipient uses it
+    GatherMessage encoded[6];
+    bool ready[6] = {false, false, false, false, false, false};
+    for (auto client : recipients) {
+        if (client->websocket && !client->websocket->Open()) {
+            continue;
+        }
+        int variant = (int) client->compression + (client->websocket ? 3 : 0);
+        if (!ready[variant]) {
+            encoded[variant] = Encode(client, message);
+            ready[variant] = true;
+        }
+        Send(client->sock, encoded[variant], priority);
+    }
+}
+
 void Server::ListClients() {
-    for (auto &client : clients) {
-        cout << "|" << client.name << "|" << client.clientType << endl;
+    for (auto client : clients) {
+        cout << "|" << client->name << "|" << client->clientType << endl;
 
     }
 }
 
 /*
-  Should be called when vector<Client> clients is locked!
+  Should be called when vector<Client *> clients is locked!
 */
 int Server::FindClientIndex(Client *c) {
     for (size_t i = 0; i < clients.size(); i++) {
-        if ((Server::clients[i].id) == c->id)
+        if ((Server::clients[i]->id) == c->id)
             return (int) i;
     }
     cerr << "Client id not found." << endl;
     return -1;
 }
 
+size_t Server::ClientCount() {
+    ServerThread::LockMutex("'ClientCount()'");
+    size_t count = clients.size();
+    ServerThread::UnlockMutex("'ClientCount()'");
+    return count;
+}
+
+size_t Server::QueuedMessages() {
+#ifdef HAVE_LIBURING
+    if (uring) {
+        return uring->Queued();
+    }
+#endif
+    return OutboundQueue::Queued();
+}
+
 Client *Server::GetClientByIndex(std::string id) {
     for (size_t i = 0; i < clients.size(); i++) {
-        if ((Server::clients[i].id) == id)
-            return &Server::clients[i];
+        if ((Server::clients[i]->id) == id)
+            return Server::clients[i];
     }
     return nullptr;
 }
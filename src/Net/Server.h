@@ -14,37 +14,146 @@
 #include <sys/socket.h>
 
 #include "Client.h"
+#include "MessageBuffer.h"
+#include "OutboundQueue.h"
 #include "ServerThread.h"
 
 using namespace std;
 
+class UringServer;
+
 class Server {
 
 private:
-    static vector<Client> clients;
+    static vector<Client *> clients;
     int serverSock;
+    // AF_UNIX listener for modules on this host, -1 when not enabled
+    int unixSock = -1;
+    // Browser sessions upgrade from HTTP here, -1 when not enabled
+    static int webSocketListener;
     struct sockaddr_in serverAddr, clientAddr;
 
+    // Set while the io_uring backend owns the client sockets
+    static UringServer *uring;
+
+    // Indexed by ClientHandle::slot, guarded like clients
+    struct Slot {
+        Client *client = nullptr;
+        uint32_t generation = 0;
+    };
+    static vector<Slot> slots;
+    static vector<uint32_t> freeSlots;
+    static uint32_t nextGeneration;
+
 public:
+    enum class Backend {
+        Threads,
+        IoUring
+    };
+
+    // Connections the kernel queues while the bridge is admitting others
+    static int listenBacklog;
+
+    // Lets several bridge processes share the TCP and WebSocket ports; the
+    // kernel spreads new connections across them
+    static bool reusePort;
+
     explicit Server(int port);
 
+    // Also accepts sessions on a Unix domain socket at path
+    bool ListenUnix(const std::string &path);
+
+    // Also accepts WebSocket sessions on port
+    bool ListenWebSocket(int port);
+
+    void Run(Backend backend);
+
     void AcceptAndDispatch();
 
     static void *HandleClient(void *args);
 
+    // Called by the backends for every accepted socket, before the session starts
+    static void Accepted(Client *c, int listenSock);
+
+    // Called by the backends with every read; unwraps WebSocket sessions
+    static void Receive(Client *c, const char *data, size_t len);
+
+    // Session hooks shared by every backend, implemented by the bridge
+    static void OnClientConnected(Client *c);
+
+    static void OnClientData(Client *c, const char *data, size_t len);
+
+    static void OnClientDisconnected(Client *c);
+
+    // Called for a client whose reads are paused; true once they may resume
+    static bool OnClientResume(Client *c);
+
+    // True when each session has a thread of its own that may wait for the
+    // bridge; false when one thread serves every session and must not
+    static bool SessionMayWait();
+
+    // Backpressure for a session that may not wait: stops reading from the
+    // client until OnClientResume() lets it go on
+    static void PauseReads(Client *c);
+
     static void SendToAll(const std::string &message);
 
+    static void SendToAll(const GatherMessage &message);
+
     static void SendToClient(Client *c, const std::string &message);
 
+    static void SendToClient(Client *c, const GatherMessage &message);
+
+    // Queues the uncompressed reply, then switches the client's codec
+    static void SetCompression(Client *c, CompressionCodec codec, const std::string &reply);
+
+    static void SendToClients(const std::vector<Client *> &recipients, const GatherMessage &message,
+                              SendPriority priority = SendPriority::Control);
+
+    // Resolves the ids under the client lock, skipping clients that have left
+    static void SendToClients(const std::vector<std::string> &clientIds, const GatherMessage &message,
+                              SendPriority priority = SendPriority::Control);
+
+    // Same for handles, without touching a string per recipient
+    static void SendToClients(const std::vector<ClientHandle> &handles, const GatherMessage &message,
+                              SendPriority priority = SendPriority::Control);
+
+    // Gives the client a handle. Should be called when vector<Client *> clients is locked!
+    static void AssignHandle(Client *c);
+
+    // Handles to the client resolve to nothing from now on. Should be called
+    // when vector<Client *> clients is locked!
+    static void ReleaseHandle(Client *c);
+
     static Client *GetClientByIndex(std::string id);
 
+    static size_t ClientCount();
+
+    // Outbound messages waiting for slow clients, whichever backend runs
+    static size_t QueuedMessages();
+
 private:
     static void ListClients();
 
     static void SendToAll(char *message);
 
+    static void Send(int sock, const GatherMessage &message, SendPriority priority);
+
+    // What goes on the wire for this client: compressed, then framed
+    static GatherMessage Encode(Client *c, const GatherMessage &message);
+
+    static void SendShared(const std::vector<Client *> &recipients, const GatherMessage &message,
+                           SendPriority priority);
+
     static int FindClientIndex(Client *c);
 
+    // Connected over the Unix socket or from a loopback address
+    static bool IsLocal(Client *c);
+
+    void AcceptBatch(int listenSock);
+
+    static const int acceptBatch = 64;
+
 protected:
     bool m_runThread;
 };
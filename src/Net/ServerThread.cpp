@@ -25,6 +25,11 @@ int ServerThread::Join() {
     return 0;
 }
 
+int ServerThread::Detach() {
+    pthread_detach(this->tid);
+    return 0;
+}
+
 int ServerThread::InitMutex() {
 
     if (pthread_mutex_init(&ServerThread::mutex, nullptr) < 0) {
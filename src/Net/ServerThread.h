@@ -26,6 +26,9 @@ public:
 
     int Join();
 
+    // The thread cleans up after itself when it exits
+    int Detach();
+
     static int InitMutex();
 
     static int LockMutex(const string &identifier);
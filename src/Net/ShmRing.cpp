@@ -0,0 +1,301 @@
+#include "ShmRing.h"
+
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+const size_t pageSize = 4096;
+
+uint64_t RecordSize(uint64_t length) {
+    return (sizeof(ShmRing::Record) + length + 7) & ~(uint64_t) 7;
+}
+
+std::string SegmentName(const std::string &name) {
+    return name.empty() || name[0] == '/' ? name : "/" + name;
+}
+
+long Futex(std::atomic<uint32_t> *word, int op, uint32_t value, const timespec *timeout) {
+    return syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), op, value, timeout, nullptr, 0);
+}
+
+}
+
+ShmRing::~ShmRing() {
+    if (header) {
+        munmap(header, mappedSize);
+        shm_unlink(name.c_str());
+    }
+}
+
+/*
+  Create():
+                A segment left by an earlier run is unlinked first, so readers
+                still mapping it stop seeing new frames instead of a ring
+                that restarted underneath them. The magic is written last;
+                a reader that opens the segment before that refuses it.
+*/
+bool ShmRing::Create(const std::string &segment, size_t requested) {
+    size_t size = 4096;
+    while (size < requested) {
+        size <<= 1;
+    }
+    name = SegmentName(segment);
+    shm_unlink(name.c_str());
+
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0660);
+    if (fd < 0) {
+        cerr << "shm_open " << name << " failed: " << errno << endl;
+        return false;
+    }
+    size_t dataOffset = (sizeof(Header) + pageSize - 1) & ~(pageSize - 1);
+    mappedSize = dataOffset + size;
+    if (ftruncate(fd, mappedSize) < 0) {
+        cerr << "ftruncate " << name << " failed: " << errno << endl;
+        close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    void *mapped = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        cerr << "mmap " << name << " failed: " << errno << endl;
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    // The new segment is zero-filled, which is every counter's starting value
+    header = static_cast<Header *>(mapped);
+    data = static_cast<char *>(mapped) + dataOffset;
+    capacity = size;
+    mask = size - 1;
+    head = 0;
+    tail = 0;
+    header->version = version;
+    header->capacity = size;
+    header->dataOffset = dataOffset;
+    std::atomic_thread_fence(std::memory_order_release);
+    reinterpret_cast<std::atomic<uint32_t> *>(&header->magic)->store(magic, std::memory_order_release);
+    return true;
+}
+
+/*
+  Write():
+                Moves tail past every record the new one will overwrite
+                before touching their bytes. A reader checks tail again after
+                copying a record, so a copy torn by the writer is thrown
+                away rather than delivered. Record lengths read back from the
+                ring are not trusted to stay below head.
+*/
+bool ShmRing::Write(const char *frame, size_t length) {
+    if (!header) {
+        return false;
+    }
+    uint64_t size = RecordSize(length);
+    if (size > capacity / 4) {
+        return false;
+    }
+
+    uint64_t pos = head;
+    uint64_t offset = pos & mask;
+    uint64_t padding = offset + size > capacity ? capacity - offset : 0;
+    uint64_t end = pos + padding + size;
+
+    if (end - tail > capacity) {
+        while (end - tail > capacity && tail < pos) {
+            const Record *oldest = reinterpret_cast<const Record *>(data + (tail & mask));
+            tail += RecordSize(oldest->length);
+        }
+        if (tail > pos) {
+            tail = pos;
+        }
+        header->tail.store(tail, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    if (padding > 0) {
+        Record *fill = reinterpret_cast<Record *>(data + offset);
+        fill->length = (uint32_t) (padding - sizeof(Record));
+        fill->flags = paddingFlag;
+        offset = 0;
+    }
+    Record *record = reinterpret_cast<Record *>(data + offset);
+    record->length = (uint32_t) length;
+    record->flags = 0;
+    memcpy(record + 1, frame, length);
+
+    head = end;
+    header->head.store(end, std::memory_order_release);
+    Wake();
+    return true;
+}
+
+void ShmRing::Wake() {
+    header->wake.fetch_add(1);
+    if (header->sleepers.load() > 0) {
+        Futex(&header->wake, FUTEX_WAKE, INT_MAX, nullptr);
+    }
+}
+
+/*
+  Readers():
+                Slots of reader processes that died without closing are
+                freed here.
+*/
+int ShmRing::Readers(uint64_t &maxLag) {
+    maxLag = 0;
+    if (!header) {
+        return 0;
+    }
+    uint64_t head = header->head.load(std::memory_order_acquire);
+    int count = 0;
+    for (auto &reader : header->readers) {
+        uint32_t pid = reader.pid.load();
+        if (pid == 0) {
+            continue;
+        }
+        if (kill((pid_t) pid, 0) < 0 && errno == ESRCH) {
+            reader.pid.compare_exchange_strong(pid, 0);
+            continue;
+        }
+        count++;
+        uint64_t cursor = reader.cursor.load(std::memory_order_relaxed);
+        if (cursor < head && head - cursor > maxLag) {
+            maxLag = head - cursor;
+        }
+    }
+    return count;
+}
+
+ShmRingReader::~ShmRingReader() {
+    if (slot) {
+        slot->pid.store(0);
+    }
+    if (header) {
+        munmap(header, mappedSize);
+    }
+}
+
+bool ShmRingReader::Open(const std::string &name) {
+    int fd = shm_open(SegmentName(name).c_str(), O_RDWR | O_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st{};
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(ShmRing::Header)) {
+        close(fd);
+        return false;
+    }
+    mappedSize = st.st_size;
+    void *mapped = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        return false;
+    }
+
+    header = static_cast<ShmRing::Header *>(mapped);
+    uint32_t magic = reinterpret_cast<std::atomic<uint32_t> *>(&header->magic)->load(std::memory_order_acquire);
+    capacity = header->capacity;
+    uint64_t dataOffset = header->dataOffset;
+    if (magic != ShmRing::magic || header->version != ShmRing::version ||
+        capacity == 0 || (capacity & (capacity - 1)) != 0 ||
+        dataOffset > mappedSize || capacity > mappedSize - dataOffset) {
+        munmap(header, mappedSize);
+        header = nullptr;
+        return false;
+    }
+    mask = capacity - 1;
+    data = static_cast<const char *>(mapped) + dataOffset;
+
+    // Start with the next frame, not with whatever the ring still holds
+    cursor = header->head.load(std::memory_order_acquire);
+    for (auto &reader : header->readers) {
+        uint32_t free = 0;
+        if (reader.pid.compare_exchange_strong(free, (uint32_t) getpid())) {
+            reader.cursor.store(cursor, std::memory_order_relaxed);
+            slot = &reader;
+            break;
+        }
+    }
+    return true;
+}
+
+bool ShmRingReader::Read(std::string &out, int timeoutMs) {
+    if (!header) {
+        return false;
+    }
+
+    for (;;) {
+        uint64_t head = header->head.load(std::memory_order_acquire);
+        if (cursor == head) {
+            if (!Wait(timeoutMs)) {
+                return false;
+            }
+            continue;
+        }
+
+        uint64_t tail = header->tail.load(std::memory_order_acquire);
+        if (cursor < tail) {
+            lost += tail - cursor;
+            cursor = tail;
+            continue;
+        }
+
+        ShmRing::Record record;
+        const char *at = data + (cursor & mask);
+        memcpy(&record, at, sizeof(record));
+        uint64_t size = RecordSize(record.length);
+        bool frame = !(record.flags & ShmRing::paddingFlag);
+        // A length torn by the writer could point past the data area
+        bool fits = (cursor & mask) + size <= capacity;
+        if (frame && fits) {
+            out.assign(at + sizeof(record), record.length);
+        }
+
+        // Overwritten while it was being copied; catch up from the new tail
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (header->tail.load(std::memory_order_relaxed) > cursor) {
+            continue;
+        }
+        if (!fits) {
+            // Not torn, so the ring itself is corrupt; skip to the newest data
+            lost += head - cursor;
+            cursor = head;
+            if (slot) {
+                slot->cursor.store(cursor, std::memory_order_relaxed);
+            }
+            continue;
+        }
+
+        cursor += size;
+        if (slot) {
+            slot->cursor.store(cursor, std::memory_order_relaxed);
+        }
+        if (frame) {
+            return true;
+        }
+    }
+}
+
+bool ShmRingReader::Wait(int timeoutMs) {
+    header->sleepers.fetch_add(1);
+    uint32_t seen = header->wake.load();
+    if (header->head.load(std::memory_order_acquire) == cursor) {
+        timespec timeout{timeoutMs / 1000, (long) (timeoutMs % 1000) * 1000000};
+        Futex(&header->wake, FUTEX_WAIT, seen, &timeout);
+    }
+    header->sleepers.fetch_sub(1);
+    return header->head.load(std::memory_order_acquire) != cursor;
+}
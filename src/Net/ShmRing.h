@@ -0,0 +1,144 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+/*
+  ShmRing:
+                Single-producer, multi-consumer byte ring in a POSIX shared
+                memory segment (/dev/shm/<name>), for waveforms going to
+                renderers on the same host. The bridge writes each frame once;
+                any number of local processes map the segment read-write and
+                follow it with their own cursor. The producer never waits for
+                a reader: a reader that falls a whole ring behind loses the
+                oldest frames and is told how many bytes it skipped. Readers
+                that have caught up sleep on a futex word in the segment.
+
+                Frames are the same text lines a TCP client receives, each
+                preceded by a Record header and padded to 8 bytes. A record
+                that would not fit before the end of the data area is
+                preceded by a padding record filling the rest.
+*/
+class ShmRing {
+public:
+    static const uint32_t magic = 0x4242524d; // "MRBB"
+    static const uint32_t version = 1;
+    static const int maxReaders = 32;
+
+    struct alignas(64) Reader {
+        // Byte position of the next record this reader will look at
+        std::atomic<uint64_t> cursor;
+        // 0 while the slot is free
+        std::atomic<uint32_t> pid;
+    };
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t capacity;
+        uint64_t dataOffset;
+
+        // Bytes published; records below head are complete
+        alignas(64) std::atomic<uint64_t> head;
+        // Oldest byte not yet overwritten; moves before the writer reuses space
+        alignas(64) std::atomic<uint64_t> tail;
+        // Futex word, bumped after every publish
+        alignas(64) std::atomic<uint32_t> wake;
+        std::atomic<uint32_t> sleepers;
+
+        Reader readers[maxReaders];
+    };
+
+    struct Record {
+        uint32_t length;
+        uint32_t flags;
+    };
+
+    static const uint32_t paddingFlag = 1;
+
+    ShmRing() = default;
+
+    ~ShmRing();
+
+    ShmRing(const ShmRing &) = delete;
+
+    ShmRing &operator=(const ShmRing &) = delete;
+
+    // capacity is rounded up to a power of two
+    bool Create(const std::string &name, size_t capacity);
+
+    bool Active() const {
+        return header != nullptr;
+    }
+
+    // Frames larger than a quarter of the ring are refused
+    bool Write(const char *data, size_t length);
+
+    const std::string &Name() const {
+        return name;
+    }
+
+    size_t Capacity() const {
+        return capacity;
+    }
+
+    // Attached readers, and the most any of them is behind the writer
+    int Readers(uint64_t &maxLag);
+
+private:
+    void Wake();
+
+    std::string name;
+    Header *header = nullptr;
+    char *data = nullptr;
+    size_t mappedSize = 0;
+    // Private copies of the ring geometry and positions; readers map the
+    // segment writable, so the header is never read back on this side
+    uint64_t capacity = 0;
+    uint64_t mask = 0;
+    uint64_t head = 0;
+    uint64_t tail = 0;
+};
+
+/*
+  ShmRingReader:
+                Consumer side of ShmRing, for local processes. Claims a reader
+                slot so the bridge can report how far behind it is.
+*/
+class ShmRingReader {
+public:
+    ShmRingReader() = default;
+
+    ~ShmRingReader();
+
+    ShmRingReader(const ShmRingReader &) = delete;
+
+    ShmRingReader &operator=(const ShmRingReader &) = delete;
+
+    bool Open(const std::string &name);
+
+    // Next frame into out; false if none arrived within timeoutMs
+    bool Read(std::string &out, int timeoutMs);
+
+    // Bytes skipped because the writer overtook this reader
+    uint64_t Lost() const {
+        return lost;
+    }
+
+private:
+    bool Wait(int timeoutMs);
+
+    ShmRing::Header *header = nullptr;
+    const char *data = nullptr;
+    size_t mappedSize = 0;
+    // Checked once in Open()
+    uint64_t capacity = 0;
+    uint64_t mask = 0;
+    ShmRing::Reader *slot = nullptr;
+    uint64_t cursor = 0;
+    uint64_t lost = 0;
+};
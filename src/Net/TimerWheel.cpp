@@ -0,0 +1,102 @@
+#include "TimerWheel.h"
+
+using namespace std;
+
+TimerWheel::TimerWheel(std::chrono::milliseconds tick) : tick(tick), start(std::chrono::steady_clock::now()) {
+}
+
+void TimerWheel::Schedule(Timer &timer, std::chrono::milliseconds delay) {
+    if (timer.Pending()) {
+        Unlink(timer);
+    }
+    uint64_t ticks = (uint64_t) ((delay + tick - std::chrono::milliseconds(1)) / tick);
+    timer.expires = current + (ticks > 0 ? ticks : 1);
+    Place(timer);
+}
+
+void TimerWheel::Cancel(Timer &timer) {
+    if (timer.Pending()) {
+        Unlink(timer);
+    }
+}
+
+void TimerWheel::Advance(std::chrono::steady_clock::time_point now) {
+    if (now < start) {
+        return;
+    }
+    uint64_t target = (uint64_t) ((now - start) / tick);
+
+    while (current < target) {
+        current++;
+
+        // Pull the next stretch of each higher level down as its window opens
+        for (int level = 1; level < levels; level++) {
+            if ((current & ((1ULL << (level * slotBits)) - 1)) != 0) {
+                break;
+            }
+            Cascade(level);
+        }
+
+        Timer **slot = &slots[0][current & slotMask];
+        while (Timer *timer = *slot) {
+            Unlink(*timer);
+            // May reschedule itself, which always lands in a later slot
+            timer->callback();
+        }
+    }
+}
+
+std::chrono::steady_clock::time_point TimerWheel::NextTick() const {
+    return start + tick * (int64_t) (current + 1);
+}
+
+void TimerWheel::Place(Timer &timer) {
+    uint64_t delta = timer.expires > current ? timer.expires - current : 0;
+
+    int level = 0;
+    while (level < levels - 1 && delta >= (1ULL << ((level + 1) * slotBits))) {
+        level++;
+    }
+
+    // Clamp to what the top level can hold; it is cascaded again when reached
+    uint64_t maxDelta = (1ULL << (levels * slotBits)) - 1;
+    if (delta > maxDelta) {
+        timer.expires = current + maxDelta;
+    }
+
+    Timer **list = &slots[level][(timer.expires >> (level * slotBits)) & slotMask];
+    timer.list = list;
+    timer.prev = nullptr;
+    timer.next = *list;
+    if (*list) {
+        (*list)->prev = &timer;
+    }
+    *list = &timer;
+}
+
+void TimerWheel::Unlink(Timer &timer) {
+    if (timer.prev) {
+        timer.prev->next = timer.next;
+    } else {
+        *timer.list = timer.next;
+    }
+    if (timer.next) {
+        timer.next->prev = timer.prev;
+    }
+    timer.prev = nullptr;
+    timer.next = nullptr;
+    timer.list = nullptr;
+}
+
+void TimerWheel::Cascade(int level) {
+    Timer **slot = &slots[level][(current >> (level * slotBits)) & slotMask];
+    Timer *timer = *slot;
+    *slot = nullptr;
+
+    while (timer) {
+        Timer *next = timer->next;
+        timer->list = nullptr;
+        Place(*timer);
+        timer = next;
+    }
+}
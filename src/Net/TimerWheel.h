@@ -0,0 +1,64 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+using namespace std;
+
+/*
+  TimerWheel:
+                Hierarchical timing wheel (four levels of 64 slots). Timers
+                are intrusive list nodes, so scheduling, rescheduling and
+                cancelling are O(1); timers further out are cascaded down a
+                level as the wheel turns. Not thread-safe, the owner
+                serializes access.
+*/
+class TimerWheel {
+public:
+    class Timer {
+    public:
+        std::function<void()> callback;
+
+        bool Pending() const {
+            return list != nullptr;
+        }
+
+    private:
+        friend class TimerWheel;
+
+        Timer *prev = nullptr;
+        Timer *next = nullptr;
+        Timer **list = nullptr;
+        uint64_t expires = 0;
+    };
+
+    explicit TimerWheel(std::chrono::milliseconds tick);
+
+    // Reschedules the timer if it is already pending
+    void Schedule(Timer &timer, std::chrono::milliseconds delay);
+
+    void Cancel(Timer &timer);
+
+    // Fires, in order, every timer due by now
+    void Advance(std::chrono::steady_clock::time_point now);
+
+    std::chrono::steady_clock::time_point NextTick() const;
+
+private:
+    static const int levels = 4;
+    static const int slotBits = 6;
+    static const uint64_t slotCount = 1 << slotBits;
+    static const uint64_t slotMask = slotCount - 1;
+
+    void Place(Timer &timer);
+
+    void Unlink(Timer &timer);
+
+    void Cascade(int level);
+
+    std::chrono::milliseconds tick;
+    std::chrono::steady_clock::time_point start;
+    uint64_t current = 0;
+    Timer *slots[levels][slotCount] = {};
+};
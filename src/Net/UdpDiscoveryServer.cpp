@@ -1,33 +1,56 @@
 #include "UdpDiscoveryServer.h"
 
+#include <algorithm>
+
 using namespace std;
 
+std::chrono::milliseconds UdpDiscoveryServer::refreshInterval(1000);
+double UdpDiscoveryServer::answerRate = 100;
+double UdpDiscoveryServer::answerBurst = 20;
+
+void UdpDiscoveryServer::receive() {
+    socket_.async_receive_from(
+            boost::asio::buffer(data_, max_length), sender_endpoint_,
+            boost::bind(&UdpDiscoveryServer::handle_receive_from, this,
+                        boost::asio::placeholders::error,
+                        boost::asio::placeholders::bytes_transferred));
+}
+
 void UdpDiscoveryServer::handle_receive_from(
         const boost::system::error_code &error, size_t bytes_recvd) {
-    if (!error && bytes_recvd > 0) {
-        cout << "\tAutodiscovery request from " << sender_endpoint_ << ": " << data_ << endl;
-        // @TODO: Verify this is a valid request before sending data back
+    if (!error && bytes_recvd > 0 && allow()) {
         socket_.async_send_to(
-                boost::asio::buffer(data_, bytes_recvd), sender_endpoint_,
+                boost::asio::buffer(payload()), sender_endpoint_,
                 boost::bind(&UdpDiscoveryServer::handle_send_to, this,
                             boost::asio::placeholders::error,
                             boost::asio::placeholders::bytes_transferred));
     } else {
-        socket_.async_receive_from(
-                boost::asio::buffer(data_, max_length), sender_endpoint_,
-                boost::bind(&UdpDiscoveryServer::handle_receive_from, this,
-                            boost::asio::placeholders::error,
-                            boost::asio::placeholders::bytes_transferred));
+        receive();
     }
 }
 
 void UdpDiscoveryServer::handle_send_to(const boost::system::error_code &error,
                                         size_t bytes_sent) {
-    cout << "\tSending discovery info to " << sender_endpoint_ << endl;
-    // @TODO: Send back some sort of validation
-    socket_.async_receive_from(
-            boost::asio::buffer(data_, max_length), sender_endpoint_,
-            boost::bind(&UdpDiscoveryServer::handle_receive_from, this,
-                        boost::asio::placeholders::error,
-                        boost::asio::placeholders::bytes_transferred));
+    receive();
+}
+
+bool UdpDiscoveryServer::allow() {
+    auto now = std::chrono::steady_clock::now();
+    double elapsed = std::chrono::duration<double>(now - refilled_).count();
+    tokens_ = std::min(answerBurst, tokens_ + elapsed * answerRate);
+    refilled_ = now;
+    if (tokens_ < 1) {
+        return false;
+    }
+    tokens_ -= 1;
+    return true;
+}
+
+const std::string &UdpDiscoveryServer::payload() {
+    auto now = std::chrono::steady_clock::now();
+    if (payload_.empty() || now - built_ >= refreshInterval) {
+        payload_ = describe_();
+        built_ = now;
+    }
+    return payload_;
 }
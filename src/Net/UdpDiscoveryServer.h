@@ -1,5 +1,7 @@
 #pragma once
 
+#include <chrono>
+#include <functional>
 #include <iostream>
 #include <sstream>
 #include <string>
@@ -12,17 +14,40 @@
 using namespace std;
 using boost::asio::ip::udp;
 
+/*
+  UdpDiscoveryServer:
+                Answers every discovery probe with one line describing this
+                bridge and its current load (see Describe), so a client
+                probing several bridges can pick the least loaded. The line
+                is rebuilt at most once per refreshInterval, and answers are
+                rate limited so a flood of probes, spoofed or not, costs
+                little and is not reflected at full rate.
+*/
 class UdpDiscoveryServer {
 public:
-    UdpDiscoveryServer(boost::asio::io_service &io_service, unsigned short port)
+    // Builds the answer, "key=value;..." terminated by a newline
+    typedef std::function<std::string()> Describe;
+
+    static std::chrono::milliseconds refreshInterval;
+    // Answers per second across all senders, and how many may go out at once
+    static double answerRate;
+    static double answerBurst;
+
+    UdpDiscoveryServer(boost::asio::io_service &io_service, unsigned short port, Describe describe,
+                       bool reusePort = false)
             : io_service_(io_service),
-              socket_(io_service, udp::endpoint(udp::v4(), port)) {
-        // Register async receive-from handler
-        socket_.async_receive_from(
-                boost::asio::buffer(data_, max_length), sender_endpoint_,
-                boost::bind(&UdpDiscoveryServer::handle_receive_from, this,
-                            boost::asio::placeholders::error,
-                            boost::asio::placeholders::bytes_transferred));
+              socket_(io_service),
+              describe_(std::move(describe)),
+              tokens_(answerBurst),
+              refilled_(std::chrono::steady_clock::now()) {
+        udp::endpoint endpoint(udp::v4(), port);
+        socket_.open(endpoint.protocol());
+        if (reusePort) {
+            // Each worker process answers for itself
+            socket_.set_option(boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true));
+        }
+        socket_.bind(endpoint);
+        receive();
     };
 
     void handle_receive_from(const boost::system::error_code &error,
@@ -32,6 +57,12 @@ public:
                         size_t bytes_sent);
 
 private:
+    void receive();
+
+    bool allow();
+
+    const std::string &payload();
+
     boost::asio::io_service &io_service_;
     udp::socket socket_;
     udp::endpoint sender_endpoint_;
@@ -39,4 +70,12 @@ private:
         max_length = 1024
     };
     char data_[max_length];
+
+    Describe describe_;
+    // Stays untouched while a send of it is in flight, the next receive is
+    // only armed once the send completes
+    std::string payload_;
+    std::chrono::steady_clock::time_point built_;
+    double tokens_;
+    std::chrono::steady_clock::time_point refilled_;
 };
@@ -0,0 +1,555 @@
+#include "UringServer.h"
+
+#ifdef HAVE_LIBURING
+
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <cstdio>
+#include <iostream>
+
+#include <sys/socket.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+#include "AdmissionControl.h"
+#include "ConnectionMonitor.h"
+#include "LatencyTrace.h"
+#include "LowLatency.h"
+#include "Server.h"
+
+using namespace std;
+
+UringServer::~UringServer() {
+    if (initialized) {
+        io_uring_free_buf_ring(&ring, bufRing, bufferCount, bufferGroup);
+        io_uring_queue_exit(&ring);
+    }
+}
+
+/*
+  Supported():
+                Multishot receive with provided buffer rings needs Linux 6.0,
+                older kernels (or ones with io_uring disabled) use the
+                threaded backend instead.
+*/
+bool UringServer::Supported() {
+    utsname u{};
+    int major = 0, minor = 0;
+    if (uname(&u) != 0 || sscanf(u.release, "%d.%d", &major, &minor) != 2 || major < 6) {
+        return false;
+    }
+
+    io_uring_probe *probe = io_uring_get_probe();
+    if (!probe) {
+        return false;
+    }
+    bool supported = io_uring_opcode_supported(probe, IORING_OP_ACCEPT) &&
+                     io_uring_opcode_supported(probe, IORING_OP_RECV) &&
+                     io_uring_opcode_supported(probe, IORING_OP_SENDMSG);
+    io_uring_free_probe(probe);
+    return supported;
+}
+
+bool UringServer::Init() {
+    io_uring_params params{};
+    // Busy polling: a kernel thread picks up submissions, so sends from the
+    // DDS threads queue work without entering the kernel
+    if (LowLatency::enabled && LowLatency::busyPoll.count() > 0) {
+        params.flags = IORING_SETUP_SQPOLL;
+        params.sq_thread_idle = sqThreadIdleMs;
+        if (!LowLatency::ioCores.empty()) {
+            params.flags |= IORING_SETUP_SQ_AFF;
+            params.sq_thread_cpu = (unsigned) LowLatency::ioCores.back();
+        }
+    }
+    if (io_uring_queue_init_params(queueDepth, &ring, &params) < 0) {
+        if (params.flags == 0) {
+            cerr << "io_uring_queue_init failed" << endl;
+            return false;
+        }
+        cerr << "io_uring submission polling is not available, submitting from each thread" << endl;
+        params = io_uring_params{};
+        if (io_uring_queue_init_params(queueDepth, &ring, &params) < 0) {
+            cerr << "io_uring_queue_init failed" << endl;
+            return false;
+        }
+    }
+
+    int ret = 0;
+    bufRing = io_uring_setup_buf_ring(&ring, bufferCount, bufferGroup, 0, &ret);
+    if (!bufRing) {
+        cerr << "io_uring buffer ring setup failed: " << ret << endl;
+        io_uring_queue_exit(&ring);
+        return false;
+    }
+
+    bufferPool.resize((size_t) bufferCount * bufferSize);
+    for (unsigned i = 0; i < bufferCount; i++) {
+        io_uring_buf_ring_add(bufRing, &bufferPool[(size_t) i * bufferSize], bufferSize, i,
+                              io_uring_buf_ring_mask(bufferCount), i);
+    }
+    io_uring_buf_ring_advance(bufRing, bufferCount);
+
+    initialized = true;
+    return true;
+}
+
+void UringServer::Run(const std::vector<int> &listenSocks) {
+    accepts.resize(listenSocks.size());
+    for (size_t i = 0; i < listenSocks.size(); i++) {
+        accepts[i].type = OpType::Accept;
+        accepts[i].fd = listenSocks[i];
+    }
+    running = true;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto &req : accepts) {
+            ArmAccept(&req);
+        }
+        io_uring_submit(&ring);
+    }
+
+    while (running) {
+        io_uring_cqe *cqe;
+        int ret;
+        if (deferred.empty() && paused.empty()) {
+            ret = Spin(&cqe) ? 0 : io_uring_wait_cqe(&ring, &cqe);
+        } else {
+            // Wake up in time to admit the parked connections, or to see
+            // whether the paused ones may read again
+            std::chrono::milliseconds wait = std::chrono::milliseconds(1);
+            if (paused.empty()) {
+                wait = std::max(AdmissionControl::Wait(), wait);
+            }
+            __kernel_timespec ts{};
+            ts.tv_sec = wait.count() / 1000;
+            ts.tv_nsec = (wait.count() % 1000) * 1000000;
+            ret = io_uring_wait_cqe_timeout(&ring, &cqe, &ts);
+        }
+        if (ret == -EINTR || ret == -ETIME) {
+            AdmitDeferred();
+            ResumePaused();
+            std::lock_guard<std::mutex> lock(mutex);
+            io_uring_submit(&ring);
+            continue;
+        }
+        if (ret < 0) {
+            cerr << "io_uring_wait_cqe failed: " << ret << endl;
+            break;
+        }
+
+        // Handle everything that completed, then submit all re-arms and
+        // follow-up sends with a single io_uring_enter()
+        unsigned head;
+        unsigned count = 0;
+        io_uring_for_each_cqe(&ring, head, cqe) {
+            auto *req = (Request *) io_uring_cqe_get_data(cqe);
+            switch (req->type) {
+                case OpType::Accept:
+                    HandleAccept(req, cqe);
+                    break;
+                case OpType::Recv:
+                    HandleRecv(req, cqe);
+                    break;
+                case OpType::Send:
+                    HandleSend((SendOp *) req, cqe);
+                    break;
+                case OpType::Cancel:
+                    break;
+            }
+            count++;
+        }
+        io_uring_cq_advance(&ring, count);
+
+        AdmitDeferred();
+        ResumePaused();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        io_uring_submit(&ring);
+    }
+}
+
+/*
+  Spin():
+                Polls the completion queue for up to LowLatency::busyPoll, so
+                a completion arriving shortly is handled without sleeping in
+                io_uring_enter() and being woken again.
+*/
+bool UringServer::Spin(io_uring_cqe **cqe) {
+    if (!LowLatency::enabled || LowLatency::busyPoll.count() == 0) {
+        return false;
+    }
+    auto until = std::chrono::steady_clock::now() + LowLatency::busyPoll;
+    do {
+        if (io_uring_peek_cqe(&ring, cqe) == 0) {
+            return true;
+        }
+    } while (std::chrono::steady_clock::now() < until);
+    return false;
+}
+
+/*
+  Send():
+                May be called from any thread. Messages queue behind whatever
+                is already in flight for the socket to keep them ordered; a
+                control message also overtakes queued telemetry that has not
+                started going out.
+*/
+size_t UringServer::Queued() {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t queued = 0;
+    for (auto &entry : connections) {
+        queued += entry.second->pending.size();
+    }
+    return queued;
+}
+
+void UringServer::Send(int sock, const GatherMessage &message, SendPriority priority) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = connections.find(sock);
+    if (it == connections.end() || it->second->closing || message.Empty()) {
+        return;
+    }
+
+    auto *op = new SendOp();
+    op->type = OpType::Send;
+    op->fd = sock;
+    op->message = message;
+    op->priority = priority;
+    op->remaining = message.Size();
+    message.FillIovec(op->iov);
+
+    Connection *conn = it->second;
+    if (priority == SendPriority::Telemetry) {
+        TrimTelemetry(conn, message.Size());
+        conn->telemetryBytes += message.Size();
+    }
+    auto pos = conn->pending.end();
+    if (priority == SendPriority::Control) {
+        // In-flight sends and a partly written head cannot be reordered
+        pos = conn->pending.begin() + conn->inflight;
+        while (pos != conn->pending.end() &&
+               ((*pos)->priority == SendPriority::Control || (*pos)->first > 0 ||
+                (*pos)->remaining < (*pos)->message.Size())) {
+            ++pos;
+        }
+    }
+    conn->pending.insert(pos, op);
+    LatencyTrace::Stamp(message.Trace().get(), LatencySpan::Enqueued);
+    if (conn->inflight == 0) {
+        FlushSends(conn);
+        io_uring_submit(&ring);
+    }
+}
+
+/*
+  TrimTelemetry():
+                Same bound as the threaded backend's telemetry lane: beyond
+                OutboundQueue::telemetryLimit the oldest samples that have not
+                reached the kernel yet make room for the new one.
+*/
+void UringServer::TrimTelemetry(Connection *conn, size_t incoming) {
+    uint64_t dropped = 0;
+    auto pos = conn->pending.begin() + conn->inflight;
+    while (conn->telemetryBytes > 0 && conn->telemetryBytes + incoming > OutboundQueue::telemetryLimit &&
+           pos != conn->pending.end()) {
+        SendOp *op = *pos;
+        if (op->priority != SendPriority::Telemetry || op->submitted) {
+            ++pos;
+            continue;
+        }
+        conn->telemetryBytes -= op->message.Size();
+        delete op;
+        pos = conn->pending.erase(pos);
+        dropped++;
+    }
+    if (dropped > 0) {
+        OutboundQueue::AddDropped(dropped);
+    }
+}
+
+io_uring_sqe *UringServer::GetSqe() {
+    io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+    while (!sqe) {
+        // Submission queue full, push what we have to the kernel
+        io_uring_submit(&ring);
+        sqe = io_uring_get_sqe(&ring);
+    }
+    return sqe;
+}
+
+void UringServer::ArmAccept(Request *req) {
+    io_uring_sqe *sqe = GetSqe();
+    io_uring_prep_multishot_accept(sqe, req->fd, nullptr, nullptr, 0);
+    io_uring_sqe_set_data(sqe, req);
+}
+
+void UringServer::ArmRecv(Connection *conn) {
+    io_uring_sqe *sqe = GetSqe();
+    io_uring_prep_recv_multishot(sqe, conn->recv.fd, nullptr, 0, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = bufferGroup;
+    io_uring_sqe_set_data(sqe, &conn->recv);
+}
+
+/*
+  FlushSends():
+                Submits the head of the client's queue as one linked chain.
+                A short write or error breaks the link and cancels the rest,
+                which are resubmitted once the whole chain has completed.
+*/
+void UringServer::FlushSends(Connection *conn) {
+    if (conn->inflight > 0 || conn->pending.empty()) {
+        return;
+    }
+
+    size_t chain = std::min<size_t>(conn->pending.size(), maxChain);
+    for (size_t i = 0; i < chain; i++) {
+        SendOp *op = conn->pending[i];
+        if (!op->submitted) {
+            op->submitted = true;
+            if (op->priority == SendPriority::Telemetry) {
+                conn->telemetryBytes -= op->message.Size();
+            }
+        }
+        op->hdr.msg_iov = &op->iov[op->first];
+        op->hdr.msg_iovlen = op->iov.size() - op->first;
+
+        io_uring_sqe *sqe = GetSqe();
+        io_uring_prep_sendmsg(sqe, op->fd, &op->hdr, MSG_NOSIGNAL | MSG_WAITALL);
+        if (i + 1 < chain) {
+            sqe->flags |= IOSQE_IO_LINK;
+        }
+        io_uring_sqe_set_data(sqe, op);
+    }
+    conn->inflight = chain;
+}
+
+void UringServer::CloseConnection(Connection *conn) {
+    for (auto *op : conn->pending) {
+        delete op;
+    }
+    if (conn->paused) {
+        paused.erase(std::remove(paused.begin(), paused.end(), conn), paused.end());
+    }
+    connections.erase(conn->recv.fd);
+    close(conn->recv.fd);
+    ClientPool::Release(conn->client);
+    delete conn;
+}
+
+void UringServer::HandleAccept(Request *req, io_uring_cqe *cqe) {
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ArmAccept(req);
+    }
+
+    if (cqe->res < 0) {
+        cerr << "Error on accept: " << -cqe->res << endl;
+        return;
+    }
+
+    auto *conn = new Connection();
+    conn->client = ClientPool::Acquire();
+    conn->client->sock = cqe->res;
+    Server::Accepted(conn->client, req->fd);
+    conn->recv.type = OpType::Recv;
+    conn->recv.fd = cqe->res;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        connections[conn->recv.fd] = conn;
+    }
+
+    // Keep arrival order: nobody jumps the queue of parked connections
+    if (!deferred.empty() || AdmissionControl::Wait().count() > 0) {
+        deferred.push_back(conn);
+        return;
+    }
+    StartConnection(conn);
+}
+
+/*
+  StartConnection():
+                Begins the session; until then a parked connection is not
+                read from and has no client id, so nothing is sent to it.
+*/
+void UringServer::StartConnection(Connection *conn) {
+    AdmissionControl::Admit(conn->client);
+    Server::OnClientConnected(conn->client);
+    ConnectionMonitor::Watch(conn->client);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    ArmRecv(conn);
+}
+
+void UringServer::AdmitDeferred() {
+    while (!deferred.empty() && AdmissionControl::Wait().count() == 0) {
+        Connection *conn = deferred.front();
+        deferred.pop_front();
+        StartConnection(conn);
+    }
+}
+
+/*
+  Pause():
+                Called from a session hook while a receive completion is
+                being handled. Data already received is still delivered;
+                once the cancelled receive has ended nothing more is read.
+*/
+void UringServer::Pause(int sock) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = connections.find(sock);
+    if (it == connections.end() || it->second->paused || it->second->closing) {
+        return;
+    }
+    Connection *conn = it->second;
+    conn->paused = true;
+    paused.push_back(conn);
+    if (!conn->recvStopped) {
+        io_uring_sqe *sqe = GetSqe();
+        io_uring_prep_cancel(sqe, &conn->recv, 0);
+        io_uring_sqe_set_data(sqe, &cancelled);
+    }
+}
+
+void UringServer::ResumePaused() {
+    for (size_t i = 0; i < paused.size();) {
+        Connection *conn = paused[i];
+        if (!Server::OnClientResume(conn->client)) {
+            i++;
+            continue;
+        }
+        paused.erase(paused.begin() + i);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        conn->paused = false;
+        if (conn->recvStopped) {
+            conn->recvStopped = false;
+            ArmRecv(conn);
+        }
+    }
+}
+
+void UringServer::RecvEnded(Connection *conn) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (conn->paused) {
+        conn->recvStopped = true;
+    } else {
+        ArmRecv(conn);
+    }
+}
+
+void UringServer::HandleRecv(Request *req, io_uring_cqe *cqe) {
+    Connection *conn;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = connections.find(req->fd);
+        if (it == connections.end()) {
+            return;
+        }
+        conn = it->second;
+    }
+
+    if (cqe->res > 0) {
+        unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        char *data = &bufferPool[(size_t) bid * bufferSize];
+
+        ConnectionMonitor::Received(conn->client);
+        Server::Receive(conn->client, data, (size_t) cqe->res);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            io_uring_buf_ring_add(bufRing, data, bufferSize, bid, io_uring_buf_ring_mask(bufferCount), 0);
+            io_uring_buf_ring_advance(bufRing, 1);
+        }
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            RecvEnded(conn);
+        }
+        return;
+    }
+
+    // Every buffer is in use, try again once they have been returned; or
+    // the receive was cancelled to pause the session
+    if (cqe->res == -ENOBUFS || cqe->res == -ECANCELED) {
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            RecvEnded(conn);
+        }
+        return;
+    }
+
+    // Peer closed the connection or the receive failed
+    Server::OnClientDisconnected(conn->client);
+    ConnectionMonitor::Forget(conn->client);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    conn->closing = true;
+    shutdown(conn->recv.fd, SHUT_RDWR);
+    if (conn->inflight == 0) {
+        CloseConnection(conn);
+    }
+}
+
+void UringServer::HandleSend(SendOp *op, io_uring_cqe *cqe) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = connections.find(op->fd);
+    if (it == connections.end()) {
+        delete op;
+        return;
+    }
+    Connection *conn = it->second;
+
+    if (cqe->res > 0 && op->remaining == op->message.Size()) {
+        LatencyTrace::Stamp(op->message.Trace().get(), LatencySpan::FirstByte);
+    }
+
+    if (cqe->res >= 0 && (size_t) cqe->res >= op->remaining) {
+        op->done = true;
+        LatencyTrace::StampLatest(op->message.Trace().get(), LatencySpan::LastByte);
+    } else if (cqe->res > 0) {
+        // Short write, resume after the bytes that made it out
+        size_t n = (size_t) cqe->res;
+        op->remaining -= n;
+        while (n > 0) {
+            iovec &v = op->iov[op->first];
+            if (n >= v.iov_len) {
+                n -= v.iov_len;
+                op->first++;
+            } else {
+                v.iov_base = (char *) v.iov_base + n;
+                v.iov_len -= n;
+                n = 0;
+            }
+        }
+    } else if (cqe->res != -ECANCELED) {
+        conn->broken = true;
+    }
+
+    if (--conn->inflight > 0) {
+        return;
+    }
+
+    // The chain completes in order, so the finished sends are a prefix
+    while (!conn->pending.empty() && conn->pending.front()->done) {
+        delete conn->pending.front();
+        conn->pending.pop_front();
+    }
+
+    if (conn->closing) {
+        CloseConnection(conn);
+    } else if (conn->broken) {
+        for (auto *pending : conn->pending) {
+            delete pending;
+        }
+        conn->pending.clear();
+        conn->telemetryBytes = 0;
+    } else {
+        FlushSends(conn);
+    }
+}
+
+#endif
@@ -0,0 +1,156 @@
+#pragma once
+
+#ifdef HAVE_LIBURING
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <liburing.h>
+
+#include "Client.h"
+#include "MessageBuffer.h"
+#include "OutboundQueue.h"
+
+using namespace std;
+
+/*
+  UringServer:
+                io_uring backend for the client sessions. One thread runs a
+                multishot accept per listen socket (TCP, and Unix when
+                enabled) and a multishot receive per client into a
+                provided buffer ring. Outbound messages for a client are
+                submitted as a chain of linked sendmsg operations, so they
+                leave in order and a burst costs a single io_uring_enter().
+                Control messages queue ahead of telemetry that has not been
+                submitted yet, and that telemetry is capped per connection
+                at OutboundQueue::telemetryLimit bytes, oldest dropped first.
+                A session the bridge cannot keep up with has its receive
+                cancelled until Server::OnClientResume() lets it go on.
+*/
+class UringServer {
+public:
+    UringServer() = default;
+
+    ~UringServer();
+
+    static bool Supported();
+
+    bool Init();
+
+    void Run(const std::vector<int> &listenSocks);
+
+    void Send(int sock, const GatherMessage &message, SendPriority priority);
+
+    // Messages not yet fully written, across every connection
+    size_t Queued();
+
+    // Stops reading from the socket until the bridge resumes it; ring thread only
+    void Pause(int sock);
+
+private:
+    enum class OpType : uint8_t {
+        Accept,
+        Recv,
+        Send,
+        Cancel
+    };
+
+    struct Request {
+        OpType type;
+        int fd;
+    };
+
+    struct SendOp : Request {
+        GatherMessage message;
+        SendPriority priority = SendPriority::Control;
+        std::vector<iovec> iov;
+        size_t first = 0;
+        size_t remaining = 0;
+        bool done = false;
+        // Handed to the kernel at least once, may no longer be dropped
+        bool submitted = false;
+        msghdr hdr{};
+    };
+
+    struct Connection {
+        Client *client = nullptr;
+        Request recv{};
+        // Not yet fully written, in order; the first `inflight` are submitted
+        std::deque<SendOp *> pending;
+        size_t inflight = 0;
+        // Telemetry in pending that was never submitted
+        size_t telemetryBytes = 0;
+        bool broken = false;
+        bool closing = false;
+        // Reads paused for backpressure, and the multishot receive has ended
+        bool paused = false;
+        bool recvStopped = false;
+    };
+
+    static const unsigned queueDepth = 512;
+    static const unsigned bufferCount = 256;
+    static const unsigned bufferSize = 8192;
+    static const unsigned maxChain = 64;
+    static const int bufferGroup = 0;
+    // The submission polling thread sleeps after this long without work
+    static const unsigned sqThreadIdleMs = 1000;
+
+    io_uring ring{};
+    io_uring_buf_ring *bufRing = nullptr;
+    std::vector<char> bufferPool;
+    bool initialized = false;
+    bool running = false;
+
+    // Sized once before the first accept is armed, never reallocated
+    std::vector<Request> accepts;
+    std::map<int, Connection *> connections;
+
+    // Accepted while AdmissionControl held new sessions back, oldest first.
+    // Only touched by the ring thread.
+    std::deque<Connection *> deferred;
+
+    // Connections whose reads are paused, retried every loop. Ring thread only.
+    std::deque<Connection *> paused;
+
+    // Completion of a receive cancellation, nothing to do for it
+    Request cancelled{OpType::Cancel, -1};
+
+    // Guards the submission queue, the buffer ring and the connection map
+    std::mutex mutex;
+
+    io_uring_sqe *GetSqe();
+
+    // Low latency mode: waits for a completion without sleeping, for a while
+    bool Spin(io_uring_cqe **cqe);
+
+    void ArmAccept(Request *req);
+
+    void ArmRecv(Connection *conn);
+
+    void FlushSends(Connection *conn);
+
+    // Drops unsubmitted telemetry, oldest first, until `incoming` more bytes fit
+    void TrimTelemetry(Connection *conn, size_t incoming);
+
+    void CloseConnection(Connection *conn);
+
+    void HandleAccept(Request *req, io_uring_cqe *cqe);
+
+    void StartConnection(Connection *conn);
+
+    void AdmitDeferred();
+
+    void ResumePaused();
+
+    // The multishot receive ended without an error; re-arms it unless paused
+    void RecvEnded(Connection *conn);
+
+    void HandleRecv(Request *req, io_uring_cqe *cqe);
+
+    void HandleSend(SendOp *op, io_uring_cqe *cqe);
+};
+
+#endif
@@ -0,0 +1,290 @@
+#include "WebSocket.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+#include <boost/archive/iterators/base64_from_binary.hpp>
+#include <boost/archive/iterators/transform_width.hpp>
+#include <boost/uuid/detail/sha1.hpp>
+
+using namespace std;
+
+size_t WebSocketSession::maxMessage = 1024 * 1024;
+
+namespace {
+
+const char *const acceptGuid = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+// Older Boost hands out the SHA-1 digest as five words, newer as 20 bytes
+void DigestBytes(const unsigned int (&digest)[5], unsigned char *out) {
+    for (int i = 0; i < 5; i++) {
+        out[i * 4] = (unsigned char) (digest[i] >> 24);
+        out[i * 4 + 1] = (unsigned char) (digest[i] >> 16);
+        out[i * 4 + 2] = (unsigned char) (digest[i] >> 8);
+        out[i * 4 + 3] = (unsigned char) digest[i];
+    }
+}
+
+void DigestBytes(const unsigned char (&digest)[20], unsigned char *out) {
+    memcpy(out, digest, 20);
+}
+
+std::string Base64(const unsigned char *data, size_t length) {
+    using namespace boost::archive::iterators;
+    typedef base64_from_binary<transform_width<const unsigned char *, 6, 8>> Encoder;
+    std::string out(Encoder(data), Encoder(data + length));
+    out.append((3 - length % 3) % 3, '=');
+    return out;
+}
+
+std::string Lower(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) {
+        return (char) std::tolower(c);
+    });
+    return text;
+}
+
+// Value of a request header, trimmed; empty when absent
+std::string Header(const std::string &request, const std::string &name) {
+    std::string lower = Lower(request);
+    std::string field = "\r\n" + Lower(name) + ":";
+    size_t at = lower.find(field);
+    if (at == std::string::npos) {
+        return "";
+    }
+    size_t begin = request.find_first_not_of(" \t", at + field.size());
+    size_t end = request.find("\r\n", at + field.size());
+    if (begin == std::string::npos || begin >= end) {
+        return "";
+    }
+    return request.substr(begin, request.find_last_not_of(" \t", end - 1) + 1 - begin);
+}
+
+// Whether a comma-separated header value lists token, ignoring case
+bool HasToken(const std::string &value, const std::string &token) {
+    std::string lower = Lower(value);
+    size_t begin = 0;
+    while (begin <= lower.size()) {
+        size_t end = std::min(lower.find(',', begin), lower.size());
+        size_t first = lower.find_first_not_of(" \t", begin);
+        if (first < end) {
+            size_t last = lower.find_last_not_of(" \t", end - 1);
+            if (lower.compare(first, last + 1 - first, token) == 0) {
+                return true;
+            }
+        }
+        begin = end + 1;
+    }
+    return false;
+}
+
+// Body of a close frame carrying only a status code
+std::string CloseCode(uint16_t code) {
+    return std::string{(char) (code >> 8), (char) code};
+}
+
+const uint16_t protocolError = 1002;
+const uint16_t messageTooBig = 1009;
+
+}
+
+bool WebSocketSession::Receive(const char *data, size_t length, std::string &payload, std::string &reply) {
+    input.append(data, length);
+    if (!upgraded) {
+        if (!Upgrade(reply)) {
+            return false;
+        }
+        if (!upgraded) {
+            return true;
+        }
+    }
+    return Frames(payload, reply);
+}
+
+/*
+  Upgrade():
+                Waits for the whole request head; whatever follows it is
+                left in input as the first frames. Only version 13 is
+                spoken; other versions are told so with a 426.
+*/
+bool WebSocketSession::Upgrade(std::string &reply) {
+    size_t end = input.find("\r\n\r\n");
+    if (end == std::string::npos) {
+        if (input.size() > maxRequest) {
+            reply = "HTTP/1.1 431 Request Header Fields Too Large\r\nConnection: close\r\n\r\n";
+            return false;
+        }
+        return true;
+    }
+
+    std::string request = input.substr(0, end + 2);
+    input.erase(0, end + 4);
+
+    std::string key = Header(request, "Sec-WebSocket-Key");
+    if (request.compare(0, 4, "GET ") != 0 || !HasToken(Header(request, "Upgrade"), "websocket") ||
+        !HasToken(Header(request, "Connection"), "upgrade") || key.empty()) {
+        reply = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n";
+        return false;
+    }
+    if (Header(request, "Sec-WebSocket-Version") != "13") {
+        reply = "HTTP/1.1 426 Upgrade Required\r\n"
+                "Sec-WebSocket-Version: 13\r\n"
+                "Connection: close\r\n\r\n";
+        return false;
+    }
+
+    reply = "HTTP/1.1 101 Switching Protocols\r\n"
+            "Upgrade: websocket\r\n"
+            "Connection: Upgrade\r\n"
+            "Sec-WebSocket-Accept: " + AcceptKey(key) + "\r\n\r\n";
+    upgraded = true;
+    return true;
+}
+
+/*
+  Frames():
+                Anything RFC 6455 calls a protocol error closes with 1002 as
+                soon as the frame header shows it: reserved bits or opcodes,
+                an unmasked frame, a fragmented or oversized control frame,
+                a continuation with no message started, or a new message
+                while one is still being fragmented.
+*/
+bool WebSocketSession::Frames(std::string &payload, std::string &reply) {
+    size_t at = 0;
+    bool keep = true;
+
+    while (keep) {
+        const unsigned char *head = (const unsigned char *) input.data() + at;
+        size_t available = input.size() - at;
+        if (available < 2) {
+            break;
+        }
+        bool fin = (head[0] & 0x80) != 0;
+        uint8_t opcode = head[0] & 0x0f;
+        bool masked = (head[1] & 0x80) != 0;
+        uint64_t length = head[1] & 0x7f;
+
+        bool control = (opcode & 0x08) != 0;
+        bool known = opcode == Continuation || opcode == Text || opcode == Binary ||
+                     opcode == Close || opcode == Ping || opcode == Pong;
+        // No extension is negotiated, so the reserved bits must be clear
+        if ((head[0] & 0x70) != 0 || !known || !masked ||
+            (control && (!fin || length > 125)) ||
+            (opcode == Continuation && !fragmented) ||
+            ((opcode == Text || opcode == Binary) && fragmented)) {
+            reply += ControlFrame(Close, CloseCode(protocolError));
+            return false;
+        }
+
+        size_t size = 2;
+        if (length == 126) {
+            size += 2;
+        } else if (length == 127) {
+            size += 8;
+        }
+        size += 4;
+        if (available < size) {
+            break;
+        }
+        if (length == 126) {
+            length = ((uint64_t) head[2] << 8) | head[3];
+        } else if (length == 127) {
+            length = 0;
+            for (int i = 0; i < 8; i++) {
+                length = (length << 8) | head[2 + i];
+            }
+        }
+
+        if (length > maxMessage || message.size() + length > maxMessage) {
+            reply += ControlFrame(Close, CloseCode(messageTooBig));
+            return false;
+        }
+        if (available - size < length) {
+            break;
+        }
+
+        const unsigned char *mask = head + size - 4;
+        std::string body((const char *) head + size, (size_t) length);
+        for (size_t i = 0; i < body.size(); i++) {
+            body[i] ^= mask[i & 3];
+        }
+        at += size + (size_t) length;
+
+        switch (opcode) {
+            case Continuation:
+            case Text:
+            case Binary:
+                message += body;
+                fragmented = !fin;
+                if (fin) {
+                    if (message.empty() || message.back() != '\n') {
+                        message += '\n';
+                    }
+                    payload += message;
+                    message.clear();
+                }
+                break;
+            case Ping:
+                reply += ControlFrame(Pong, body);
+                break;
+            case Pong:
+                break;
+            case Close:
+                reply += ControlFrame(Close, body.substr(0, 2));
+                keep = false;
+                break;
+            default:
+                reply += ControlFrame(Close, CloseCode(protocolError));
+                keep = false;
+                break;
+        }
+    }
+
+    input.erase(0, at);
+    return keep;
+}
+
+std::string WebSocketSession::ControlFrame(Opcode opcode, const std::string &body) {
+    std::string frame;
+    frame += (char) (0x80 | opcode);
+    frame += (char) std::min<size_t>(body.size(), 125);
+    frame.append(body, 0, 125);
+    return frame;
+}
+
+GatherMessage WebSocketSession::Frame(const GatherMessage &message, bool binary) {
+    size_t length = message.Size();
+    std::string header;
+    header += (char) (0x80 | (binary ? Binary : Text));
+    if (length < 126) {
+        header += (char) length;
+    } else if (length <= 0xffff) {
+        header += (char) 126;
+        header += (char) (length >> 8);
+        header += (char) length;
+    } else {
+        header += (char) 127;
+        for (int shift = 56; shift >= 0; shift -= 8) {
+            header += (char) ((uint64_t) length >> shift);
+        }
+    }
+
+    GatherMessage framed;
+    framed.Append(header);
+    framed.Append(message);
+    framed.SetTrace(message.Trace());
+    return framed;
+}
+
+std::string WebSocketSession::AcceptKey(const std::string &key) {
+    boost::uuids::detail::sha1 sha;
+    std::string input = key + acceptGuid;
+    sha.process_bytes(input.data(), input.size());
+    boost::uuids::detail::sha1::digest_type digest;
+    sha.get_digest(digest);
+
+    unsigned char bytes[20];
+    DigestBytes(digest, bytes);
+    return Base64(bytes, sizeof(bytes));
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "MessageBuffer.h"
+
+using namespace std;
+
+/*
+  WebSocketSession:
+                Server side of RFC 6455 for browser sessions. Until the HTTP
+                upgrade has been answered nothing is sent to the client;
+                afterwards every outbound message goes out as one WebSocket
+                message carrying exactly the bytes a TCP client would get.
+                The payloads of the client's data messages are handed to the
+                session like bytes read from a plain socket, each message
+                ending a line.
+*/
+class WebSocketSession {
+public:
+    // Larger client messages close the connection
+    static size_t maxMessage;
+
+    /*
+      Consumes bytes read from the socket. Payload receives the data for
+      the session; reply the bytes to send back unframed (the upgrade
+      response, pongs, the closing handshake). False once the connection
+      should be closed.
+    */
+    bool Receive(const char *data, size_t length, std::string &payload, std::string &reply);
+
+    // The upgrade response has been written; receive side only
+    bool Upgraded() const {
+        return upgraded;
+    }
+
+    // Set once the upgrade response is queued, outbound messages may follow
+    void MarkOpen() {
+        open.store(true);
+    }
+
+    bool Open() const {
+        return open.load();
+    }
+
+    // One message: binary for compressed sessions, text otherwise
+    static GatherMessage Frame(const GatherMessage &message, bool binary);
+
+private:
+    enum Opcode : uint8_t {
+        Continuation = 0x0,
+        Text = 0x1,
+        Binary = 0x2,
+        Close = 0x8,
+        Ping = 0x9,
+        Pong = 0xa
+    };
+
+    static const size_t maxRequest = 8192;
+
+    bool Upgrade(std::string &reply);
+
+    // Parses whole frames out of input; false on a protocol error or close
+    bool Frames(std::string &payload, std::string &reply);
+
+    static std::string ControlFrame(Opcode opcode, const std::string &body);
+
+    static std::string AcceptKey(const std::string &key);
+
+    std::string input;
+    std::string message;
+    // A data frame without FIN was read; only continuations may follow
+    bool fragmented = false;
+    bool upgraded = false;
+    std::atomic<bool> open{false};
+};
@@ -0,0 +1,164 @@
+#include "ZeroCopySender.h"
+
+#include <algorithm>
+#include <cerrno>
+
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY)
+#define HAVE_MSG_ZEROCOPY 1
+#endif
+
+using namespace std;
+
+// Below roughly 16KB the page pinning costs more than the copy it saves.
+size_t ZeroCopySender::threshold = 16 * 1024;
+
+std::map<int, ZeroCopySender::SocketState> ZeroCopySender::sockets;
+std::mutex ZeroCopySender::mutex;
+
+ssize_t ZeroCopySender::SendSome(int sock, const GatherMessage &message, size_t offset) {
+    // Reused across sends so the iovec list is not reallocated per message
+    thread_local std::vector<iovec> iov;
+    message.FillIovec(iov);
+
+    size_t idx = 0;
+    while (offset > 0 && idx < iov.size()) {
+        if (offset >= iov[idx].iov_len) {
+            offset -= iov[idx].iov_len;
+            ++idx;
+        } else {
+            iov[idx].iov_base = (char *) iov[idx].iov_base + offset;
+            iov[idx].iov_len -= offset;
+            offset = 0;
+        }
+    }
+    if (idx == iov.size()) {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    SocketState &state = sockets[sock];
+
+    if (!state.pending.empty()) {
+        ReapCompletions(sock, state);
+    }
+
+    bool zerocopy = threshold > 0 && message.Size() >= threshold && Enable(sock, state);
+
+    msghdr msg{};
+    msg.msg_iov = &iov[idx];
+    msg.msg_iovlen = iov.size() - idx;
+
+    for (;;) {
+        int flags = MSG_NOSIGNAL | MSG_DONTWAIT;
+#ifdef HAVE_MSG_ZEROCOPY
+        if (zerocopy) {
+            flags |= MSG_ZEROCOPY;
+        }
+#endif
+        ssize_t n = sendmsg(sock, &msg, flags);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (zerocopy && errno == ENOBUFS) {
+                // Out of optmem for pinned pages, fall back to a copy
+                zerocopy = false;
+                continue;
+            }
+            return n;
+        }
+
+        if (zerocopy) {
+            // Every successful zerocopy call consumes one notification id
+            state.pending.push_back({state.nextId++, message});
+        }
+        return n;
+    }
+}
+
+void ZeroCopySender::Forget(int sock) {
+    std::lock_guard<std::mutex> lock(mutex);
+    sockets.erase(sock);
+}
+
+bool ZeroCopySender::HasPending(int sock) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = sockets.find(sock);
+    return it != sockets.end() && !it->second.pending.empty();
+}
+
+bool ZeroCopySender::Reap(int sock) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = sockets.find(sock);
+    if (it == sockets.end() || it->second.pending.empty()) {
+        return false;
+    }
+    return ReapCompletions(sock, it->second);
+}
+
+bool ZeroCopySender::Enable(int sock, SocketState &state) {
+#ifdef HAVE_MSG_ZEROCOPY
+    if (!state.probed) {
+        int one = 1;
+        state.probed = true;
+        state.enabled = setsockopt(sock, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+    }
+    return state.enabled;
+#else
+    return false;
+#endif
+}
+
+/*
+  ReapCompletions():
+                Drains zerocopy notifications without blocking and releases
+                the buffers whose transmission the kernel has finished with.
+*/
+bool ZeroCopySender::ReapCompletions(int sock, SocketState &state) {
+    size_t before = state.pending.size();
+#ifdef HAVE_MSG_ZEROCOPY
+    while (!state.pending.empty()) {
+        char control[128];
+        msghdr msg{};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(sock, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            break;
+        }
+
+        for (cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            bool isRecvErr = (cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                             (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR);
+            if (!isRecvErr) {
+                continue;
+            }
+
+            auto *err = (sock_extended_err *) CMSG_DATA(cm);
+            if (err->ee_errno != 0 || err->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+
+            // The kernel had to copy anyway (e.g. loopback), stop pinning pages
+            if ((err->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) && ++state.copied >= 8) {
+                state.enabled = false;
+            }
+
+            uint32_t lo = err->ee_info;
+            uint32_t hi = err->ee_data;
+            state.pending.erase(
+                    std::remove_if(state.pending.begin(), state.pending.end(),
+                                   [lo, hi](const Pending &p) {
+                                       return (uint32_t) (p.id - lo) <= (uint32_t) (hi - lo);
+                                   }),
+                    state.pending.end());
+        }
+    }
+#else
+    state.pending.clear();
+#endif
+    return state.pending.size() < before;
+}
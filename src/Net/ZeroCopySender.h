@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <sys/socket.h>
+
+#include "MessageBuffer.h"
+
+using namespace std;
+
+/*
+  ZeroCopySender:
+                Writes a GatherMessage to a socket with a single non-blocking
+                sendmsg(), resuming at `offset` after a partial write.
+                Messages of at least `threshold` bytes are sent with
+                MSG_ZEROCOPY, and their buffers are kept alive until the
+                kernel reports completion on the socket's error queue. The
+                caller watches for EPOLLERR while HasPending() and calls Reap().
+*/
+class ZeroCopySender {
+public:
+    // Bytes written, or -1 with errno set (EAGAIN when the socket is full)
+    static ssize_t SendSome(int sock, const GatherMessage &message, size_t offset);
+
+    static void Forget(int sock);
+
+    // Zerocopy sends on the socket the kernel has not released yet
+    static bool HasPending(int sock);
+
+    // Releases the finished ones; false if there were none to release
+    static bool Reap(int sock);
+
+    // 0 disables MSG_ZEROCOPY entirely
+    static size_t threshold;
+
+private:
+    struct Pending {
+        uint32_t id;
+        GatherMessage message;
+    };
+
+    struct SocketState {
+        bool probed = false;
+        bool enabled = false;
+        uint32_t nextId = 0;
+        unsigned copied = 0;
+        std::deque<Pending> pending;
+    };
+
+    static std::map<int, SocketState> sockets;
+    static std::mutex mutex;
+
+    static bool Enable(int sock, SocketState &state);
+
+    static bool ReapCompletions(int sock, SocketState &state);
+};
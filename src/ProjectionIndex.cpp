@@ -0,0 +1,67 @@
+#include "ProjectionIndex.h"
+
+#include <mutex>
+
+void ProjectionIndex::Replace(ClientHandle client,
+                              const std::vector<std::pair<TopicId, FieldMask>> &projections) {
+    std::unique_lock<boost::shared_mutex> lock(mutex);
+    ClearLocked(client);
+
+    for (auto &projection : projections) {
+        if (projection.second == allFields) {
+            continue;
+        }
+        if (byTopic.size() <= projection.first) {
+            byTopic.resize(projection.first + 1);
+        }
+        byTopic[projection.first][client] = projection.second;
+        byClient[client].push_back(projection.first);
+    }
+}
+
+void ProjectionIndex::Clear(ClientHandle client) {
+    std::unique_lock<boost::shared_mutex> lock(mutex);
+    ClearLocked(client);
+}
+
+void ProjectionIndex::ClearLocked(ClientHandle client) {
+    auto it = byClient.find(client);
+    if (it == byClient.end()) {
+        return;
+    }
+    for (TopicId topic : it->second) {
+        byTopic[topic].erase(client);
+    }
+    byClient.erase(it);
+}
+
+std::vector<std::pair<FieldMask, std::vector<ClientHandle>>> ProjectionIndex::Group(
+        TopicId topic, const std::vector<ClientHandle> &recipients) const {
+    std::vector<std::pair<FieldMask, std::vector<ClientHandle>>> groups;
+    if (recipients.empty()) {
+        return groups;
+    }
+
+    boost::shared_lock<boost::shared_mutex> lock(mutex);
+    if (topic >= byTopic.size() || byTopic[topic].empty()) {
+        groups.emplace_back(allFields, recipients);
+        return groups;
+    }
+
+    const std::unordered_map<ClientHandle, FieldMask> &projected = byTopic[topic];
+    for (auto &client : recipients) {
+        auto found = projected.find(client);
+        FieldMask fields = found == projected.end() ? allFields : found->second;
+
+        // Few distinct projections per topic, a linear scan beats hashing
+        size_t g = 0;
+        while (g < groups.size() && groups[g].first != fields) {
+            g++;
+        }
+        if (g == groups.size()) {
+            groups.emplace_back(fields, std::vector<ClientHandle>());
+        }
+        groups[g].second.push_back(client);
+    }
+    return groups;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <boost/thread/shared_mutex.hpp>
+
+#include "Net/ClientHandle.h"
+#include "TopicRegistry.h"
+
+// One bit per field of an event frame, in the order the frame lists them
+typedef uint32_t FieldMask;
+
+const FieldMask allFields = ~(FieldMask) 0;
+
+/*
+  ProjectionIndex:
+                The fields each client wants from an event topic. Recipients
+                of an event are grouped by projection, so every group shares
+                one frame formatted with just its fields; clients without a
+                projection get the full frame.
+*/
+class ProjectionIndex {
+public:
+    void Replace(ClientHandle client, const std::vector<std::pair<TopicId, FieldMask>> &projections);
+
+    void Clear(ClientHandle client);
+
+    // Recipients grouped by the fields they want from the topic
+    std::vector<std::pair<FieldMask, std::vector<ClientHandle>>> Group(TopicId topic,
+                                                                       const std::vector<ClientHandle> &recipients) const;
+
+private:
+    void ClearLocked(ClientHandle client);
+
+    std::unordered_map<ClientHandle, std::vector<TopicId>> byClient;
+    // Indexed by TopicId, only clients with a projection are listed
+    std::vector<std::unordered_map<ClientHandle, FieldMask>> byTopic;
+    mutable boost::shared_mutex mutex;
+};
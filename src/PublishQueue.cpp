@@ -0,0 +1,74 @@
+#include "PublishQueue.h"
+
+PublishQueue::PublishQueue(size_t capacity) : capacity(capacity) {
+}
+
+void PublishQueue::Start() {
+    worker = std::thread(&PublishQueue::Run, this);
+    worker.detach();
+}
+
+void PublishQueue::SpinFor(std::chrono::microseconds duration) {
+    spin = duration;
+}
+
+void PublishQueue::Post(std::function<void()> write) {
+    std::unique_lock<std::mutex> lock(mutex);
+    notFull.wait(lock, [this] { return queue.size() < capacity; });
+    Enqueue(lock, std::move(write));
+}
+
+bool PublishQueue::TryPost(std::function<void()> &write) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (queue.size() >= capacity) {
+        return false;
+    }
+    Enqueue(lock, std::move(write));
+    return true;
+}
+
+void PublishQueue::Enqueue(std::unique_lock<std::mutex> &lock, std::function<void()> write) {
+    queue.push_back(std::move(write));
+    queued.store(queue.size(), std::memory_order_release);
+    if (queue.size() > peak) {
+        peak = queue.size();
+    }
+    lock.unlock();
+    notEmpty.notify_one();
+}
+
+size_t PublishQueue::Pending() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return queue.size();
+}
+
+size_t PublishQueue::TakePeak() {
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t result = peak;
+    peak = queue.size();
+    return result;
+}
+
+void PublishQueue::Run() {
+    std::deque<std::function<void()>> batch;
+
+    while (true) {
+        if (spin.count() > 0) {
+            auto until = std::chrono::steady_clock::now() + spin;
+            while (queued.load(std::memory_order_acquire) == 0 && std::chrono::steady_clock::now() < until) {
+            }
+        }
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            notEmpty.wait(lock, [this] { return !queue.empty(); });
+            batch.swap(queue);
+            queued.store(0, std::memory_order_relaxed);
+        }
+        notFull.notify_all();
+
+        for (auto &write : batch) {
+            write();
+        }
+        batch.clear();
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/*
+  PublishQueue:
+                Hands DDS writes for client-originated messages to a single
+                publisher thread, so a client's read loop never waits on the
+                middleware. One FIFO keeps every client's writes in the order
+                they were read. The publisher takes everything queued at once
+                and writes it back to back. A full queue makes Post() wait
+                and TryPost() refuse; neither ever drops a write.
+*/
+class PublishQueue {
+public:
+    explicit PublishQueue(size_t capacity);
+
+    void Start();
+
+    // Polls this long for new writes before sleeping, so Post() finds the
+    // publisher awake and needs no wakeup. 0 sleeps at once.
+    void SpinFor(std::chrono::microseconds duration);
+
+    void Post(std::function<void()> write);
+
+    // Never waits. False, the write left with the caller, when the queue is
+    // full; the write is moved from only when it is queued
+    bool TryPost(std::function<void()> &write);
+
+    size_t Pending();
+
+    // Longest the queue has been since the last call
+    size_t TakePeak();
+
+private:
+    void Run();
+
+    // Called with the lock held and room in the queue; releases the lock
+    void Enqueue(std::unique_lock<std::mutex> &lock, std::function<void()> write);
+
+    size_t capacity;
+    size_t peak = 0;
+    std::chrono::microseconds spin{0};
+    // Mirrors queue.size() for the spinning publisher
+    std::atomic<size_t> queued{0};
+    std::deque<std::function<void()>> queue;
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+    std::thread worker;
+};
@@ -0,0 +1,30 @@
+#include "Serializers.h"
+
+#include <algorithm>
+#include <cstdio>
+
+/*
+  Put(double):
+                Same bytes as std::ostream's default floating point output,
+                which is printf's %g with six significant digits.
+*/
+FrameWriter &FrameWriter::Put(double value) {
+    char digits[32];
+    int n = snprintf(digits, sizeof(digits), "%g", value);
+    if (n > 0) {
+        out.append(digits, (size_t) n);
+    }
+    return *this;
+}
+
+FieldMask ProjectFields(const std::vector<std::string> &names, std::initializer_list<const char *> frameFields) {
+    FieldMask fields = 0;
+    unsigned index = 0;
+    for (const char *field : frameFields) {
+        if (std::find(names.begin(), names.end(), field) != names.end()) {
+            fields |= (FieldMask) 1 << index;
+        }
+        index++;
+    }
+    return fields;
+}
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+#include "Net/MessageBuffer.h"
+#include "ProjectionIndex.h"
+
+#include "amm_std.h"
+
+/*
+  FrameWriter:
+                Appends protocol fields to a pooled buffer reserved up front,
+                without going through iostreams or locale facets.
+*/
+class FrameWriter {
+public:
+    explicit FrameWriter(size_t capacity) {
+        out.reserve(capacity);
+    }
+
+    FrameWriter &Put(const std::string &text) {
+        out.append(text.data(), text.size());
+        return *this;
+    }
+
+    template<size_t N>
+    FrameWriter &Put(const char (&literal)[N]) {
+        out.append(literal, N - 1);
+        return *this;
+    }
+
+    FrameWriter &Put(char c) {
+        out.push_back(c);
+        return *this;
+    }
+
+    FrameWriter &Put(double value);
+
+    // name=value and the separator, if the field is in the projection
+    template<size_t N>
+    FrameWriter &Field(FieldMask fields, unsigned index, const char (&name)[N], const std::string &value,
+                       bool separator = true) {
+        if (fields & ((FieldMask) 1 << index)) {
+            Put(name).Put(value);
+            if (separator) {
+                Put(';');
+            }
+        }
+        return *this;
+    }
+
+    MessageBuffer Take() {
+        return MakeMessageBuffer(std::move(out));
+    }
+
+private:
+    OutboundString out;
+};
+
+/*
+  Fields an event-style frame takes from the EventRecord it refers to.
+*/
+struct EventContext {
+    std::string location;
+    std::string participant;
+    std::string type;
+};
+
+/*
+  Bits for the named fields, by position in the frame's field list. Names
+  that are not in the list are ignored.
+*/
+FieldMask ProjectFields(const std::vector<std::string> &names, std::initializer_list<const char *> frameFields);
+
+/*
+  Serializer<T>:
+                One specialization per AMM type the bridge forwards. Each
+                produces exactly the bytes the TCP protocol defines for it.
+                Event-style frames take a projection and leave out the
+                fields not in it; allFields gives the full frame.
+*/
+template<typename T>
+struct Serializer;
+
+template<>
+struct Serializer<AMM::PhysiologyValue> {
+    static MessageBuffer Write(const AMM::PhysiologyValue &n) {
+        FrameWriter w(n.name().size() + 32);
+        w.Put(n.name()).Put('=').Put(n.value()).Put("|\n");
+        return w.Take();
+    }
+};
+
+template<>
+struct Serializer<AMM::PhysiologyWaveform> {
+    static MessageBuffer Write(const AMM::PhysiologyWaveform &n) {
+        FrameWriter w(n.name().size() + 32);
+        w.Put(n.name()).Put('=').Put(n.value()).Put("|\n");
+        return w.Take();
+    }
+};
+
+template<>
+struct Serializer<AMM::PhysiologyModification> {
+    static FieldMask Project(const std::vector<std::string> &names) {
+        return ProjectFields(names, {"id", "event_id", "type", "location", "participant_id", "payload"});
+    }
+
+    static MessageBuffer Write(const AMM::PhysiologyModification &pm, const EventContext &ctx,
+                               FieldMask fields = allFields) {
+        FrameWriter w(128 + pm.id().id().size() + pm.event_id().id().size() + pm.type().size() +
+                      ctx.location.size() + ctx.participant.size() + pm.data().size());
+        w.Put("[AMM_Physiology_Modification]")
+                .Field(fields, 0, "id=", pm.id().id())
+                .Field(fields, 1, "event_id=", pm.event_id().id())
+                .Field(fields, 2, "type=", pm.type())
+                .Field(fields, 3, "location=", ctx.location)
+                .Field(fields, 4, "participant_id=", ctx.participant)
+                .Field(fields, 5, "payload=", pm.data(), false)
+                .Put('\n');
+        return w.Take();
+    }
+};
+
+template<>
+struct Serializer<AMM::EventRecord> {
+    static FieldMask Project(const std::vector<std::string> &names) {
+        return ProjectFields(names, {"id", "type", "location", "participant_id", "participant_type", "data"});
+    }
+
+    static MessageBuffer Write(const AMM::EventRecord &er, FieldMask fields = allFields) {
+        std::string pType = AMM::Utility::EEventAgentTypeStr(er.agent_type());
+        FrameWriter w(128 + er.id().id().size() + er.type().size() + er.location().name().size() +
+                      er.agent_id().id().size() + pType.size() + er.data().size());
+        w.Put("[AMM_EventRecord]")
+                .Field(fields, 0, "id=", er.id().id())
+                .Field(fields, 1, "type=", er.type())
+                .Field(fields, 2, "location=", er.location().name())
+                .Field(fields, 3, "participant_id=", er.agent_id().id())
+                .Field(fields, 4, "participant_type=", pType)
+                .Field(fields, 5, "data=", er.data())
+                .Put('\n');
+        return w.Take();
+    }
+};
+
+template<>
+struct Serializer<AMM::Assessment> {
+    static FieldMask Project(const std::vector<std::string> &names) {
+        return ProjectFields(names, {"id", "event_id", "type", "location", "participant_id", "value", "comment"});
+    }
+
+    static MessageBuffer Write(const AMM::Assessment &a, const EventContext &ctx, FieldMask fields = allFields) {
+        std::string value = AMM::Utility::EAssessmentValueStr(a.value());
+        FrameWriter w(128 + a.id().id().size() + a.event_id().id().size() + ctx.type.size() +
+                      ctx.location.size() + ctx.participant.size() + value.size() + a.comment().size());
+        w.Put("[AMM_Assessment]")
+                .Field(fields, 0, "id=", a.id().id())
+                .Field(fields, 1, "event_id=", a.event_id().id())
+                .Field(fields, 2, "type=", ctx.type)
+                .Field(fields, 3, "location=", ctx.location)
+                .Field(fields, 4, "participant_id=", ctx.participant)
+                .Field(fields, 5, "value=", value)
+                .Field(fields, 6, "comment=", a.comment(), false)
+                .Put('\n');
+        return w.Take();
+    }
+};
+
+template<>
+struct Serializer<AMM::RenderModification> {
+    static FieldMask Project(const std::vector<std::string> &names) {
+        return ProjectFields(names, {"id", "event_id", "type", "location", "participant_id", "payload"});
+    }
+
+    static MessageBuffer Write(const AMM::RenderModification &rendMod, const EventContext &ctx,
+                               FieldMask fields = allFields) {
+        // A render mod without data is sent as an empty element carrying its type
+        std::string rendModPayload;
+        std::string rendModType;
+        if (rendMod.data().empty()) {
+            rendModPayload = "<RenderModification type='" + rendMod.type() + "'/>";
+        } else {
+            rendModPayload = rendMod.data();
+            rendModType = rendMod.type();
+        }
+
+        FrameWriter w(128 + rendMod.id().id().size() + rendMod.event_id().id().size() + rendModType.size() +
+                      ctx.location.size() + ctx.participant.size() + rendModPayload.size());
+        w.Put("[AMM_Render_Modification]")
+                .Field(fields, 0, "id=", rendMod.id().id())
+                .Field(fields, 1, "event_id=", rendMod.event_id().id())
+                .Field(fields, 2, "type=", rendModType)
+                .Field(fields, 3, "location=", ctx.location)
+                .Field(fields, 4, "participant_id=", ctx.participant)
+                .Field(fields, 5, "payload=", rendModPayload, false)
+                .Put('\n');
+        return w.Take();
+    }
+};
+
+template<>
+struct Serializer<AMM::OperationalDescription> {
+    // The encoded schema is the bulk of the frame, so it stays in its own shared segment
+    static GatherMessage Write(const AMM::OperationalDescription &opD) {
+        FrameWriter w(256 + opD.name().size() + opD.description().size() + opD.manufacturer().size() +
+                      opD.model().size() + opD.serial_number().size() + opD.module_id().id().size() +
+                      opD.module_version().size() + opD.configuration_version().size() +
+                      opD.AMM_version().size());
+        w.Put("[AMM_OperationalDescription]")
+                .Put("name=").Put(opD.name()).Put(';')
+                .Put("description=").Put(opD.description()).Put(';')
+                .Put("manufacturer=").Put(opD.manufacturer()).Put(';')
+                .Put("model=").Put(opD.model()).Put(';')
+                .Put("serial_number=").Put(opD.serial_number()).Put(';')
+                .Put("module_id=").Put(opD.module_id().id()).Put(';')
+                .Put("module_version=").Put(opD.module_version()).Put(';')
+                .Put("configuration_version=").Put(opD.configuration_version()).Put(';')
+                .Put("AMM_version=").Put(opD.AMM_version()).Put(';')
+                .Put("capabilities_configuration=");
+
+        static const MessageBuffer newline = MakeMessageBuffer("\n");
+
+        GatherMessage message;
+        message.Append(w.Take());
+        message.Append(AMM::Utility::encode64(opD.capabilities_schema()));
+        message.Append(newline);
+        return message;
+    }
+};
+
+template<typename T, typename... Context>
+auto Serialize(const T &message, const Context &... context) -> decltype(Serializer<T>::Write(message, context...)) {
+    return Serializer<T>::Write(message, context...);
+}
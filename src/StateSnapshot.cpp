@@ -0,0 +1,290 @@
+#include "StateSnapshot.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+void PutLength(std::string &out, size_t length) {
+    uint32_t value = (uint32_t) length;
+    out.append((const char *) &value, sizeof(value));
+}
+
+void PutString(std::string &out, const std::string &text) {
+    PutLength(out, text.size());
+    out.append(text);
+}
+
+bool GetString(const char *&at, const char *end, std::string &text) {
+    uint32_t length;
+    if ((size_t) (end - at) < sizeof(length)) {
+        return false;
+    }
+    memcpy(&length, at, sizeof(length));
+    at += sizeof(length);
+    if ((size_t) (end - at) < length) {
+        return false;
+    }
+    text.assign(at, length);
+    at += length;
+    return true;
+}
+
+}
+
+StateSnapshot::~StateSnapshot() {
+    Unmap();
+}
+
+/*
+  Open():
+                A missing, foreign or damaged file is replaced by an empty
+                one; a damaged newest generation falls back to the other.
+*/
+bool StateSnapshot::Open(const std::string &file, Sections &restored) {
+    path = file;
+    if (Map() && header->magic == magic && header->version == version &&
+        mappedSize >= headerSize + 2 * header->slotSize) {
+        int newest = -1;
+        for (int i = 0; i < 2; i++) {
+            const Slot &slot = header->slots[i];
+            const char *data = mapped + headerSize + i * header->slotSize;
+            if (slot.generation == 0 || slot.length > header->slotSize ||
+                Checksum(data, slot.length) != slot.checksum) {
+                continue;
+            }
+            if (newest < 0 || slot.generation > header->slots[newest].generation) {
+                newest = i;
+            }
+        }
+        if (newest >= 0) {
+            const Slot &slot = header->slots[newest];
+            Sections loaded;
+            if (Decode(mapped + headerSize + newest * header->slotSize, slot.length, loaded)) {
+                restored = loaded;
+                generation = slot.generation;
+                live = newest;
+                std::lock_guard<std::mutex> lock(mutex);
+                sections = std::move(loaded);
+                for (auto &section : sections) {
+                    EncodeSection(section.first, section.second, encoded[section.first]);
+                }
+            }
+        }
+        enabled = true;
+        return true;
+    }
+
+    Unmap();
+    cerr << "No usable snapshot in " << path << ", starting a new one" << endl;
+    enabled = Recreate(initialSlotSize, "", 0);
+    return enabled;
+}
+
+void StateSnapshot::Put(const std::string &section, const std::string &key, const std::string &value) {
+    if (!enabled) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string &current = sections[section][key];
+    if (current != value) {
+        current = value;
+        dirty.insert(section);
+    }
+}
+
+void StateSnapshot::Replace(const std::string &section, Section values) {
+    if (!enabled) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    Section &current = sections[section];
+    if (current != values) {
+        current = std::move(values);
+        dirty.insert(section);
+    }
+}
+
+void StateSnapshot::Erase(const std::string &section, const std::string &key) {
+    if (!enabled) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = sections.find(section);
+    if (it != sections.end() && it->second.erase(key) > 0) {
+        dirty.insert(section);
+    }
+}
+
+bool StateSnapshot::Flush() {
+    if (!enabled || !header) {
+        return false;
+    }
+
+    std::string image;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (dirty.empty()) {
+            return true;
+        }
+        for (auto &name : dirty) {
+            EncodeSection(name, sections[name], encoded[name]);
+        }
+        dirty.clear();
+        for (auto &section : encoded) {
+            image += section.second;
+        }
+    }
+
+    if (!Write(image)) {
+        // Everything is written again next time
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto &section : sections) {
+            dirty.insert(section.first);
+        }
+        return false;
+    }
+    return true;
+}
+
+bool StateSnapshot::Write(const std::string &image) {
+    uint64_t next = generation + 1;
+    if (image.size() > header->slotSize) {
+        size_t slotSize = header->slotSize;
+        while (slotSize < image.size()) {
+            slotSize *= 2;
+        }
+        if (!Recreate(slotSize, image, next)) {
+            return false;
+        }
+        generation = next;
+        live = 0;
+        return true;
+    }
+
+    // Overwrite the other slot, the restored or last written generation stays intact meanwhile
+    int target = 1 - live;
+    char *data = mapped + headerSize + target * header->slotSize;
+    memcpy(data, image.data(), image.size());
+    if (msync(data, header->slotSize, MS_SYNC) < 0) {
+        cerr << "Snapshot sync failed: " << errno << endl;
+        return false;
+    }
+
+    Slot &slot = header->slots[target];
+    slot.length = image.size();
+    slot.checksum = Checksum(data, image.size());
+    slot.generation = next;
+    if (msync(mapped, headerSize, MS_SYNC) < 0) {
+        cerr << "Snapshot sync failed: " << errno << endl;
+        return false;
+    }
+    generation = next;
+    live = target;
+    return true;
+}
+
+void StateSnapshot::EncodeSection(const std::string &name, const Section &values, std::string &out) {
+    out.clear();
+    for (auto &value : values) {
+        PutString(out, name);
+        PutString(out, value.first);
+        PutString(out, value.second);
+    }
+}
+
+bool StateSnapshot::Decode(const char *data, size_t length, Sections &out) {
+    const char *at = data;
+    const char *end = data + length;
+    std::string section;
+    std::string key;
+    std::string value;
+    while (at < end) {
+        if (!GetString(at, end, section) || !GetString(at, end, key) || !GetString(at, end, value)) {
+            return false;
+        }
+        out[section][key] = value;
+    }
+    return true;
+}
+
+uint64_t StateSnapshot::Checksum(const char *data, size_t length) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char) data[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+bool StateSnapshot::Recreate(size_t slotSize, const std::string &image, uint64_t imageGeneration) {
+    std::string temporary = path + ".tmp";
+    int fd = open(temporary.c_str(), O_CREAT | O_TRUNC | O_RDWR | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        cerr << "Cannot create snapshot " << temporary << ": " << errno << endl;
+        return false;
+    }
+
+    std::string head(headerSize, '\0');
+    Header fresh{};
+    fresh.magic = magic;
+    fresh.version = version;
+    fresh.slotSize = slotSize;
+    if (!image.empty()) {
+        fresh.slots[0].generation = imageGeneration;
+        fresh.slots[0].length = image.size();
+        fresh.slots[0].checksum = Checksum(image.data(), image.size());
+    }
+    memcpy(&head[0], &fresh, sizeof(fresh));
+
+    bool ok = ftruncate(fd, headerSize + 2 * slotSize) == 0 &&
+              pwrite(fd, head.data(), head.size(), 0) == (ssize_t) head.size() &&
+              pwrite(fd, image.data(), image.size(), headerSize) == (ssize_t) image.size() &&
+              fsync(fd) == 0;
+    close(fd);
+    if (!ok || rename(temporary.c_str(), path.c_str()) < 0) {
+        cerr << "Cannot write snapshot " << path << ": " << errno << endl;
+        unlink(temporary.c_str());
+        return false;
+    }
+
+    Unmap();
+    return Map();
+}
+
+bool StateSnapshot::Map() {
+    int fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st{};
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size < headerSize) {
+        close(fd);
+        return false;
+    }
+    void *region = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (region == MAP_FAILED) {
+        return false;
+    }
+    mapped = static_cast<char *>(region);
+    mappedSize = st.st_size;
+    header = reinterpret_cast<Header *>(mapped);
+    return true;
+}
+
+void StateSnapshot::Unmap() {
+    if (mapped) {
+        munmap(mapped, mappedSize);
+    }
+    mapped = nullptr;
+    header = nullptr;
+    mappedSize = 0;
+}
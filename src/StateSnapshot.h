@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+
+/*
+  StateSnapshot:
+                Simulation state the bridge would otherwise lose on a
+                restart, kept as named sections of key/value pairs in a
+                memory-mapped file. Writers Put() values as they change;
+                Flush() re-encodes only the sections touched since the last
+                call and writes the result as a new generation.
+
+                The file holds two slots. A generation is written to the
+                slot not holding the newest one, synced, and only then
+                committed by updating that slot's descriptor (generation,
+                length, checksum) in the header. A crash at any point
+                leaves at least one slot whose checksum matches, and loading
+                takes the newest of those.
+*/
+class StateSnapshot {
+public:
+    typedef std::map<std::string, std::string> Section;
+    typedef std::map<std::string, Section> Sections;
+
+    StateSnapshot() = default;
+
+    ~StateSnapshot();
+
+    StateSnapshot(const StateSnapshot &) = delete;
+
+    StateSnapshot &operator=(const StateSnapshot &) = delete;
+
+    // Restores the newest intact generation, if any, and keeps the file for writing
+    bool Open(const std::string &path, Sections &restored);
+
+    bool Enabled() const {
+        return enabled;
+    }
+
+    void Put(const std::string &section, const std::string &key, const std::string &value);
+
+    void Replace(const std::string &section, Section values);
+
+    void Erase(const std::string &section, const std::string &key);
+
+    // Writes a new generation if anything changed; one caller at a time
+    bool Flush();
+
+    uint64_t Generation() const {
+        return generation;
+    }
+
+private:
+    static const uint32_t magic = 0x53534254; // "TBSS"
+    static const uint32_t version = 1;
+    static const size_t headerSize = 4096;
+    static const size_t initialSlotSize = 64 * 1024;
+
+    struct Slot {
+        uint64_t generation;
+        uint64_t length;
+        uint64_t checksum;
+    };
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t slotSize;
+        Slot slots[2];
+    };
+
+    bool Write(const std::string &image);
+
+    static void EncodeSection(const std::string &name, const Section &values, std::string &out);
+
+    static bool Decode(const char *data, size_t length, Sections &out);
+
+    static uint64_t Checksum(const char *data, size_t length);
+
+    // Replaces the file through a renamed temporary holding image in slot 0
+    bool Recreate(size_t slotSize, const std::string &image, uint64_t imageGeneration);
+
+    bool Map();
+
+    void Unmap();
+
+    std::string path;
+    bool enabled = false;
+    Header *header = nullptr;
+    char *mapped = nullptr;
+    size_t mappedSize = 0;
+    uint64_t generation = 0;
+    // Slot holding that generation; the next one is written to the other,
+    // even when a torn write left it with the higher descriptor
+    int live = 0;
+
+    // Guards the values and encodings, Put() never waits for a disk write
+    std::mutex mutex;
+    Sections sections;
+    std::map<std::string, std::string> encoded;
+    std::set<std::string> dirty;
+};
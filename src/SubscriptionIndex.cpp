@@ -0,0 +1,135 @@
+#include "SubscriptionIndex.h"
+
+#include <algorithm>
+#include <mutex>
+
+void SubscriptionIndex::Subscribe(ClientHandle client, TopicId topic) {
+    std::unique_lock<boost::shared_mutex> lock(mutex);
+    SubscribeLocked(client, topic);
+}
+
+void SubscriptionIndex::SubscribeLocked(ClientHandle client, TopicId topic) const {
+    std::vector<TopicId> &topics = byClient[client];
+    if (std::find(topics.begin(), topics.end(), topic) != topics.end()) {
+        return;
+    }
+    topics.push_back(topic);
+
+    if (byTopic.size() <= topic) {
+        byTopic.resize(topic + 1);
+    }
+    byTopic[topic].push_back(client);
+}
+
+void SubscriptionIndex::Clear(ClientHandle client) {
+    std::unique_lock<boost::shared_mutex> lock(mutex);
+    ClearLocked(client);
+}
+
+void SubscriptionIndex::Replace(ClientHandle client, const std::vector<TopicId> &topics,
+                                const std::vector<std::string> &patterns) {
+    std::unique_lock<boost::shared_mutex> lock(mutex);
+    ClearLocked(client);
+    byClient[client] = topics;
+    for (TopicId topic : topics) {
+        if (byTopic.size() <= topic) {
+            byTopic.resize(topic + 1);
+        }
+        byTopic[topic].push_back(client);
+    }
+
+    // Expand over the topics seen so far, later ones are picked up by Resolve()
+    for (auto &pattern : patterns) {
+        this->patterns.Add(pattern, client);
+        for (TopicId topic = 0; topic < resolved; topic++) {
+            if (TopicMatcher::Matches(pattern, TopicRegistry::Name(topic))) {
+                SubscribeLocked(client, topic);
+            }
+        }
+    }
+}
+
+void SubscriptionIndex::ClearLocked(ClientHandle client) {
+    patterns.Remove(client);
+
+    auto it = byClient.find(client);
+    if (it == byClient.end()) {
+        return;
+    }
+    for (TopicId topic : it->second) {
+        std::vector<ClientHandle> &subscribers = byTopic[topic];
+        subscribers.erase(std::remove(subscribers.begin(), subscribers.end(), client), subscribers.end());
+    }
+    byClient.erase(it);
+}
+
+/*
+  Resolve():
+                Runs once per newly interned topic, under the exclusive lock;
+                lookups of topics already resolved never get here.
+*/
+void SubscriptionIndex::Resolve() const {
+    std::unique_lock<boost::shared_mutex> lock(mutex);
+    TopicId known = (TopicId) TopicRegistry::Size();
+    for (; resolved < known; resolved++) {
+        for (auto &client : patterns.Match(TopicRegistry::Name(resolved))) {
+            SubscribeLocked(client, resolved);
+        }
+    }
+}
+
+bool SubscriptionIndex::IsSubscribed(ClientHandle client, TopicId topic) const {
+    boost::shared_lock<boost::shared_mutex> lock(mutex);
+    if (!Resolved(topic)) {
+        lock.unlock();
+        Resolve();
+        lock.lock();
+    }
+
+    auto it = byClient.find(client);
+    return it != byClient.end() && std::find(it->second.begin(), it->second.end(), topic) != it->second.end();
+}
+
+void SubscriptionIndex::Subscribers(TopicId topic, std::vector<ClientHandle> &subscribers) const {
+    subscribers.clear();
+    boost::shared_lock<boost::shared_mutex> lock(mutex);
+    if (!Resolved(topic)) {
+        lock.unlock();
+        Resolve();
+        lock.lock();
+    }
+
+    if (topic < byTopic.size()) {
+        subscribers.assign(byTopic[topic].begin(), byTopic[topic].end());
+    }
+}
+
+/*
+  SubscribersOfAny():
+                Clients subscribed to at least one of the topics, each listed
+                once.
+*/
+void SubscriptionIndex::SubscribersOfAny(const std::vector<TopicId> &topics,
+                                         std::vector<ClientHandle> &subscribers) const {
+    subscribers.clear();
+    boost::shared_lock<boost::shared_mutex> lock(mutex);
+    for (TopicId topic : topics) {
+        if (!Resolved(topic)) {
+            lock.unlock();
+            Resolve();
+            lock.lock();
+            break;
+        }
+    }
+
+    for (TopicId topic : topics) {
+        if (topic >= byTopic.size()) {
+            continue;
+        }
+        for (auto &client : byTopic[topic]) {
+            if (std::find(subscribers.begin(), subscribers.end(), client) == subscribers.end()) {
+                subscribers.push_back(client);
+            }
+        }
+    }
+}
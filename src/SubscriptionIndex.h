@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/thread/shared_mutex.hpp>
+
+#include "Net/ClientHandle.h"
+#include "TopicMatcher.h"
+#include "TopicRegistry.h"
+
+/*
+  SubscriptionIndex:
+                Which clients are subscribed to which topics, kept in both
+                directions. Listeners ask for the subscribers of a topic id
+                instead of scanning every client's topic list. Wildcard
+                subscriptions are expanded into the same index: against the
+                known topics when they are made, and against each new topic
+                the first time it is looked up. Clients are keyed by handle,
+                so a lookup copies and compares no strings.
+*/
+class SubscriptionIndex {
+public:
+    void Subscribe(ClientHandle client, TopicId topic);
+
+    void Clear(ClientHandle client);
+
+    // Swaps in a client's whole subscription set under one lock; topics must be distinct
+    void Replace(ClientHandle client, const std::vector<TopicId> &topics,
+                 const std::vector<std::string> &patterns = {});
+
+    bool IsSubscribed(ClientHandle client, TopicId topic) const;
+
+    // Replaces the contents of subscribers; pass a reused vector to keep
+    // lookups free of allocations
+    void Subscribers(TopicId topic, std::vector<ClientHandle> &subscribers) const;
+
+    void SubscribersOfAny(const std::vector<TopicId> &topics, std::vector<ClientHandle> &subscribers) const;
+
+private:
+    void SubscribeLocked(ClientHandle client, TopicId topic) const;
+
+    void ClearLocked(ClientHandle client);
+
+    // Matches every topic interned since the last call against the patterns
+    void Resolve() const;
+
+    // Called with the shared lock held
+    bool Resolved(TopicId topic) const {
+        return topic < resolved;
+    }
+
+    // Mutable because lookups expand wildcards into them; the subscription
+    // set they describe does not change
+    mutable std::unordered_map<ClientHandle, std::vector<TopicId>> byClient;
+    // Indexed by TopicId
+    mutable std::vector<std::vector<ClientHandle>> byTopic;
+    TopicMatcher patterns;
+    // Topics below this id have been matched against every pattern
+    mutable TopicId resolved = 0;
+    mutable boost::shared_mutex mutex;
+};
@@ -1,6 +1,12 @@
 #include <algorithm>
+#include <deque>
 #include <fstream>
+#include <functional>
 #include <map>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <boost/algorithm/string.hpp>
 #include <boost/archive/iterators/base64_from_binary.hpp>
@@ -16,9 +22,38 @@
 #include <boost/asio.hpp>
 #include <boost/thread.hpp>
 
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Net/AdmissionControl.h"
 #include "Net/Client.h"
+#include "Net/Compression.h"
+#include "Net/LatencyTrace.h"
+#include "Net/LowLatency.h"
+#include "Net/MulticastSender.h"
+#include "Net/ConnectionMonitor.h"
 #include "Net/Server.h"
+#include "Net/ShmRing.h"
 #include "Net/UdpDiscoveryServer.h"
+#include "Net/ZeroCopySender.h"
+
+#include "AsyncLogSink.h"
+#include "CapabilityCache.h"
+#include "ClientSet.h"
+#include "DurationStat.h"
+#include "EventFilterIndex.h"
+#include "ProjectionIndex.h"
+#include "PublishQueue.h"
+#include "Serializers.h"
+#include "StateSnapshot.h"
+#include "SubscriptionIndex.h"
+#include "TopicDemand.h"
+#include "TopicMatcher.h"
+#include "TopicRegistry.h"
+#include "WorkerLoad.h"
+#include "WorkerPool.h"
 
 #include "amm_std.h"
 
@@ -44,6 +79,13 @@ int bridgePort = 9015;
 int daemonize = 1;
 int discovery = 1;
 
+Server::Backend networkBackend = Server::Backend::Threads;
+
+// Extra AF_UNIX listener for modules on this host, empty when disabled
+std::string unixSocketPath;
+// Browser dashboards connect here by WebSocket, 0 when disabled
+int webSocketPort = 0;
+
 std::map <std::string, std::string> globalInboundBuffer;
 
 const string capabilityPrefix = "CAPABILITY=";
@@ -54,6 +96,10 @@ const string modulePrefix = "MODULE_NAME=";
 const string registerPrefix = "REGISTER=";
 const string requestPrefix = "REQUEST=";
 const string keepHistoryPrefix = "KEEP_HISTORY=";
+const string compressionPrefix = "COMPRESSION=";
+const string shmRingPrefix = "SHM_RING=";
+const string multicastPrefix = "MULTICAST=";
+const string errorPrefix = "ERROR=";
 const string actionPrefix = "ACT=";
 const string genericTopicPrefix = "[";
 const string keepAlivePrefix = "[KEEPALIVE]";
@@ -68,21 +114,89 @@ std::string currentScenario = "NONE";
 std::string currentState = "NONE";
 std::string currentStatus = "NOT RUNNING";
 bool isPaused = false;
-string encodedConfig = "";
+
+const MessageBuffer configPrefixBuffer = MakeMessageBuffer(configPrefix);
+const MessageBuffer newlineBuffer = MakeMessageBuffer("\n");
 
 bool closed = false;
 
-std::map <std::string, std::vector<std::string>> subscribedTopics;
-std::map <std::string, std::vector<std::string>> publishedTopics;
+// DDS writes for messages read from clients, off the read path
+PublishQueue publishQueue(4096);
+
+// CAPABILITY, SETTINGS and STATUS documents are parsed here, in order per client
+WorkerPool xmlWorkers(2, 1024);
+DurationStat xmlParseTime;
+CapabilityCache capabilityCache(256);
+
+// Work a client sent that found its queue full, oldest first, for sessions
+// that may not wait. Each post never waits when passed false.
+typedef std::function<bool(bool wait)> SessionPost;
+std::mutex heldMutex;
+std::deque <std::pair<ClientHandle, SessionPost>> heldPosts;
+std::unordered_map <ClientHandle, size_t> heldCounts;
+
+// Guards the routing state below when parsed documents are applied
+std::mutex routingMutex;
+
+SubscriptionIndex subscriptions;
+EventFilterIndex eventFilters;
+ProjectionIndex projections;
+
+// Waveform samples are only read from DDS while some client wants an HF_ topic
+TopicDemand waveformDemand("HF_");
+std::map <std::string, std::vector<TopicId>> publishedTopics;
+
+// Waveforms for clients on this host that asked to read them from shared
+// memory. Only the waveform listener writes the ring.
+ShmRing waveformRing;
+std::string waveformRingName;
+size_t waveformRingSize = 4 * 1024 * 1024;
+ClientSet ringClients;
+
+// Waveforms for clients on the LAN that joined the multicast groups instead
+std::string multicastGroup;
+uint16_t multicastPort = 9016;
+int multicastGroups = 1;
+int multicastTtl = 1;
+std::string multicastInterface;
+// Longest a waveform frame waits for others to share its datagram
+std::chrono::milliseconds multicastFlush(10);
+MulticastSender waveformMulticast;
+ClientSet multicastClients;
+
+// With -reuseport, the load of every worker on the port, for discovery answers
+WorkerLoad workerLoad;
+
+const TopicId physiologyModificationTopic = TopicRegistry::Intern("AMM_Physiology_Modification");
+const TopicId renderModificationTopic = TopicRegistry::Intern("AMM_Render_Modification");
+const TopicId eventRecordTopic = TopicRegistry::Intern("AMM_EventRecord");
+const TopicId assessmentTopic = TopicRegistry::Intern("AMM_Assessment");
+const TopicId operationalDescriptionTopic = TopicRegistry::Intern("AMM_OperationalDescription");
+const TopicId bloodPHModTopic = TopicRegistry::Intern("BloodChemistry_BloodPH_MOD");
 
 
 double BloodChemistry_BloodPH_val = 0.0f;
 std::map <std::string, std::map<std::string, double>> labNodes;
+// Every lab sheet entry for a topic, indexed by TopicId
+std::vector <std::vector<double *>> labSlots;
 std::map <std::string, std::map<std::string, std::string>> equipmentSettings;
 std::map <std::string, std::string> clientMap;
 std::map <std::string, std::string> clientTypeMap;
 std::map <std::string, AMM::EventRecord> eventRecords;
 
+// Status, lab sheets, settings and event records survive a restart here
+StateSnapshot snapshot;
+std::string snapshotPath;
+std::chrono::milliseconds snapshotInterval(1000);
+std::vector <std::pair<std::string, double *>> snapshotLabs;
+std::atomic<bool> labsChanged(false);
+// Only the newest event records are snapshotted, ordered by sequence number
+size_t snapshotEventLimit = 1000;
+std::mutex snapshotEventsMutex;
+uint64_t snapshotEventSeq = 0;
+std::map <uint64_t, std::string> snapshotEventOrder;
+std::map <std::string, uint64_t> snapshotEventIds;
+
 void InitializeLabNodes() {
     //
     labNodes["ALL"]["Substance_Sodium"] = 0.0f;
@@ -168,30 +282,210 @@ void InitializeLabNodes() {
     labNodes["CMP"]["MetabolicPanel_Protein"] = 0.0f;
 }
 
-void sendConfig(Client *c, std::string scene, std::string clientType) {
+GatherMessage BuildConfigMessage(std::string const &scene, std::string const &clientType) {
     ostringstream static_filename;
     static_filename << "static/module_configuration_static/" << scene << "_"
                     << clientType << "_configuration.xml";
-    LOG_DEBUG << "Sending " << static_filename.str() << " to " << c->id;
     std::ifstream ifs(static_filename.str());
     std::string configContent((std::istreambuf_iterator<char>(ifs)),
                               (std::istreambuf_iterator<char>()));
-    std::string encodedConfigContent = Utility::encode64(configContent);
-    encodedConfig = configPrefix + encodedConfigContent + "\n";
 
-    Server::SendToClient(c, encodedConfig);
+    GatherMessage config;
+    config.Append(configPrefixBuffer);
+    config.Append(Utility::encode64(configContent));
+    config.Append(newlineBuffer);
+    return config;
+}
+
+/*
+  Points each topic at its entries in the lab sheets, so a new value is
+  stored without searching every sheet by name.
+*/
+void IndexLabNodes() {
+    labSlots.clear();
+    for (auto &sheet : labNodes) {
+        for (auto &node : sheet.second) {
+            TopicId topic = TopicRegistry::Intern(node.first);
+            if (labSlots.size() <= topic) {
+                labSlots.resize(topic + 1);
+            }
+            labSlots[topic].push_back(&node.second);
+        }
+    }
+}
+
+void SnapshotStatus() {
+    snapshot.Put("status", "status", currentStatus);
+    snapshot.Put("status", "scenario", currentScenario);
+    snapshot.Put("status", "state", currentState);
+    snapshot.Put("status", "paused", isPaused ? "1" : "0");
+}
+
+/*
+  Keeps the order of a snapshotted event record; the oldest beyond
+  snapshotEventLimit leaves the snapshot. Called with snapshotEventsMutex held.
+*/
+void TrackSnapshotEvent(const std::string &id, uint64_t seq) {
+    auto known = snapshotEventIds.find(id);
+    if (known != snapshotEventIds.end()) {
+        snapshotEventOrder.erase(known->second);
+    }
+    snapshotEventIds[id] = seq;
+    snapshotEventOrder[seq] = id;
+    while (snapshotEventOrder.size() > snapshotEventLimit) {
+        auto oldest = snapshotEventOrder.begin();
+        snapshot.Erase("events", oldest->second);
+        snapshotEventIds.erase(oldest->second);
+        snapshotEventOrder.erase(oldest);
+    }
+}
+
+// Called with snapshotEventsMutex held
+void PutSnapshotEvent(const AMM::EventRecord &er) {
+    uint64_t seq = ++snapshotEventSeq;
+    snapshot.Put("events", er.id().id(), er.type() + '\x1f' + er.location().name() + '\x1f' +
+                                         er.agent_id().id() + '\x1f' + std::to_string(seq));
+    TrackSnapshotEvent(er.id().id(), seq);
+}
+
+void SnapshotEventRecord(const AMM::EventRecord &er) {
+    if (!snapshot.Enabled()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(snapshotEventsMutex);
+    PutSnapshotEvent(er);
+}
+
+// A reset scenario starts without event records
+void ClearSnapshotEvents() {
+    std::lock_guard<std::mutex> lock(snapshotEventsMutex);
+    snapshot.Replace("events", StateSnapshot::Section());
+    snapshotEventOrder.clear();
+    snapshotEventIds.clear();
+}
+
+/*
+  Reads the lab values through pointers taken once at startup, so the
+  snapshot thread never walks labNodes while a request may add a sheet.
+*/
+StateSnapshot::Section SnapshotLabValues() {
+    StateSnapshot::Section values;
+    char text[32];
+    for (auto &lab : snapshotLabs) {
+        snprintf(text, sizeof(text), "%.17g", *lab.second);
+        values[lab.first] = text;
+    }
+    return values;
+}
+
+/*
+  RestoreSnapshot():
+                Loads the last snapshot into the globals before any session
+                or DDS reader exists, so STATUS and LABS requests are answered
+                from it at once. Lab entries the sheets no longer have are
+                ignored. Event records from before sequence numbers were kept
+                count as the oldest.
+*/
+void RestoreSnapshot() {
+    for (auto &sheet : labNodes) {
+        for (auto &node : sheet.second) {
+            snapshotLabs.emplace_back(sheet.first + "\t" + node.first, &node.second);
+        }
+    }
+
+    StateSnapshot::Sections restored;
+    if (!snapshot.Open(snapshotPath, restored)) {
+        LOG_WARNING << "State snapshots disabled, cannot open " << snapshotPath;
+        return;
+    }
+    if (restored.empty()) {
+        return;
+    }
+
+    StateSnapshot::Section &status = restored["status"];
+    if (!status.empty()) {
+        currentStatus = status["status"];
+        currentScenario = status["scenario"];
+        currentState = status["state"];
+        isPaused = status["paused"] == "1";
+    }
+
+    for (auto &value : restored["labs"]) {
+        size_t tab = value.first.find('\t');
+        auto sheet = labNodes.find(value.first.substr(0, tab));
+        if (tab == std::string::npos || sheet == labNodes.end()) {
+            continue;
+        }
+        auto node = sheet->second.find(value.first.substr(tab + 1));
+        if (node != sheet->second.end()) {
+            node->second = std::strtod(value.second.c_str(), nullptr);
+        }
+    }
+
+    for (auto &setting : restored["settings"]) {
+        size_t tab = setting.first.find('\t');
+        if (tab != std::string::npos) {
+            equipmentSettings[setting.first.substr(0, tab)][setting.first.substr(tab + 1)] = setting.second;
+        }
+    }
+
+    // Oldest first, then renumbered from 1 so the file and the order agree
+    std::vector <std::pair<uint64_t, std::string>> eventOrder;
+    for (auto &event : restored["events"]) {
+        std::vector<std::string> fields;
+        boost::split(fields, event.second, boost::is_any_of("\x1f"));
+        if (fields.size() != 3 && fields.size() != 4) {
+            continue;
+        }
+        uint64_t seq = fields.size() == 4 ? std::strtoull(fields[3].c_str(), nullptr, 10) : 0;
+        eventOrder.emplace_back(seq, event.first);
+
+        AMM::UUID erID;
+        erID.id(event.first);
+
+        FMA_Location fma;
+        fma.name(fields[1]);
+
+        AMM::UUID agentID;
+        agentID.id(fields[2]);
+
+        AMM::EventRecord er;
+        er.id(erID);
+        er.location(fma);
+        er.agent_id(agentID);
+        er.type(fields[0]);
+        eventRecords[event.first] = er;
+    }
+
+    std::stable_sort(eventOrder.begin(), eventOrder.end(),
+                     [](const std::pair<uint64_t, std::string> &a, const std::pair<uint64_t, std::string> &b) {
+                         return a.first < b.first;
+                     });
+    {
+        std::lock_guard<std::mutex> lock(snapshotEventsMutex);
+        for (auto &event : eventOrder) {
+            PutSnapshotEvent(eventRecords[event.second]);
+        }
+    }
+
+    LOG_INFO << "Restored snapshot generation " << snapshot.Generation() << " from " << snapshotPath << ": "
+             << currentStatus << ", scenario " << currentScenario << ", " << eventRecords.size() << " event records";
 }
 
 void sendConfigToAll(std::string scene) {
-    auto it = clientMap.begin();
-    while (it != clientMap.end()) {
-        std::string cid = it->first;
-        std::string clientType = clientTypeMap[it->first];
-        Client *c = Server::GetClientByIndex(cid);
-        if (c) {
-            sendConfig(c, scene, clientType);
+    // Clients of the same type get the same file, so encode it once and share it
+    std::map<std::string, std::vector<std::string>> recipients;
+    {
+        std::lock_guard<std::mutex> lock(routingMutex);
+        for (auto &client : clientMap) {
+            recipients[clientTypeMap[client.first]].push_back(client.first);
         }
-        ++it;
+    }
+
+    for (auto &group : recipients) {
+        LOG_DEBUG << "Sending " << scene << "_" << group.first << " configuration to "
+                  << group.second.size() << " clients";
+        Server::SendToClients(group.second, BuildConfigMessage(scene, group.first));
     }
 }
 
@@ -203,6 +497,11 @@ AMM::DDSManager <TCPBridgeListener> *mgr = new AMM::DDSManager<TCPBridgeListener
 AMM::UUID m_uuid;
 
 
+// System-clock nanoseconds at which the DDS writer stamped the sample, 0 if unknown
+int64_t SourceTimestamp(SampleInfo_t *info) {
+    return info ? info->sourceTimestamp.to_ns() : 0;
+}
+
 /**
  * FastRTPS/DDS Listener for subscriptions
  */
@@ -211,228 +510,157 @@ public:
 
     /// Event handler for incoming Physiology Waveform data.
     void onNewPhysiologyWaveform(AMM::PhysiologyWaveform &n, SampleInfo_t *info) {
-        ;
-        std::string hfname = "HF_" + n.name();
-        auto it = clientMap.begin();
-        while (it != clientMap.end()) {
-            std::string cid = it->first;
-            std::vector <std::string> subV = subscribedTopics[cid];
-            if (std::find(subV.begin(), subV.end(), hfname) != subV.end()) {
-                Client *c = Server::GetClientByIndex(cid);
-                if (c) {
-                    std::ostringstream messageOut;
-                    messageOut << n.name() << "=" << n.value() << "|" << std::endl;
-                    string stringOut = messageOut.str();
-                    Server::SendToClient(c, messageOut.str());
-                }
-            }
-            ++it;
+        // The middleware's receive threads are shared by every reader, the
+        // telemetry ones see them first
+        LowLatency::PinDdsThread();
+        if (!waveformDemand.Active()) {
+            return;
+        }
+        LatencySpanPtr span = LatencyTrace::Begin(n.name(), SourceTimestamp(info));
+        std::vector<ClientHandle> &subscribers = Recipients();
+        subscriptions.Subscribers(WaveformTopic(n.name()), subscribers);
+        if (subscribers.empty()) {
+            return;
+        }
+        MessageBuffer frame = Serialize(n);
+        LatencyTrace::Stamp(span.get(), LatencySpan::Formatted);
+        if (ringClients.Take(subscribers)) {
+            waveformRing.Write(frame->data(), frame->size());
+        }
+        if (multicastClients.Take(subscribers)) {
+            waveformMulticast.Send(n.name(), frame->data(), frame->size());
         }
+        if (subscribers.empty()) {
+            return;
+        }
+        GatherMessage message(frame);
+        message.SetTrace(span);
+        Server::SendToClients(subscribers, message, SendPriority::Telemetry);
     }
 
     void onNewPhysiologyValue(AMM::PhysiologyValue &n, SampleInfo_t *info) {
+        LowLatency::PinDdsThread();
+        LatencySpanPtr span = LatencyTrace::Begin(n.name(), SourceTimestamp(info));
+        TopicId topic = TopicRegistry::Intern(n.name());
+
         // Drop values into the lab sheets
-        for (auto &outer_map_pair : labNodes) {
-            if (labNodes[outer_map_pair.first].find(n.name()) !=
-                labNodes[outer_map_pair.first].end()) {
-                labNodes[outer_map_pair.first][n.name()] = n.value();
+        if (topic < labSlots.size() && !labSlots[topic].empty()) {
+            for (double *slot : labSlots[topic]) {
+                *slot = n.value();
             }
+            labsChanged.store(true, std::memory_order_relaxed);
         }
 
-        if (n.name().compare("BloodChemistry_BloodPH_MOD") == 0) {
+        if (topic == bloodPHModTopic) {
             BloodChemistry_BloodPH_val = n.value();
         }
 
-        auto it = clientMap.begin();
-        while (it != clientMap.end()) {
-            std::string cid = it->first;
-            std::vector <std::string> subV = subscribedTopics[cid];
-
-            if (std::find(subV.begin(), subV.end(), n.name()) != subV.end()) {
-                Client *c = Server::GetClientByIndex(cid);
-                if (c) {
-                    std::ostringstream messageOut;
-                    messageOut << n.name() << "=" << n.value() << "|" << std::endl;
-                    Server::SendToClient(c, messageOut.str());
-                }
-            }
-            ++it;
+        std::vector<ClientHandle> &subscribers = Recipients();
+        subscriptions.Subscribers(topic, subscribers);
+        if (subscribers.empty()) {
+            return;
         }
+        GatherMessage message(Serialize(n));
+        LatencyTrace::Stamp(span.get(), LatencySpan::Formatted);
+        message.SetTrace(span);
+        Server::SendToClients(subscribers, message, SendPriority::Telemetry);
     }
 
     void onNewPhysiologyModification(AMM::PhysiologyModification &pm, SampleInfo_t *info) {
-        std::string location;
-        std::string practitioner;
+        EventContext ctx;
 
         if (eventRecords.count(pm.event_id().id()) > 0) {
             AMM::EventRecord er = eventRecords[pm.event_id().id()];
-            location = er.location().name();
-            practitioner = er.agent_id().id();
+            ctx.location = er.location().name();
+            ctx.participant = er.agent_id().id();
         }
 
-        std::ostringstream messageOut;
-        messageOut << "[AMM_Physiology_Modification]"
-                   << "id=" << pm.id().id() << ";"
-                   << "event_id=" << pm.event_id().id() << ";"
-                   << "type=" << pm.type() << ";"
-                   << "location=" << location << ";"
-                   << "participant_id=" << practitioner << ";"
-                   << "payload=" << pm.data()
-                   << std::endl;
-        string stringOut = messageOut.str();
-
-        LOG_DEBUG << "Received a phys mod via DDS, republishing to TCP clients: " << stringOut;
-
-        auto it = clientMap.begin();
-        while (it != clientMap.end()) {
-            std::string cid = it->first;
-            std::vector <std::string> subV = subscribedTopics[cid];
-
-            if (std::find(subV.begin(), subV.end(), pm.type()) != subV.end() ||
-                std::find(subV.begin(), subV.end(), "AMM_Physiology_Modification") !=
-                subV.end()) {
-                Client *c = Server::GetClientByIndex(cid);
-                if (c) {
-                    Server::SendToClient(c, stringOut);
-                }
-            }
-            ++it;
+        // Interned, like value names, so a type first seen here is still
+        // matched against wildcard subscriptions
+        std::vector<TopicId> topics = {physiologyModificationTopic};
+        if (!pm.type().empty()) {
+            topics.push_back(TopicRegistry::Intern(pm.type()));
+        }
+        std::vector<ClientHandle> &recipients = Recipients();
+        subscriptions.SubscribersOfAny(topics, recipients);
+        eventFilters.AddMatches(topics, pm.type(), ctx.location, ctx.participant, recipients);
+
+        for (auto &group : projections.Group(physiologyModificationTopic, recipients)) {
+            MessageBuffer stringOut = Serialize(pm, ctx, group.first);
+
+            HOT_LOG_DEBUG << "Received a phys mod via DDS, republishing to TCP clients: " << *stringOut;
+
+            Server::SendToClients(group.second, GatherMessage(stringOut));
         }
     }
 
     void onNewEventRecord(AMM::EventRecord &er, SampleInfo_t *info) {
-        std::string location;
-        std::string practitioner;
-        std::string eType;
-        std::string eData;
-        std::string pType;
-
-        LOG_DEBUG << "Received an event record of type " << er.type()
+        HOT_LOG_DEBUG << "Received an event record of type " << er.type()
                   << " on DDS bus, so we're storing it in a simple map.";
         eventRecords[er.id().id()] = er;
-        location = er.location().name();
-        practitioner = er.agent_id().id();
-        eType = er.type();
-        eData = er.data();
-        pType = AMM::Utility::EEventAgentTypeStr(er.agent_type());
+        SnapshotEventRecord(er);
 
-        std::ostringstream messageOut;
+        std::vector<ClientHandle> &recipients = Recipients();
+        subscriptions.Subscribers(eventRecordTopic, recipients);
+        eventFilters.AddMatches({eventRecordTopic}, er.type(), er.location().name(), er.agent_id().id(), recipients);
 
-        messageOut << "[AMM_EventRecord]"
-                   << "id=" << er.id().id() << ";"
-                   << "type=" << eType << ";"
-                   << "location=" << location << ";"
-                   << "participant_id=" << practitioner << ";"
-                   << "participant_type=" << pType << ";"
-                   << "data=" << eData << ";"
-                   << std::endl;
-        string stringOut = messageOut.str();
-
-        LOG_DEBUG << "Received an EventRecord via DDS, republishing to TCP clients: " << stringOut;
-
-        auto it = clientMap.begin();
-        while (it != clientMap.end()) {
-            std::string cid = it->first;
-            std::vector <std::string> subV = subscribedTopics[cid];
-            if (std::find(subV.begin(), subV.end(), "AMM_EventRecord") != subV.end()) {
-                Client *c = Server::GetClientByIndex(cid);
-                if (c) {
-                    Server::SendToClient(c, stringOut);
-                }
-            }
-            ++it;
+        for (auto &group : projections.Group(eventRecordTopic, recipients)) {
+            MessageBuffer stringOut = Serialize(er, group.first);
+
+            HOT_LOG_DEBUG << "Received an EventRecord via DDS, republishing to TCP clients: " << *stringOut;
+
+            Server::SendToClients(group.second, GatherMessage(stringOut));
         }
     }
 
     void onNewAssessment(AMM::Assessment &a, eprosima::fastrtps::SampleInfo_t *info) {
-        std::string location;
-        std::string practitioner;
-        std::string eType;
+        EventContext ctx;
 
-        LOG_INFO << "Assessment received on DDS bus";
+        HOT_LOG_DEBUG << "Assessment received on DDS bus";
         if (eventRecords.count(a.event_id().id()) > 0) {
             AMM::EventRecord er = eventRecords[a.event_id().id()];
-            location = er.location().name();
-            practitioner = er.agent_id().id();
-            eType = er.type();
+            ctx.location = er.location().name();
+            ctx.participant = er.agent_id().id();
+            ctx.type = er.type();
         }
 
-        std::ostringstream messageOut;
+        std::vector<ClientHandle> &recipients = Recipients();
+        subscriptions.Subscribers(assessmentTopic, recipients);
+        eventFilters.AddMatches({assessmentTopic}, ctx.type, ctx.location, ctx.participant, recipients);
 
-        messageOut << "[AMM_Assessment]"
-                   << "id=" << a.id().id() << ";"
-                   << "event_id=" << a.event_id().id() << ";"
-                   << "type=" << eType << ";"
-                   << "location=" << location << ";"
-                   << "participant_id=" << practitioner << ";"
-                   << "value=" << AMM::Utility::EAssessmentValueStr(a.value()) << ";"
-                   << "comment=" << a.comment()
-                   << std::endl;
-        string stringOut = messageOut.str();
-
-        LOG_DEBUG << "Received an assessment via DDS, republishing to TCP clients: " << stringOut;
-
-        auto it = clientMap.begin();
-        while (it != clientMap.end()) {
-            std::string cid = it->first;
-            std::vector <std::string> subV = subscribedTopics[cid];
-            if (std::find(subV.begin(), subV.end(), "AMM_Assessment") != subV.end()) {
-                Client *c = Server::GetClientByIndex(cid);
-                if (c) {
-                    Server::SendToClient(c, stringOut);
-                }
-            }
-            ++it;
+        for (auto &group : projections.Group(assessmentTopic, recipients)) {
+            MessageBuffer stringOut = Serialize(a, ctx, group.first);
+
+            HOT_LOG_DEBUG << "Received an assessment via DDS, republishing to TCP clients: " << *stringOut;
+
+            Server::SendToClients(group.second, GatherMessage(stringOut));
         }
     }
 
     void onNewRenderModification(AMM::RenderModification &rendMod, SampleInfo_t *info) {
-        std::string location;
-        std::string practitioner;
+        EventContext ctx;
 
-        LOG_INFO << "Render mod received on DDS bus";
+        HOT_LOG_DEBUG << "Render mod received on DDS bus";
         if (eventRecords.count(rendMod.event_id().id()) > 0) {
             AMM::EventRecord er = eventRecords[rendMod.event_id().id()];
-            location = er.location().name();
-            practitioner = er.agent_id().id();
+            ctx.location = er.location().name();
+            ctx.participant = er.agent_id().id();
         }
 
-        std::ostringstream messageOut;
-        std::string rendModPayload;
-        std::string rendModType;
-        if (rendMod.data().empty()) {
-            rendModPayload = "<RenderModification type='" + rendMod.type() + "'/>";
-            rendModType = "";
-        } else {
-            rendModPayload = rendMod.data();
-            rendModType = rendMod.type();
-        }
-        messageOut << "[AMM_Render_Modification]"
-                   << "id=" << rendMod.id().id() << ";"
-                   << "event_id=" << rendMod.event_id().id() << ";"
-                   << "type=" << rendModType << ";"
-                   << "location=" << location << ";"
-                   << "participant_id=" << practitioner << ";"
-                   // << "payload=" << rendMod.data()
-                   << "payload=" << rendModPayload
-                   << std::endl;
-        string stringOut = messageOut.str();
-
-        LOG_DEBUG << "Received a render mod via DDS, republishing to TCP clients: " << stringOut;
-
-        auto it = clientMap.begin();
-        while (it != clientMap.end()) {
-            std::string cid = it->first;
-            std::vector <std::string> subV = subscribedTopics[cid];
-            if (std::find(subV.begin(), subV.end(), rendMod.type()) != subV.end() ||
-                std::find(subV.begin(), subV.end(), "AMM_Render_Modification") !=
-                subV.end()) {
-                Client *c = Server::GetClientByIndex(cid);
-                if (c) {
-                    Server::SendToClient(c, stringOut);
-                }
-            }
-            ++it;
+        std::vector<TopicId> topics = {renderModificationTopic};
+        if (!rendMod.type().empty()) {
+            topics.push_back(TopicRegistry::Intern(rendMod.type()));
+        }
+        std::vector<ClientHandle> &recipients = Recipients();
+        subscriptions.SubscribersOfAny(topics, recipients);
+        eventFilters.AddMatches(topics, rendMod.type(), ctx.location, ctx.participant, recipients);
+
+        for (auto &group : projections.Group(renderModificationTopic, recipients)) {
+            MessageBuffer stringOut = Serialize(rendMod, ctx, group.first);
+
+            HOT_LOG_DEBUG << "Received a render mod via DDS, republishing to TCP clients: " << *stringOut;
+
+            Server::SendToClients(group.second, GatherMessage(stringOut));
         }
     }
 
@@ -464,6 +692,7 @@ public:
             case AMM::ControlType::RESET: {
                 currentStatus = "NOT RUNNING";
                 isPaused = false;
+                ClearSnapshotEvents();
                 LOG_INFO << "Message recieved; Reset sim";
                 std::string tmsg = "ACT=RESET_SIM\n";
                 s->SendToAll(tmsg);
@@ -476,6 +705,7 @@ public:
                 break;
             }
         }
+        SnapshotStatus();
     }
 
     void onNewOperationalDescription(AMM::OperationalDescription &opD, SampleInfo_t *info) {
@@ -483,37 +713,14 @@ public:
 
         // [AMM_OperationalDescription]name=;description=;manufacturer=;model=;serial_number=;module_id=;module_version=;configuration_version=;AMM_version=;capabilities_configuration=(BASE64 ENCODED STRING - URLSAFE)
 
-        std::ostringstream messageOut;
-        std::string capabilities = Utility::encode64(opD.capabilities_schema());
-
-        messageOut << "[AMM_OperationalDescription]"
-                   << "name=" << opD.name() << ";"
-                   << "description=" << opD.description() << ";"
-                   << "manufacturer=" << opD.manufacturer() << ";"
-                   << "model=" << opD.model() << ";"
-                   << "serial_number=" << opD.serial_number() << ";"
-                   << "module_id=" << opD.module_id().id() << ";"
-                   << "module_version=" << opD.module_version() << ";"
-                   << "configuration_version=" << opD.configuration_version() << ";"
-                   << "AMM_version=" << opD.AMM_version() << ";"
-                   << "capabilities_configuration=" << capabilities
-                   << std::endl;
-        string stringOut = messageOut.str();
-
-        LOG_DEBUG << "Received an Operational Description via DDS, republishing to TCP clients: " << stringOut;
-
-        auto it = clientMap.begin();
-        while (it != clientMap.end()) {
-            std::string cid = it->first;
-            std::vector <std::string> subV = subscribedTopics[cid];
-            if (std::find(subV.begin(), subV.end(), "AMM_OperationalDescription") != subV.end()) {
-                Client *c = Server::GetClientByIndex(cid);
-                if (c) {
-                    Server::SendToClient(c, stringOut);
-                }
-            }
-            ++it;
-        }
+        GatherMessage stringOut = Serialize(opD);
+
+        HOT_LOG_DEBUG << "Received an Operational Description via DDS, republishing " << stringOut.Size()
+                  << " bytes to TCP clients";
+
+        std::vector<ClientHandle> &recipients = Recipients();
+        subscriptions.Subscribers(operationalDescriptionTopic, recipients);
+        Server::SendToClients(recipients, stringOut);
     }
 
     void onNewCommand(AMM::Command &c, eprosima::fastrtps::SampleInfo_t *info) {
@@ -552,6 +759,7 @@ public:
             } else if (value.compare("RESET_SIM") == 0) {
                 currentStatus = "NOT RUNNING";
                 isPaused = false;
+                ClearSnapshotEvents();
                 std::string tmsg = "ACT=RESET_SIM";
                 s->SendToAll(tmsg);
                 AMM::SimulationControl simControl;
@@ -560,6 +768,7 @@ public:
                 simControl.type(AMM::ControlType::RESET);
                 mgr->WriteSimulationControl(simControl);
                 InitializeLabNodes();
+                labsChanged.store(true, std::memory_order_relaxed);
             } else if (!value.compare(0, loadScenarioPrefix.size(), loadScenarioPrefix)) {
                 currentScenario = value.substr(loadScenarioPrefix.size());
                 sendConfigToAll(currentScenario);
@@ -577,6 +786,7 @@ public:
                 LOG_INFO << "Sending unknown system message: " << messageOut.str();
                 s->SendToAll(messageOut.str());
             }
+            SnapshotStatus();
         } else {
             std::ostringstream messageOut;
             messageOut << "ACT"
@@ -585,29 +795,143 @@ public:
             s->SendToAll(messageOut.str());
         }
     }
+
+private:
+    // Subscriber list reused by every sample a listener thread delivers
+    static std::vector<ClientHandle> &Recipients() {
+        static thread_local std::vector<ClientHandle> recipients;
+        return recipients;
+    }
+
+    // HF_ topic for each waveform name, so samples skip building the name
+    std::unordered_map<std::string, TopicId> waveformTopics;
+
+    TopicId WaveformTopic(const std::string &name) {
+        auto it = waveformTopics.find(name);
+        if (it == waveformTopics.end()) {
+            it = waveformTopics.emplace(name, TopicRegistry::Intern("HF_" + name)).first;
+        }
+        return it->second;
+    }
 };
 
 
+/*
+  PostFromSession():
+                Nothing a client sends is dropped because a queue is full. A
+                threaded session serves only its own client and waits for
+                room. The io_uring thread serves every client, so there the
+                work is held, in order, and the client's reads are paused
+                until all of it has been queued; other clients carry on.
+*/
+void PostFromSession(Client *c, SessionPost post) {
+    if (Server::SessionMayWait()) {
+        post(true);
+        return;
+    }
+    std::lock_guard<std::mutex> lock(heldMutex);
+    // Behind work already held for the client, to keep its order
+    if (heldCounts.count(c->handle) == 0 && post(false)) {
+        return;
+    }
+    heldPosts.emplace_back(c->handle, std::move(post));
+    heldCounts[c->handle]++;
+    Server::PauseReads(c);
+}
+
+void PublishFromSession(Client *c, std::function<void()> write) {
+    PostFromSession(c, [write](bool wait) mutable {
+        if (wait) {
+            publishQueue.Post(std::move(write));
+            return true;
+        }
+        return publishQueue.TryPost(write);
+    });
+}
+
+// Documents are parsed in order per client, keyed by its id
+void ParseFromSession(Client *c, std::function<void()> job) {
+    std::string key = c->id;
+    PostFromSession(c, [key, job](bool wait) mutable {
+        if (wait) {
+            xmlWorkers.Post(key, std::move(job));
+            return true;
+        }
+        return xmlWorkers.TryPost(key, job);
+    });
+}
+
+/*
+  RejectDocument():
+                Tells a client its document was not applied, as
+                ERROR=<prefix without '='>;<reason>, so it can send it again.
+                A rejected CAPABILITY also ends the client's handshake.
+*/
+void RejectDocument(std::string const &clientId, std::string const &prefix, std::string const &reason) {
+    std::string kind = prefix.substr(0, prefix.size() - 1);
+    LOG_ERROR << "Client " << clientId << " sent a " << kind << " document that " << reason;
+    if (prefix == capabilityPrefix) {
+        ServerThread::LockMutex(clientId);
+        Client *c = Server::GetClientByIndex(clientId);
+        if (c) {
+            AdmissionControl::Completed(c);
+        }
+        ServerThread::UnlockMutex(clientId);
+    }
+    std::string reply = errorPrefix + kind + ";" + reason + "\n";
+    Server::SendToClients(std::vector<std::string>{clientId}, GatherMessage(MakeMessageBuffer(reply)));
+}
+
+/*
+  Retries held work in order; work of a client whose earlier post is still
+  refused stays behind it.
+*/
+bool Server::OnClientResume(Client *c) {
+    std::lock_guard<std::mutex> lock(heldMutex);
+    std::unordered_set<ClientHandle> blocked;
+    for (auto it = heldPosts.begin(); it != heldPosts.end();) {
+        if (blocked.count(it->first) == 0 && it->second(false)) {
+            auto count = heldCounts.find(it->first);
+            if (--count->second == 0) {
+                heldCounts.erase(count);
+            }
+            it = heldPosts.erase(it);
+        } else {
+            blocked.insert(it->first);
+            ++it;
+        }
+    }
+    return heldCounts.count(c->handle) == 0;
+}
+
 void PublishSettings(std::string const &equipmentType) {
     std::ostringstream payload;
     LOG_INFO << "Publishing equipment " << equipmentType << " settings";
-    for (auto &inner_map_pair : equipmentSettings[equipmentType]) {
-        payload << inner_map_pair.first << "=" << inner_map_pair.second
-                << std::endl;
-        LOG_DEBUG << "\t" << inner_map_pair.first << ": " << inner_map_pair.second;
+    {
+        std::lock_guard<std::mutex> lock(routingMutex);
+        for (auto &inner_map_pair : equipmentSettings[equipmentType]) {
+            payload << inner_map_pair.first << "=" << inner_map_pair.second
+                    << std::endl;
+            LOG_DEBUG << "\t" << inner_map_pair.first << ": " << inner_map_pair.second;
+        }
     }
 
     AMM::InstrumentData i;
     i.instrument(equipmentType);
     i.payload(payload.str());
-    mgr->WriteInstrumentData(i);
+    publishQueue.Post([i]() mutable {
+        mgr->WriteInstrumentData(i);
+    });
 }
 
-void HandleSettings(Client *c, std::string const &settingsVal) {
+bool ParseSettings(std::string const &settingsVal, SettingsList &settings) {
     XMLDocument doc(false);
     doc.Parse(settingsVal.c_str());
     tinyxml2::XMLNode *root =
             doc.FirstChildElement("AMMModuleConfiguration");
+    if (!root || !root->FirstChildElement("module")) {
+        return false;
+    }
     tinyxml2::XMLElement *module = root->FirstChildElement("module");
     tinyxml2::XMLElement *caps =
             module->FirstChildElement("capabilities");
@@ -616,7 +940,10 @@ void HandleSettings(Client *c, std::string const &settingsVal) {
                 caps->FirstChildElement("capability");
              node; node = node->NextSibling()) {
             tinyxml2::XMLElement *cap = node->ToElement();
-            std::string capabilityName = cap->Attribute("name");
+            if (!cap || !cap->Attribute("name")) {
+                continue;
+            }
+            settings.emplace_back(cap->Attribute("name"), std::map<std::string, std::string>());
             tinyxml2::XMLElement *configEl =
                     cap->FirstChildElement("configuration");
             if (configEl) {
@@ -624,75 +951,144 @@ void HandleSettings(Client *c, std::string const &settingsVal) {
                         configEl->FirstChildElement("setting");
                      settingNode; settingNode = settingNode->NextSibling()) {
                     tinyxml2::XMLElement *setting = settingNode->ToElement();
-                    std::string settingName = setting->Attribute("name");
-                    std::string settingValue = setting->Attribute("value");
-                    equipmentSettings[capabilityName][settingName] =
-                            settingValue;
+                    if (setting && setting->Attribute("name") && setting->Attribute("value")) {
+                        settings.back().second[setting->Attribute("name")] = setting->Attribute("value");
+                    }
                 }
             }
-            PublishSettings(capabilityName);
         }
     }
+    return true;
+}
+
+void ApplySettings(SettingsList const &settings) {
+    {
+        std::lock_guard<std::mutex> lock(routingMutex);
+        for (auto &capability : settings) {
+            for (auto &setting : capability.second) {
+                equipmentSettings[capability.first][setting.first] = setting.second;
+                snapshot.Put("settings", capability.first + "\t" + setting.first, setting.second);
+            }
+        }
+    }
+    for (auto &capability : settings) {
+        PublishSettings(capability.first);
+    }
+}
+
+void HandleSettings(Client *c, std::string const &settingsVal) {
+    std::string clientId = c->id;
+    ParseFromSession(c, [clientId, settingsVal] {
+        SettingsList settings;
+        auto start = std::chrono::steady_clock::now();
+        bool ok = ParseSettings(settingsVal, settings);
+        xmlParseTime.Add(std::chrono::steady_clock::now() - start);
+
+        if (!ok) {
+            RejectDocument(clientId, settingsPrefix, "could not be parsed");
+            return;
+        }
+        ApplySettings(settings);
+    });
+}
+
+/*
+  ParseEventFilter():
+                Predicates declared on a subscribed topic, e.g.
+                <topic name="AMM_EventRecord" location="Thorax,Head" participant_id="..."/>.
+                Each attribute is a comma separated list of accepted values.
+*/
+EventFilter ParseEventFilter(const tinyxml2::XMLElement *topic) {
+    static const char *const attributes[EventFilter::FieldCount] = {"type", "location", "participant_id"};
+
+    EventFilter filter;
+    for (int field = 0; field < EventFilter::FieldCount; field++) {
+        const char *value = topic->Attribute(attributes[field]);
+        if (!value) {
+            continue;
+        }
+        for (auto &accepted : Utility::explode(",", value)) {
+            boost::trim(accepted);
+            if (!accepted.empty()) {
+                Utility::add_once(filter.accepted[field], accepted);
+            }
+        }
+    }
+    return filter;
+}
+
+/*
+  ProjectionFor():
+                Fields a client wants from an event topic, declared as
+                <topic name="AMM_EventRecord" fields="id,type"/>. False for
+                topics without projections or when no listed field exists.
+*/
+bool ProjectionFor(std::string const &topicName, std::string const &fieldList, FieldMask &fields) {
+    std::vector<std::string> names = Utility::explode(",", fieldList);
+    for (auto &name : names) {
+        boost::trim(name);
+    }
+
+    if (topicName == "AMM_EventRecord") {
+        fields = Serializer<AMM::EventRecord>::Project(names);
+    } else if (topicName == "AMM_Assessment") {
+        fields = Serializer<AMM::Assessment>::Project(names);
+    } else if (topicName == "AMM_Physiology_Modification") {
+        fields = Serializer<AMM::PhysiologyModification>::Project(names);
+    } else if (topicName == "AMM_Render_Modification") {
+        fields = Serializer<AMM::RenderModification>::Project(names);
+    } else {
+        return false;
+    }
+    return fields != 0;
 }
 
-void HandleCapabilities(Client *c, std::string const &capabilityVal) {
+bool ParseCapabilities(std::string const &capabilityVal, CapabilityProfile &profile) {
     XMLDocument doc(false);
     doc.Parse(capabilityVal.c_str());
 
     tinyxml2::XMLNode *root = doc.FirstChildElement("AMMModuleConfiguration");
+    if (!root || !root->FirstChildElement("module")) {
+        return false;
+    }
     tinyxml2::XMLElement *module = root->FirstChildElement("module")->ToElement();
     const char *name = module->Attribute("name");
     const char *manufacturer = module->Attribute("manufacturer");
     const char *model = module->Attribute("model");
     const char *serial = module->Attribute("serial_number");
     const char *module_version = module->Attribute("module_version");
+    if (!name || !manufacturer || !model || !serial || !module_version) {
+        return false;
+    }
 
-    std::string nodeName(name);
-    std::string nodeManufacturer(manufacturer);
-    std::string nodeModel(model);
-    std::string serialNumber(serial);
-    std::string moduleVersion(module_version);
-
-    AMM::OperationalDescription od;
-    od.name(nodeName);
-    od.model(nodeModel);
-    od.manufacturer(nodeManufacturer);
-    od.serial_number(serialNumber);
-    od.module_id(m_uuid);
-    od.module_version(moduleVersion);
-    // const std::string capabilities = AMM::Utility::read_file_to_string("config/tcp_bridge_capabilities.xml");
-    od.capabilities_schema(capabilityVal);
-    od.description();
-    mgr->WriteOperationalDescription(od);
-
-    // Set the client's type
-    ServerThread::LockMutex(c->id);
-    c->SetClientType(nodeName);
-    clientTypeMap[c->id] = nodeName;
-    ServerThread::UnlockMutex(c->id);
-
-    subscribedTopics[c->id].clear();
-    publishedTopics[c->id].clear();
+    profile.name = name;
+    profile.manufacturer = manufacturer;
+    profile.model = model;
+    profile.serialNumber = serial;
+    profile.moduleVersion = module_version;
 
     tinyxml2::XMLElement *caps =
             module->FirstChildElement("capabilities");
     if (caps) {
         for (tinyxml2::XMLNode *node = caps->FirstChildElement("capability"); node; node = node->NextSibling()) {
             tinyxml2::XMLElement *cap = node->ToElement();
+            if (!cap || !cap->Attribute("name")) {
+                continue;
+            }
             std::string capabilityName = cap->Attribute("name");
             tinyxml2::XMLElement *starting_settings =
                     cap->FirstChildElement("starting_settings");
             if (starting_settings) {
+                profile.startingSettings.emplace_back(capabilityName, std::map<std::string, std::string>());
                 for (tinyxml2::XMLNode *settingNode =
                         starting_settings->FirstChildElement("setting");
                      settingNode; settingNode = settingNode->NextSibling()) {
                     tinyxml2::XMLElement *setting = settingNode->ToElement();
-                    std::string settingName = setting->Attribute("name");
-                    std::string settingValue = setting->Attribute("value");
-                    equipmentSettings[capabilityName][settingName] =
-                            settingValue;
+                    if (setting && setting->Attribute("name") && setting->Attribute("value")) {
+                        profile.startingSettings.back().second[setting->Attribute("name")] =
+                                setting->Attribute("value");
+                    }
                 }
-                PublishSettings(capabilityName);
             }
 
             tinyxml2::XMLNode *subs =
@@ -702,6 +1098,9 @@ void HandleCapabilities(Client *c, std::string const &capabilityVal) {
                         subs->FirstChildElement("topic");
                      sub; sub = sub->NextSibling()) {
                     tinyxml2::XMLElement *s = sub->ToElement();
+                    if (!s || !s->Attribute("name")) {
+                        continue;
+                    }
                     std::string subTopicName = s->Attribute("name");
 
                     if (s->Attribute("nodepath")) {
@@ -712,9 +1111,19 @@ void HandleCapabilities(Client *c, std::string const &capabilityVal) {
                             subTopicName = subNodePath;
                         }
                     }
-                    Utility::add_once(subscribedTopics[c->id], subTopicName);
-                    LOG_DEBUG << "[" << capabilityName << "][" << c->id
-                              << "] Subscribing to " << subTopicName;
+                    EventFilter filter = ParseEventFilter(s);
+                    FieldMask fields;
+                    if (s->Attribute("fields") && ProjectionFor(subTopicName, s->Attribute("fields"), fields)) {
+                        profile.projections.emplace_back(TopicRegistry::Intern(subTopicName), fields);
+                    }
+                    if (TopicMatcher::IsPattern(subTopicName)) {
+                        Utility::add_once(profile.subscribedPatterns, subTopicName);
+                    } else if (!filter.Empty()) {
+                        profile.eventFilters.emplace_back(TopicRegistry::Intern(subTopicName), filter);
+                    } else {
+                        Utility::add_once(profile.subscribed, TopicRegistry::Intern(subTopicName));
+                    }
+                    LOG_DEBUG << "[" << capabilityName << "] Subscribing to " << subTopicName;
                 }
             }
 
@@ -726,36 +1135,156 @@ void HandleCapabilities(Client *c, std::string const &capabilityVal) {
                         pubs->FirstChildElement("topic");
                      pub; pub = pub->NextSibling()) {
                     tinyxml2::XMLElement *p = pub->ToElement();
+                    if (!p || !p->Attribute("name")) {
+                        continue;
+                    }
                     std::string pubTopicName = p->Attribute("name");
-                    Utility::add_once(publishedTopics[c->id], pubTopicName);
-                    LOG_DEBUG << "[" << capabilityName << "][" << c->id
-                              << "] Publishing " << pubTopicName;
+                    Utility::add_once(profile.published, TopicRegistry::Intern(pubTopicName));
+                    LOG_DEBUG << "[" << capabilityName << "] Publishing " << pubTopicName;
                 }
             }
         }
     }
+    return true;
 }
 
-void HandleStatus(Client *c, std::string const &statusVal) {
-    XMLDocument doc(false);
-    doc.Parse(statusVal.c_str());
+/*
+  ApplyCapabilities():
+                Installs a parsed profile for a client: its type, its whole
+                subscription set and its published topics change together
+                under routingMutex, then the module's description and starting
+                settings are published.
+*/
+void ApplyCapabilities(std::string const &clientId, CapabilityProfile const &profile,
+                       std::string const &capabilityVal) {
+    bool createWaveformReader;
+    {
+        std::lock_guard<std::mutex> lock(routingMutex);
+
+        // Set the client's type. A client that left while this was queued
+        // is skipped, so a late result cannot bring its routes back.
+        std::string nodeName = profile.name;
+        ServerThread::LockMutex(clientId);
+        Client *c = Server::GetClientByIndex(clientId);
+        ClientHandle handle;
+        if (c) {
+            c->SetClientType(nodeName);
+            AdmissionControl::Completed(c);
+            handle = c->handle;
+        }
+        ServerThread::UnlockMutex(clientId);
+        if (!c) {
+            return;
+        }
+        clientTypeMap[clientId] = nodeName;
+
+        subscriptions.Replace(handle, profile.subscribed, profile.subscribedPatterns);
+        eventFilters.Replace(handle, profile.eventFilters);
+        projections.Replace(handle, profile.projections);
+        createWaveformReader = waveformDemand.Set(clientId,
+                                                  waveformDemand.Wants(profile.subscribed, profile.subscribedPatterns));
+        publishedTopics[clientId] = profile.published;
+
+        for (auto &capability : profile.startingSettings) {
+            for (auto &setting : capability.second) {
+                equipmentSettings[capability.first][setting.first] = setting.second;
+                snapshot.Put("settings", capability.first + "\t" + setting.first, setting.second);
+            }
+        }
+    }
+    // Outside routingMutex: creation waits for room on the publish queue
+    if (createWaveformReader) {
+        waveformDemand.Create();
+    }
 
-    tinyxml2::XMLNode *root = doc.FirstChildElement("AMMModuleStatus");
-    tinyxml2::XMLElement *module =
-            root->FirstChildElement("module")->ToElement();
-    const char *name = module->Attribute("name");
-    std::string nodeName(name);
-
-    std::size_t found = statusVal.find(haltingString);
-    AMM::Status s;
-    s.module_id(m_uuid);
-    s.capability(nodeName);
-    if (found != std::string::npos) {
-        s.value(AMM::StatusValue::INOPERATIVE);
-    } else {
-        s.value(AMM::StatusValue::OPERATIONAL);
+    AMM::OperationalDescription od;
+    od.name(profile.name);
+    od.model(profile.model);
+    od.manufacturer(profile.manufacturer);
+    od.serial_number(profile.serialNumber);
+    od.module_id(m_uuid);
+    od.module_version(profile.moduleVersion);
+    // const std::string capabilities = AMM::Utility::read_file_to_string("config/tcp_bridge_capabilities.xml");
+    od.capabilities_schema(capabilityVal);
+    od.description();
+    publishQueue.Post([od]() mutable {
+        mgr->WriteOperationalDescription(od);
+    });
+
+    for (auto &capability : profile.startingSettings) {
+        PublishSettings(capability.first);
     }
-    mgr->WriteStatus(s);
+}
+
+/*
+  HandleCapabilities():
+                Takes the still-encoded payload. A payload seen before binds
+                its cached profile; a new one is decoded, parsed and cached.
+*/
+void HandleCapabilities(Client *c, std::string const &payload) {
+    std::string clientId = c->id;
+    ParseFromSession(c, [clientId, payload] {
+        std::shared_ptr<const CapabilityCache::Entry> cached = capabilityCache.Find(payload);
+        if (cached) {
+            LOG_INFO << "Client " << clientId << " sent known capabilities for " << cached->profile.name;
+            ApplyCapabilities(clientId, cached->profile, cached->document);
+            return;
+        }
+
+        auto entry = std::make_shared<CapabilityCache::Entry>();
+        entry->payload = payload;
+        try {
+            entry->document = Utility::decode64(payload);
+        } catch (exception &e) {
+            RejectDocument(clientId, capabilityPrefix, std::string("could not be decoded: ") + e.what());
+            return;
+        }
+        LOG_INFO << "Client " << clientId << " sent capabilities: " << entry->document;
+
+        auto start = std::chrono::steady_clock::now();
+        bool ok = ParseCapabilities(entry->document, entry->profile);
+        xmlParseTime.Add(std::chrono::steady_clock::now() - start);
+
+        if (!ok) {
+            RejectDocument(clientId, capabilityPrefix, "could not be parsed");
+            return;
+        }
+        capabilityCache.Insert(entry);
+        ApplyCapabilities(clientId, entry->profile, entry->document);
+    });
+}
+
+void HandleStatus(Client *c, std::string const &statusVal) {
+    std::string clientId = c->id;
+    ParseFromSession(c, [clientId, statusVal] {
+        auto start = std::chrono::steady_clock::now();
+        XMLDocument doc(false);
+        doc.Parse(statusVal.c_str());
+
+        tinyxml2::XMLNode *root = doc.FirstChildElement("AMMModuleStatus");
+        tinyxml2::XMLElement *module = root ? root->FirstChildElement("module") : nullptr;
+        const char *name = module ? module->Attribute("name") : nullptr;
+        xmlParseTime.Add(std::chrono::steady_clock::now() - start);
+
+        if (!name) {
+            RejectDocument(clientId, statusPrefix, "could not be parsed");
+            return;
+        }
+        std::string nodeName(name);
+
+        std::size_t found = statusVal.find(haltingString);
+        AMM::Status s;
+        s.module_id(m_uuid);
+        s.capability(nodeName);
+        if (found != std::string::npos) {
+            s.value(AMM::StatusValue::INOPERATIVE);
+        } else {
+            s.value(AMM::StatusValue::OPERATIONAL);
+        }
+        publishQueue.Post([s]() mutable {
+            mgr->WriteStatus(s);
+        });
+    });
 }
 
 void DispatchRequest(Client *c, std::string const &request) {
@@ -796,277 +1325,395 @@ void DispatchRequest(Client *c, std::string const &request) {
     }
 }
 
-// Override client handler code from Net Server
-void *Server::HandleClient(void *args) {
-    auto *c = (Client *) args;
-    char buffer[8192 - 25];
-    int index;
-    ssize_t n;
-
+// Override client session hooks from Net Server
+void Server::OnClientConnected(Client *c) {
     std::string uuid = mgr->GenerateUuidString();
 
     ServerThread::LockMutex(uuid);
     c->SetId(uuid);
     string defaultName = "Client " + c->id;
     c->SetName(defaultName);
-    Server::clients.push_back(*c);
+    Server::clients.push_back(c);
+    Server::AssignHandle(c);
     clientMap[c->id] = uuid;
     LOG_DEBUG << "Adding client with id: " << c->id;
     ServerThread::UnlockMutex(uuid);
+}
 
-    while (true) {
-        memset(buffer, 0, sizeof buffer);
-        n = recv(c->sock, buffer, sizeof buffer, 0);
+void Server::OnClientDisconnected(Client *c) {
+    int index;
 
-        // Client disconnected?
-        if (n == 0) {
-            LOG_INFO << c->name << " disconnected";
-            shutdown(c->sock, 2);
-            close(c->sock);
+    LOG_INFO << c->name << " disconnected";
+    AdmissionControl::Completed(c);
 
-            // Remove client in Static clients <vector>
-            ServerThread::LockMutex(uuid);
-            index = Server::FindClientIndex(c);
-            LOG_DEBUG << "Erasing user in position " << index
-                      << " whose name id is: " << Server::clients[index].id;
-            Server::clients.erase(Server::clients.begin() + index);
-            ServerThread::UnlockMutex(uuid);
-
-            // Remove from our client/UUID map
-            LOG_DEBUG << "Erasing from client map";
-            auto it = clientMap.find(c->id);
-            clientMap.erase(it);
-            LOG_DEBUG << "Done shutting down socket.";
+    // Remove client in Static clients <vector>
+    ServerThread::LockMutex(c->id);
+    index = Server::FindClientIndex(c);
+    LOG_DEBUG << "Erasing user in position " << index
+              << " whose name id is: " << Server::clients[index]->id;
+    Server::clients.erase(Server::clients.begin() + index);
+    Server::ReleaseHandle(c);
+    // Only now can no broadcast reach the fd; the caller closes it after this
+    OutboundQueue::Forget(c->sock);
+    ZeroCopySender::Forget(c->sock);
+    ServerThread::UnlockMutex(c->id);
 
-            break;
-        } else if (n < 0) {
-            LOG_ERROR << "Error while receiving message from client: " << c->name;
-        } else {
-            std::string tempBuffer(buffer);
-            globalInboundBuffer[c->id] += tempBuffer;
-            if (!boost::algorithm::ends_with(globalInboundBuffer[c->id], "\n")) {
-                continue;
-            }
-            vector <string> strings = Utility::explode("\n", globalInboundBuffer[c->id]);
-            globalInboundBuffer[c->id].clear();
-
-            for (auto str : strings) {
-                boost::trim_right(str);
-                if (!str.empty()) {
-                    if (str.substr(0, modulePrefix.size()) == modulePrefix) {
-                        std::string moduleName = str.substr(modulePrefix.size());
-
-                        // Add the modules name to the static Client vector
-                        ServerThread::LockMutex(uuid);
-                        c->SetName(moduleName);
-                        ServerThread::UnlockMutex(uuid);
-                        LOG_DEBUG << "Client " << c->id
-                                  << " module connected: " << moduleName;
-                    } else if (str.substr(0, registerPrefix.size()) == registerPrefix) {
-                        // Registering for data
-                        std::string registerVal = str.substr(registerPrefix.size());
-                        LOG_INFO << "Client " << c->id
-                                 << " registered for: " << registerVal;
-                    } else if (str.substr(0, statusPrefix.size()) == statusPrefix) {
-                        // Client set their status (OPERATIONAL, etc)
-                        std::string statusVal;
-                        try {
-                            statusVal = Utility::decode64(str.substr(statusPrefix.size()));
-                        } catch (exception &e) {
-                            LOG_ERROR << "Error decoding base64 string: " << e.what();
-                            break;
-                        }
+    // Remove from our client/UUID map
+    LOG_DEBUG << "Erasing from client map";
+    std::lock_guard<std::mutex> lock(routingMutex);
+    auto it = clientMap.find(c->id);
+    clientMap.erase(it);
+    subscriptions.Clear(c->handle);
+    eventFilters.Clear(c->handle);
+    projections.Clear(c->handle);
+    waveformDemand.Set(c->id, false);
+    publishedTopics.erase(c->id);
+    ringClients.Set(c->handle, false);
+    multicastClients.Set(c->handle, false);
+}
 
-                        LOG_DEBUG << "Client " << c->id << " sent status: " << statusVal;
-                        HandleStatus(c, statusVal);
-                    } else if (str.substr(0, capabilityPrefix.size()) ==
-                               capabilityPrefix) {
-                        // Client sent their capabilities / announced
-                        std::string capabilityVal;
-                        try {
-                            capabilityVal = Utility::decode64(str.substr(capabilityPrefix.size()));
-                        } catch (exception &e) {
-                            LOG_ERROR << "Error decoding base64 string: " << e.what();
-                            break;
-                        }
-                        LOG_INFO << "Client " << c->id
-                                 << " sent capabilities: " << capabilityVal;
-                        HandleCapabilities(c, capabilityVal);
-                    } else if (str.substr(0, settingsPrefix.size()) == settingsPrefix) {
-                        std::string settingsVal;
-                        try {
-                            settingsVal = Utility::decode64(str.substr(settingsPrefix.size()));
-                        } catch (exception &e) {
-                            LOG_ERROR << "Error decoding base64 string: " << e.what();
-                            break;
-                        }
-                        LOG_INFO << "Client " << c->id << " sent settings: " << settingsVal;
-                        HandleSettings(c, settingsVal);
-                    } else if (str.substr(0, keepHistoryPrefix.size()) ==
-                               keepHistoryPrefix) {
-                        // Setting the KEEP_HISTORY flag
-                        std::string keepHistory = str.substr(keepHistoryPrefix.size());
-                        if (keepHistory == "TRUE") {
-                            LOG_DEBUG << "Client " << c->id << " wants to keep history.";
-                            c->SetKeepHistory(true);
-                        } else {
-                            LOG_DEBUG << "Client " << c->id
-                                      << " does not want to keep history.";
-                            c->SetKeepHistory(false);
-                        }
-                    } else if (str.substr(0, requestPrefix.size()) == requestPrefix) {
-                        std::string request = str.substr(requestPrefix.size());
-                        DispatchRequest(c, request);
-                    } else if (str.substr(0, actionPrefix.size()) == actionPrefix) {
-                        // Sending action
-                        std::string action = str.substr(actionPrefix.size());
-                        LOG_INFO << "Client " << c->id
-                                 << " posting action to AMM: " << action;
-                        AMM::Command cmdInstance;
-                        cmdInstance.message(action);
-                        // mgr->PublishCommand(cmdInstance);
-                    } else if (!str.compare(0, genericTopicPrefix.size(), genericTopicPrefix)) {
-                        std::string topic, message, modType, modLocation, modPayload, modLearner, modInfo;
-                        unsigned first = str.find("[");
-                        unsigned last = str.find("]");
-                        topic = str.substr(first + 1, last - first - 1);
-                        message = str.substr(last + 1);
-
-                        if (topic == "KEEPALIVE") {
-                            continue;
-                        }
+void Server::OnClientData(Client *c, const char *data, size_t len) {
+    globalInboundBuffer[c->id].append(data, len);
+    if (!boost::algorithm::ends_with(globalInboundBuffer[c->id], "\n")) {
+        return;
+    }
+    vector <string> strings = Utility::explode("\n", globalInboundBuffer[c->id]);
+    globalInboundBuffer[c->id].clear();
+
+
+    for (auto str : strings) {
+        boost::trim_right(str);
+        if (!str.empty()) {
+            if (str.substr(0, modulePrefix.size()) == modulePrefix) {
+                std::string moduleName = str.substr(modulePrefix.size());
+
+                // Add the modules name to the static Client vector
+                ServerThread::LockMutex(c->id);
+                c->SetName(moduleName);
+                ServerThread::UnlockMutex(c->id);
+                LOG_DEBUG << "Client " << c->id
+                          << " module connected: " << moduleName;
+            } else if (str.substr(0, registerPrefix.size()) == registerPrefix) {
+                // Registering for data
+                std::string registerVal = str.substr(registerPrefix.size());
+                LOG_INFO << "Client " << c->id
+                         << " registered for: " << registerVal;
+            } else if (str.substr(0, statusPrefix.size()) == statusPrefix) {
+                // Client set their status (OPERATIONAL, etc)
+                std::string statusVal;
+                try {
+                    statusVal = Utility::decode64(str.substr(statusPrefix.size()));
+                } catch (exception &e) {
+                    LOG_ERROR << "Error decoding base64 string: " << e.what();
+                    break;
+                }
 
-                        LOG_INFO << "Received a message for topic " << topic << " with a payload of: " << message;
-
-                        std::list <std::string> tokenList;
-                        split(tokenList, message, boost::algorithm::is_any_of(";"), boost::token_compress_on);
-                        std::map <std::string, std::string> kvp;
-
-                        BOOST_FOREACH(std::string
-                        token, tokenList) {
-                            size_t sep_pos = token.find_first_of("=");
-                            std::string key = token.substr(0, sep_pos);
-                            std::string value = (sep_pos == std::string::npos ? "" : token.substr(
-                                    sep_pos + 1,
-                                    std::string::npos));
-                            kvp[key] = value;
-                            LOG_DEBUG << "\t" << key << " => " << kvp[key];
-                        }
+                LOG_DEBUG << "Client " << c->id << " sent status: " << statusVal;
+                HandleStatus(c, statusVal);
+            } else if (str.substr(0, capabilityPrefix.size()) ==
+                       capabilityPrefix) {
+                // Client sent their capabilities / announced, decoded with the profile
+                HandleCapabilities(c, str.substr(capabilityPrefix.size()));
+            } else if (str.substr(0, settingsPrefix.size()) == settingsPrefix) {
+                std::string settingsVal;
+                try {
+                    settingsVal = Utility::decode64(str.substr(settingsPrefix.size()));
+                } catch (exception &e) {
+                    LOG_ERROR << "Error decoding base64 string: " << e.what();
+                    break;
+                }
+                LOG_INFO << "Client " << c->id << " sent settings: " << settingsVal;
+                HandleSettings(c, settingsVal);
+            } else if (str.substr(0, compressionPrefix.size()) == compressionPrefix) {
+                // Client lists the codecs it can inflate, most preferred first
+                CompressionCodec codec = Compressor::Negotiate(str.substr(compressionPrefix.size()));
+                LOG_INFO << "Client " << c->id << " negotiated compression: " << Compressor::Name(codec);
+                Server::SetCompression(c, codec, compressionPrefix + Compressor::Name(codec) + "\n");
+            } else if (str.substr(0, shmRingPrefix.size()) == shmRingPrefix) {
+                // Local client wants its waveforms from the shared memory
+                // ring; the session still carries everything else
+                bool wants = str.substr(shmRingPrefix.size()) == "TRUE";
+                bool granted = wants && waveformRing.Active() && Server::IsLocal(c);
+                ringClients.Set(c->handle, granted);
+                LOG_INFO << "Client " << c->id << (granted ? " reads" : " does not read")
+                         << " waveforms from shared memory";
+                Server::SendToClient(c, shmRingPrefix + (granted ? waveformRing.Name() + ";" +
+                                                                   std::to_string(waveformRing.Capacity())
+                                                                 : "NONE") + "\n");
+            } else if (str.substr(0, multicastPrefix.size()) == multicastPrefix) {
+                // Client joins the waveform groups; FALSE, e.g. after it saw
+                // gaps in the sequence, moves it back to its session
+                bool granted = str.substr(multicastPrefix.size()) == "TRUE" && waveformMulticast.Active();
+                multicastClients.Set(c->handle, granted);
+                LOG_INFO << "Client " << c->id << (granted ? " receives" : " does not receive")
+                         << " waveforms by multicast";
+                Server::SendToClient(c, multicastPrefix + (granted ? waveformMulticast.Describe() : "NONE") + "\n");
+            } else if (str.substr(0, keepHistoryPrefix.size()) ==
+                       keepHistoryPrefix) {
+                // Setting the KEEP_HISTORY flag
+                std::string keepHistory = str.substr(keepHistoryPrefix.size());
+                if (keepHistory == "TRUE") {
+                    LOG_DEBUG << "Client " << c->id << " wants to keep history.";
+                    c->SetKeepHistory(true);
+                } else {
+                    LOG_DEBUG << "Client " << c->id
+                              << " does not want to keep history.";
+                    c->SetKeepHistory(false);
+                }
+            } else if (str.substr(0, requestPrefix.size()) == requestPrefix) {
+                std::string request = str.substr(requestPrefix.size());
+                DispatchRequest(c, request);
+            } else if (str.substr(0, actionPrefix.size()) == actionPrefix) {
+                // Sending action
+                std::string action = str.substr(actionPrefix.size());
+                LOG_INFO << "Client " << c->id
+                         << " posting action to AMM: " << action;
+                AMM::Command cmdInstance;
+                cmdInstance.message(action);
+                // mgr->PublishCommand(cmdInstance);
+            } else if (!str.compare(0, genericTopicPrefix.size(), genericTopicPrefix)) {
+                std::string topic, message, modType, modLocation, modPayload, modLearner, modInfo;
+                unsigned first = str.find("[");
+                unsigned last = str.find("]");
+                topic = str.substr(first + 1, last - first - 1);
+                message = str.substr(last + 1);
+
+                if (topic == "KEEPALIVE") {
+                    continue;
+                }
 
-                        auto type = kvp.find("type");
-                        if (type != kvp.end()) {
-                            modType = type->second;
-                        }
+                HOT_LOG_DEBUG << "Received a message for topic " << topic << " with a payload of: " << message;
+
+                std::list <std::string> tokenList;
+                split(tokenList, message, boost::algorithm::is_any_of(";"), boost::token_compress_on);
+                std::map <std::string, std::string> kvp;
+
+                BOOST_FOREACH(std::string
+                token, tokenList) {
+                    size_t sep_pos = token.find_first_of("=");
+                    std::string key = token.substr(0, sep_pos);
+                    std::string value = (sep_pos == std::string::npos ? "" : token.substr(
+                            sep_pos + 1,
+                            std::string::npos));
+                    kvp[key] = value;
+                    HOT_LOG_DEBUG << "\t" << key << " => " << kvp[key];
+                }
 
-                        auto location = kvp.find("location");
-                        if (location != kvp.end()) {
-                            modLocation = location->second;
-                        }
+                auto type = kvp.find("type");
+                if (type != kvp.end()) {
+                    modType = type->second;
+                }
 
-                        auto participant_id = kvp.find("participant_id");
-                        if (participant_id != kvp.end()) {
-                            modLearner = participant_id->second;
-                        }
+                auto location = kvp.find("location");
+                if (location != kvp.end()) {
+                    modLocation = location->second;
+                }
 
-                        auto payload = kvp.find("payload");
-                        if (payload != kvp.end()) {
-                            modPayload = payload->second;
-                        }
+                auto participant_id = kvp.find("participant_id");
+                if (participant_id != kvp.end()) {
+                    modLearner = participant_id->second;
+                }
 
-                        auto info = kvp.find("info");
-                        if (info != kvp.end()) {
-                            modInfo = info->second;
-                        }
+                auto payload = kvp.find("payload");
+                if (payload != kvp.end()) {
+                    modPayload = payload->second;
+                }
 
-                        if (topic == "AMM_Render_Modification") {
-                            AMM::UUID erID;
-                            erID.id(mgr->GenerateUuidString());
-
-                            FMA_Location fma;
-                            fma.name(modLocation);
-
-                            AMM::UUID agentID;
-                            agentID.id(modLearner);
-
-                            AMM::EventRecord er;
-                            er.id(erID);
-                            er.location(fma);
-                            er.agent_id(agentID);
-                            er.type(modType);
-                            mgr->WriteEventRecord(er);
-
-                            AMM::RenderModification renderMod;
-                            renderMod.event_id(erID);
-                            renderMod.type(modType);
-                            renderMod.data(modPayload);
-                            mgr->WriteRenderModification(renderMod);
-                            LOG_INFO << "We sent a render mod of type " << renderMod.type();
-                            LOG_INFO << "\tPayload was: " << renderMod.data();
-                        } else if (topic == "AMM_Physiology_Modification") {
-                            AMM::UUID erID;
-                            erID.id(mgr->GenerateUuidString());
-
-                            FMA_Location fma;
-                            fma.name(modLocation);
-
-                            AMM::UUID agentID;
-                            agentID.id(modLearner);
-
-                            AMM::EventRecord er;
-                            er.id(erID);
-                            er.location(fma);
-                            er.agent_id(agentID);
-                            er.type(modType);
-                            mgr->WriteEventRecord(er);
-
-                            AMM::PhysiologyModification physMod;
-                            physMod.event_id(erID);
-                            physMod.type(modType);
-                            physMod.data(modPayload);
-                            mgr->WritePhysiologyModification(physMod);
-                        } else if (topic == "AMM_Assessment") {
-                            AMM::UUID erID;
-                            erID.id(mgr->GenerateUuidString());
-                            FMA_Location fma;
-                            fma.name(modLocation);
-                            AMM::UUID agentID;
-                            agentID.id(modLearner);
-                            AMM::EventRecord er;
-                            er.id(erID);
-                            er.location(fma);
-                            er.agent_id(agentID);
-                            er.type(modType);
-                            mgr->WriteEventRecord(er);
-
-                            AMM::Assessment assessment;
-                            assessment.event_id(erID);
-                            mgr->WriteAssessment(assessment);
-                        } else if (topic == "AMM_Command") {
-                            AMM::Command cmdInstance;
-                            cmdInstance.message(message);
-                            mgr->WriteCommand(cmdInstance);
-                        } else {
-                            LOG_DEBUG << "Unknown topic: " << topic;
-                        }
-                    } else if (str.substr(0, keepAlivePrefix.size()) == keepAlivePrefix) {
-                        // keepalive, ignore it
-                    } else {
-                        if (!boost::algorithm::ends_with(str, "Connected")) {
-                            LOG_ERROR << "Client " << c->id << " unknown message:" << str;
-                        }
-                    }
+                auto info = kvp.find("info");
+                if (info != kvp.end()) {
+                    modInfo = info->second;
                 }
+
+                if (topic == "AMM_Render_Modification") {
+                    AMM::UUID erID;
+                    erID.id(mgr->GenerateUuidString());
+
+                    FMA_Location fma;
+                    fma.name(modLocation);
+
+                    AMM::UUID agentID;
+                    agentID.id(modLearner);
+
+                    AMM::EventRecord er;
+                    er.id(erID);
+                    er.location(fma);
+                    er.agent_id(agentID);
+                    er.type(modType);
+
+                    AMM::RenderModification renderMod;
+                    renderMod.event_id(erID);
+                    renderMod.type(modType);
+                    renderMod.data(modPayload);
+
+                    PublishFromSession(c, [er, renderMod]() mutable {
+                        mgr->WriteEventRecord(er);
+                        mgr->WriteRenderModification(renderMod);
+                        LOG_INFO << "We sent a render mod of type " << renderMod.type();
+                        LOG_INFO << "\tPayload was: " << renderMod.data();
+                    });
+                } else if (topic == "AMM_Physiology_Modification") {
+                    AMM::UUID erID;
+                    erID.id(mgr->GenerateUuidString());
+
+                    FMA_Location fma;
+                    fma.name(modLocation);
+
+                    AMM::UUID agentID;
+                    agentID.id(modLearner);
+
+                    AMM::EventRecord er;
+                    er.id(erID);
+                    er.location(fma);
+                    er.agent_id(agentID);
+                    er.type(modType);
+
+                    AMM::PhysiologyModification physMod;
+                    physMod.event_id(erID);
+                    physMod.type(modType);
+                    physMod.data(modPayload);
+
+                    PublishFromSession(c, [er, physMod]() mutable {
+                        mgr->WriteEventRecord(er);
+                        mgr->WritePhysiologyModification(physMod);
+                    });
+                } else if (topic == "AMM_Assessment") {
+                    AMM::UUID erID;
+                    erID.id(mgr->GenerateUuidString());
+                    FMA_Location fma;
+                    fma.name(modLocation);
+                    AMM::UUID agentID;
+                    agentID.id(modLearner);
+                    AMM::EventRecord er;
+                    er.id(erID);
+                    er.location(fma);
+                    er.agent_id(agentID);
+                    er.type(modType);
+
+                    AMM::Assessment assessment;
+                    assessment.event_id(erID);
+
+                    PublishFromSession(c, [er, assessment]() mutable {
+                        mgr->WriteEventRecord(er);
+                        mgr->WriteAssessment(assessment);
+                    });
+                } else if (topic == "AMM_Command") {
+                    AMM::Command cmdInstance;
+                    cmdInstance.message(message);
+
+                    PublishFromSession(c, [cmdInstance]() mutable {
+                        mgr->WriteCommand(cmdInstance);
+                    });
+                } else {
+                    LOG_DEBUG << "Unknown topic: " << topic;
+                }
+            } else if (str.substr(0, keepAlivePrefix.size()) == keepAlivePrefix) {
+                // keepalive, ignore it
+            } else {
+                if (!boost::algorithm::ends_with(str, "Connected")) {
+                    LOG_ERROR << "Client " << c->id << " unknown message:" << str;
+                }
+            }
+        }
+    }
+}
+
+void *Server::HandleClient(void *args) {
+    auto *c = (Client *) args;
+    char buffer[8192 - 25];
+    ssize_t n;
+
+    Server::OnClientConnected(c);
+    ConnectionMonitor::Watch(c);
+
+    while (true) {
+        n = recv(c->sock, buffer, sizeof buffer, 0);
+
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        // Client disconnected, evicted, or the connection failed?
+        if (n <= 0) {
+            if (n < 0) {
+                LOG_ERROR << "Error while receiving message from client: " << c->name;
             }
+            Server::OnClientDisconnected(c);
+            ConnectionMonitor::Forget(c);
+            shutdown(c->sock, 2);
+            close(c->sock);
+            ClientPool::Release(c);
+            LOG_DEBUG << "Done shutting down socket.";
+
+            break;
         }
+
+        ConnectionMonitor::Received(c);
+        Server::Receive(c, buffer, (size_t) n);
     }
 
     return nullptr;
 }
 
+/*
+  ProcessCpu():
+                Share of one core this process used since the previous call,
+                from getrusage(). Only called from one thread: the discovery
+                thread, or with -reuseport the worker load refresh.
+*/
+double ProcessCpu() {
+    static std::chrono::steady_clock::time_point lastWall = std::chrono::steady_clock::now();
+    static double lastCpu = 0;
+
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    double cpu = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+                 (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+    auto now = std::chrono::steady_clock::now();
+    double wall = std::chrono::duration<double>(now - lastWall).count();
+    double share = wall > 0 ? (cpu - lastCpu) / wall : 0;
+    lastWall = now;
+    lastCpu = cpu;
+    return share;
+}
+
+/*
+  DescribeBridge():
+                The discovery answer: where to connect and how busy the
+                bridge is. With -reuseport the port is shared and the kernel
+                picks the worker, so whichever worker answers reports the
+                totals of all of them on this host, and how many there are.
+*/
+std::string DescribeBridge() {
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(2);
+    out << moduleName
+        << ";module_id=" << m_uuid.id()
+        << ";pid=" << getpid()
+        << ";port=" << bridgePort
+        << ";websocket_port=" << webSocketPort;
+    WorkerLoad::Totals totals;
+    if (workerLoad.Active()) {
+        int workers = workerLoad.Sum(totals);
+        out << ";workers=" << workers;
+    } else {
+        totals.clients = Server::ClientCount();
+        totals.outbound = Server::QueuedMessages();
+        totals.publish = publishQueue.Pending();
+        totals.cpu = ProcessCpu();
+    }
+    out << ";clients=" << totals.clients
+        << ";outbound_queue=" << totals.outbound
+        << ";publish_queue=" << totals.publish
+        << ";cpu=" << totals.cpu
+        << "\n";
+    return out.str();
+}
+
 void UdpDiscoveryThread() {
     if (discovery) {
         boost::asio::io_service io_service;
-        UdpDiscoveryServer udps(io_service, discoveryPort);
+        UdpDiscoveryServer udps(io_service, discoveryPort, DescribeBridge, Server::reusePort);
         LOG_INFO << "UDP Discovery listening on port " << discoveryPort;
         io_service.run();
     } else {
@@ -1078,6 +1725,40 @@ static void show_usage(const std::string &name) {
     std::cerr << "Usage: " << name << " <option(s)>"
               << "\nOptions:\n"
               << "\t-h,--help\t\tShow this help message\n"
+              << "\t-iouring\t\tUse the io_uring networking backend when the kernel supports it\n"
+              << "\t-reuseport\t\tShare the TCP and WebSocket ports with other bridge processes (SO_REUSEPORT)\n"
+              << "\t-unix_socket <path>\tAlso accept sessions on a Unix domain socket at this path\n"
+              << "\t-websocket_port <port>\tAlso accept WebSocket sessions from browsers on this port\n"
+              << "\t-shm_ring <name>\tOffer waveforms to local clients in the shared memory segment /dev/shm/<name>\n"
+              << "\t-shm_ring_size <bytes>\tSize of the -shm_ring buffer\n"
+              << "\t-multicast <group>\tOffer waveforms by UDP multicast, starting at this group address\n"
+              << "\t-multicast_port <port>\tUDP port of the multicast groups\n"
+              << "\t-multicast_groups <n>\tConsecutive groups the waveform topics are spread over\n"
+              << "\t-multicast_ttl <n>\tHops multicast datagrams may take\n"
+              << "\t-multicast_if <address>\tLocal interface address to send multicast from\n"
+              << "\t-multicast_flush <ms>\tSend partly filled multicast datagrams this often (default 10)\n"
+              << "\t-low_latency\t\tTune sockets for latency over throughput (TCP_NODELAY, TCP_NOTSENT_LOWAT)\n"
+              << "\t-io_cores <list>\tWith -low_latency, pin the session I/O threads to these cores, e.g. 2,3 or 2-3\n"
+              << "\t-dds_cores <list>\tWith -low_latency, pin the DDS listener and publisher threads to these cores\n"
+              << "\t-busy_poll <us>\tWith -low_latency, spin this long on sockets and event loops before sleeping\n"
+              << "\t-socket_sndbuf <bytes>\tWith -low_latency, send buffer of every session socket\n"
+              << "\t-socket_rcvbuf <bytes>\tWith -low_latency, receive buffer of every session socket\n"
+              << "\t-notsent_lowat <bytes>\tWith -low_latency, unsent bytes the kernel holds per session (0 leaves it unset)\n"
+              << "\t-compression_threshold <bytes>\tOnly compress messages of at least this size for clients that negotiated it\n"
+              << "\t-zerocopy_threshold <bytes>\tSend messages of at least this size with MSG_ZEROCOPY (0 disables)\n"
+              << "\t-idle_timeout <seconds>\tDisconnect clients that send nothing, keepalives included, for this long (0 disables)\n"
+              << "\t-write_timeout <seconds>\tDisconnect clients whose socket stops draining for this long (0 disables)\n"
+              << "\t-telemetry_queue_limit <bytes>\tQueued waveform/value data per client before the oldest is dropped\n"
+              << "\t-trace_sample <n>\tTrace the latency of one in n physiology samples (0 disables)\n"
+              << "\t-trace_file <path>\tWrite traced samples as a Chrome trace (chrome://tracing, Perfetto)\n"
+              << "\t-backlog <n>\t\tListen backlog for pending connections\n"
+              << "\t-accept_rate <n>\tAdmit at most this many new sessions per second (0 disables)\n"
+              << "\t-accept_burst <n>\tSessions admitted at once before -accept_rate applies\n"
+              << "\t-max_handshakes <n>\tSessions that may be connected but without applied capabilities (0 disables)\n"
+              << "\t-snapshot <path>\tKeep status, labs, settings and event records in this file across restarts\n"
+              << "\t-snapshot_interval <ms>\tHow often changes are written to the -snapshot file\n"
+              << "\t-snapshot_events <n>\tMost recent event records kept in the -snapshot file (default 1000)\n"
+              << "\t-loglevel <level>\tnone, fatal, error, warning, info, debug or verbose (default info; SIGUSR1/SIGUSR2 step it at runtime)\n"
               << std::endl;
 }
 
@@ -1106,9 +1787,46 @@ void PublishConfiguration() {
     mgr->WriteModuleConfiguration(mc);
 }
 
+/*
+  SignalReady():
+                Tells a supervisor the bridge accepts sessions, using the
+                sd_notify protocol when NOTIFY_SOCKET is set.
+*/
+void SignalReady() {
+    LOG_INFO << "Ready";
+    const char *socketPath = getenv("NOTIFY_SOCKET");
+    if (!socketPath || !*socketPath) {
+        return;
+    }
+
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    size_t length = strlen(socketPath);
+    if (length >= sizeof(address.sun_path)) {
+        return;
+    }
+    memcpy(address.sun_path, socketPath, length);
+    // A leading '@' names a socket in the abstract namespace
+    if (address.sun_path[0] == '@') {
+        address.sun_path[0] = '\0';
+    }
+
+    int sock = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        return;
+    }
+    const char ready[] = "READY=1";
+    sendto(sock, ready, sizeof(ready) - 1, MSG_NOSIGNAL, (sockaddr *) &address,
+           offsetof(sockaddr_un, sun_path) + length);
+    close(sock);
+}
+
 int main(int argc, const char *argv[]) {
-    static plog::ColorConsoleAppender <plog::TxtFormatter> consoleAppender;
-    plog::init(plog::verbose, &consoleAppender);
+    // Never destroyed, DDS threads may still log while the process exits
+    static AsyncLogSink *logSink = new AsyncLogSink();
+    // Info until -loglevel or a signal says otherwise; per-message lines are debug
+    plog::init(plog::info, logSink);
+    AsyncLogSink::InstallSignalHandlers();
 
     LOG_INFO << "=== [AMM - TCP Bridge] ===";
 
@@ -1126,9 +1844,161 @@ int main(int argc, const char *argv[]) {
         if (arg == "-nodiscovery") {
             discovery = 0;
         }
+
+        if (arg == "-iouring") {
+            networkBackend = Server::Backend::IoUring;
+        }
+
+        if (arg == "-reuseport") {
+            Server::reusePort = true;
+        }
+
+        if (arg == "-unix_socket" && i + 1 < argc) {
+            unixSocketPath = argv[++i];
+        }
+
+        if (arg == "-websocket_port" && i + 1 < argc) {
+            webSocketPort = std::stoi(argv[++i]);
+        }
+
+        if (arg == "-shm_ring" && i + 1 < argc) {
+            waveformRingName = argv[++i];
+        }
+
+        if (arg == "-shm_ring_size" && i + 1 < argc) {
+            waveformRingSize = std::stoul(argv[++i]);
+        }
+
+        if (arg == "-multicast" && i + 1 < argc) {
+            multicastGroup = argv[++i];
+        }
+
+        if (arg == "-multicast_port" && i + 1 < argc) {
+            multicastPort = (uint16_t) std::stoul(argv[++i]);
+        }
+
+        if (arg == "-multicast_groups" && i + 1 < argc) {
+            multicastGroups = std::stoi(argv[++i]);
+        }
+
+        if (arg == "-multicast_ttl" && i + 1 < argc) {
+            multicastTtl = std::stoi(argv[++i]);
+        }
+
+        if (arg == "-multicast_if" && i + 1 < argc) {
+            multicastInterface = argv[++i];
+        }
+
+        if (arg == "-multicast_flush" && i + 1 < argc) {
+            multicastFlush = std::chrono::milliseconds(std::stoi(argv[++i]));
+        }
+
+        if (arg == "-low_latency") {
+            LowLatency::enabled = true;
+        }
+
+        if (arg == "-io_cores" && i + 1 < argc && !LowLatency::ParseCores(argv[++i], LowLatency::ioCores)) {
+            LOG_WARNING << "Ignoring malformed -io_cores " << argv[i];
+        }
+
+        if (arg == "-dds_cores" && i + 1 < argc && !LowLatency::ParseCores(argv[++i], LowLatency::ddsCores)) {
+            LOG_WARNING << "Ignoring malformed -dds_cores " << argv[i];
+        }
+
+        if (arg == "-busy_poll" && i + 1 < argc) {
+            LowLatency::busyPoll = std::chrono::microseconds(std::stoul(argv[++i]));
+        }
+
+        if (arg == "-socket_sndbuf" && i + 1 < argc) {
+            LowLatency::sendBuffer = std::stoi(argv[++i]);
+        }
+
+        if (arg == "-socket_rcvbuf" && i + 1 < argc) {
+            LowLatency::receiveBuffer = std::stoi(argv[++i]);
+        }
+
+        if (arg == "-notsent_lowat" && i + 1 < argc) {
+            LowLatency::notSentLowat = std::stoi(argv[++i]);
+        }
+
+        if (arg == "-compression_threshold" && i + 1 < argc) {
+            Compressor::threshold = std::stoul(argv[++i]);
+        }
+
+        if (arg == "-zerocopy_threshold" && i + 1 < argc) {
+            ZeroCopySender::threshold = std::stoul(argv[++i]);
+        }
+
+        if (arg == "-idle_timeout" && i + 1 < argc) {
+            ConnectionMonitor::idleTimeout = std::chrono::seconds(std::stoul(argv[++i]));
+        }
+
+        if (arg == "-write_timeout" && i + 1 < argc) {
+            ConnectionMonitor::writeTimeout = std::chrono::seconds(std::stoul(argv[++i]));
+        }
+
+        if (arg == "-telemetry_queue_limit" && i + 1 < argc) {
+            OutboundQueue::telemetryLimit = std::stoul(argv[++i]);
+        }
+
+        if (arg == "-trace_sample" && i + 1 < argc) {
+            LatencyTrace::sampleEvery = std::stoul(argv[++i]);
+        }
+
+        if (arg == "-trace_file" && i + 1 < argc) {
+            LatencyTrace::traceFile = argv[++i];
+        }
+
+        if (arg == "-backlog" && i + 1 < argc) {
+            Server::listenBacklog = std::stoi(argv[++i]);
+        }
+
+        if (arg == "-accept_rate" && i + 1 < argc) {
+            AdmissionControl::acceptRate = std::stod(argv[++i]);
+        }
+
+        if (arg == "-accept_burst" && i + 1 < argc) {
+            AdmissionControl::acceptBurst = std::stoul(argv[++i]);
+        }
+
+        if (arg == "-max_handshakes" && i + 1 < argc) {
+            AdmissionControl::maxHandshakes = std::stoul(argv[++i]);
+        }
+
+        if (arg == "-snapshot" && i + 1 < argc) {
+            snapshotPath = argv[++i];
+        }
+
+        if (arg == "-snapshot_events" && i + 1 < argc) {
+            snapshotEventLimit = std::stoul(argv[++i]);
+        }
+
+        if (arg == "-snapshot_interval" && i + 1 < argc) {
+            snapshotInterval = std::chrono::milliseconds(std::stoul(argv[++i]));
+        }
+
+        if (arg == "-loglevel" && i + 1 < argc) {
+            AsyncLogSink::SetLevel(plog::severityFromString(argv[++i]));
+        }
+    }
+
+    if (!waveformRingName.empty() && waveformRing.Create(waveformRingName, waveformRingSize)) {
+        LOG_INFO << "Waveform ring " << waveformRing.Name() << ", " << waveformRing.Capacity() << " bytes";
+    }
+
+    if (!multicastGroup.empty() &&
+        waveformMulticast.Open(multicastGroup, multicastPort, multicastGroups, multicastTtl, multicastInterface)) {
+        LOG_INFO << "Waveform multicast groups " << waveformMulticast.Describe();
+        ConnectionMonitor::Every(multicastFlush, [] {
+            waveformMulticast.Flush();
+        });
     }
 
     InitializeLabNodes();
+    if (!snapshotPath.empty()) {
+        RestoreSnapshot();
+    }
+    IndexLabNodes();
 
     TCPBridgeListener tl;
 
@@ -1150,7 +2020,6 @@ int main(int argc, const char *argv[]) {
     mgr->CreateStatusPublisher();
     mgr->CreateEventRecordPublisher();
     mgr->CreatePhysiologyValueSubscriber(&tl, &TCPBridgeListener::onNewPhysiologyValue);
-    mgr->CreatePhysiologyWaveformSubscriber(&tl, &TCPBridgeListener::onNewPhysiologyWaveform);
     mgr->CreateCommandSubscriber(&tl, &TCPBridgeListener::onNewCommand);
     mgr->CreateSimulationControlSubscriber(&tl, &TCPBridgeListener::onNewSimulationControl);
     mgr->CreateAssessmentSubscriber(&tl, &TCPBridgeListener::onNewAssessment);
@@ -1158,6 +2027,15 @@ int main(int argc, const char *argv[]) {
     mgr->CreatePhysiologyModificationSubscriber(&tl, &TCPBridgeListener::onNewPhysiologyModification);
     mgr->CreateEventRecordSubscriber(&tl, &TCPBridgeListener::onNewEventRecord);
     mgr->CreateOperationalDescriptionSubscriber(&tl, &TCPBridgeListener::onNewOperationalDescription);
+
+    // DDSManager cannot remove a reader or filter by content, so the waveform
+    // reader is created on first demand and gated in the listener afterwards
+    waveformDemand.OnFirstDemand([&tl] {
+        publishQueue.Post([&tl] {
+            LOG_INFO << "First HF_ subscriber, creating the PhysiologyWaveform reader";
+            mgr->CreatePhysiologyWaveformSubscriber(&tl, &TCPBridgeListener::onNewPhysiologyWaveform);
+        });
+    });
     mgr->CreateRenderModificationPublisher();
     mgr->CreatePhysiologyModificationPublisher();
     mgr->CreateSimulationControlPublisher();
@@ -1167,19 +2045,112 @@ int main(int argc, const char *argv[]) {
 
     m_uuid.id(mgr->GenerateUuidString());
 
-    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    if (LowLatency::enabled) {
+        LOG_INFO << "Low latency mode: busy poll " << LowLatency::busyPoll.count() << " us, "
+                 << LowLatency::ioCores.size() << " I/O cores, " << LowLatency::ddsCores.size() << " DDS cores";
+        publishQueue.SpinFor(LowLatency::busyPoll);
+        publishQueue.Post([] {
+            LowLatency::PinThread(LowLatency::ddsCores);
+        });
+    }
+    publishQueue.Start();
+    xmlWorkers.Start();
+
+    // Announced once discovery has had time to match the new writers; sessions
+    // are served meanwhile
+    ConnectionMonitor::After(std::chrono::milliseconds(250), [] {
+        publishQueue.Post([] {
+            PublishOperationalDescription();
+            PublishConfiguration();
+        });
+    });
+
+    if (snapshot.Enabled()) {
+        ConnectionMonitor::Every(snapshotInterval, [] {
+            if (labsChanged.exchange(false, std::memory_order_relaxed)) {
+                snapshot.Replace("labs", SnapshotLabValues());
+            }
+            snapshot.Flush();
+        });
+    }
 
-    PublishOperationalDescription();
-    PublishConfiguration();
+    ConnectionMonitor::Every(std::chrono::seconds(10), [] {
+        size_t peak = publishQueue.TakePeak();
+        if (peak > 0) {
+            LOG_INFO << "DDS publish queue: " << publishQueue.Pending() << " pending, peak " << peak;
+        }
+        size_t held;
+        size_t heldClients;
+        {
+            std::lock_guard<std::mutex> lock(heldMutex);
+            held = heldPosts.size();
+            heldClients = heldCounts.size();
+        }
+        if (held > 0) {
+            LOG_WARNING << "Queues full: " << held << " client messages held, reads paused for "
+                        << heldClients << " clients";
+        }
+
+        DurationStat::Summary wait = xmlWorkers.queueWait.Take();
+        DurationStat::Summary parse = xmlParseTime.Take();
+        std::pair<size_t, size_t> cache = capabilityCache.TakeCounts();
+        if (wait.count > 0) {
+            LOG_INFO << "XML workers: " << wait.count << " documents, queue wait mean " << wait.meanMs
+                     << " ms max " << wait.maxMs << " ms, parse mean " << parse.meanMs
+                     << " ms max " << parse.maxMs << " ms, capability cache " << cache.first
+                     << " hits " << cache.second << " misses";
+        }
+
+        uint64_t droppedTelemetry = OutboundQueue::TakeDropped();
+        if (droppedTelemetry > 0) {
+            LOG_WARNING << "Outbound queues: dropped " << droppedTelemetry << " telemetry messages for slow clients";
+        }
+
+        std::string latency;
+        if (LatencyTrace::TakeSummary(latency)) {
+            LOG_INFO << "Latency by stage" << (LowLatency::enabled ? " (low latency mode)" : "") << ":" << latency;
+            LatencyTrace::Export();
+        }
+
+        size_t handshaking = AdmissionControl::Handshaking();
+        if (handshaking > 0) {
+            LOG_INFO << "Admission: " << handshaking << " sessions handshaking";
+        }
+
+        uint64_t ringLag;
+        int ringReaders = waveformRing.Readers(ringLag);
+        if (ringReaders > 0) {
+            LOG_INFO << "Waveform ring: " << ringReaders << " readers, furthest " << ringLag << " bytes behind";
+        }
+
+        uint64_t multicastErrors = waveformMulticast.TakeErrors();
+        if (multicastErrors > 0) {
+            LOG_WARNING << "Waveform multicast: " << multicastErrors << " datagrams failed to send";
+        }
+    });
+
+    if (Server::reusePort && discovery && workerLoad.Join("amm_tcp_bridge." + std::to_string(bridgePort))) {
+        ConnectionMonitor::Every(std::chrono::seconds(1), [] {
+            workerLoad.Update(Server::ClientCount(), Server::QueuedMessages(), publishQueue.Pending(), ProcessCpu());
+        });
+    }
 
     std::thread t1(UdpDiscoveryThread);
     s = new Server(bridgePort);
+    if (!unixSocketPath.empty() && s->ListenUnix(unixSocketPath)) {
+        LOG_INFO << "Listening on unix socket " << unixSocketPath;
+    }
+    if (webSocketPort > 0 && s->ListenWebSocket(webSocketPort)) {
+        LOG_INFO << "Listening for WebSocket sessions on port " << webSocketPort;
+    }
     std::string action;
 
+    SignalReady();
 
-    s->AcceptAndDispatch();
+    s->Run(networkBackend);
 
     t1.join();
 
     LOG_INFO << "TCP Bridge shutdown.";
+    logSink->Stop();
 }
@@ -0,0 +1,61 @@
+#include "TopicDemand.h"
+
+#include "TopicMatcher.h"
+
+TopicDemand::TopicDemand(const std::string &prefix) : prefix(prefix) {
+}
+
+void TopicDemand::OnFirstDemand(std::function<void()> create) {
+    bool due;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->create = std::move(create);
+        due = !clients.empty() && !created;
+        created = created || due;
+    }
+    if (due) {
+        Create();
+    }
+}
+
+bool TopicDemand::Wants(const std::vector<TopicId> &topics, const std::vector<std::string> &patterns) const {
+    for (TopicId topic : topics) {
+        if (TopicRegistry::Name(topic).compare(0, prefix.size(), prefix) == 0) {
+            return true;
+        }
+    }
+    for (auto &pattern : patterns) {
+        if (TopicMatcher::MayMatchPrefix(pattern, prefix)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TopicDemand::Set(const std::string &clientId, bool wants) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (wants) {
+        clients.insert(clientId);
+    } else {
+        clients.erase(clientId);
+    }
+    active.store(!clients.empty(), std::memory_order_relaxed);
+
+    // Without a callback yet, OnFirstDemand() creates the reader instead
+    if (!clients.empty() && !created && create) {
+        created = true;
+        return true;
+    }
+    return false;
+}
+
+void TopicDemand::Create() {
+    std::function<void()> run;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        run = create;
+    }
+    if (run) {
+        run();
+    }
+}
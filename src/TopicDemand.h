@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "TopicRegistry.h"
+
+/*
+  TopicDemand:
+                Tracks which clients want a family of topics, every name
+                starting with a prefix such as "HF_". The DDS reader for the
+                family is created the first time a client wants it; while no
+                client does, Active() is false and the listener drops
+                samples on entry.
+
+                Callers record demand while holding their routing locks, so
+                creating the reader, which waits on the publish queue, is
+                left to Create(), called once those locks are released.
+*/
+class TopicDemand {
+public:
+    explicit TopicDemand(const std::string &prefix);
+
+    // Runs once, from Create() or here, when the first client wants the family
+    void OnFirstDemand(std::function<void()> create);
+
+    // Whether a subscription set reaches into the family
+    bool Wants(const std::vector<TopicId> &topics, const std::vector<std::string> &patterns) const;
+
+    // True when this is the first demand; the caller must then call Create()
+    bool Set(const std::string &clientId, bool wants);
+
+    // Runs the creation callback; never with TopicDemand's mutex held
+    void Create();
+
+    bool Active() const {
+        return active.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::string prefix;
+    std::function<void()> create;
+    bool created = false;
+    std::unordered_set<std::string> clients;
+    std::atomic<bool> active{false};
+    std::mutex mutex;
+};
@@ -0,0 +1,123 @@
+#include "TopicMatcher.h"
+
+#include <algorithm>
+
+bool TopicMatcher::IsPattern(const std::string &name) {
+    return name.find_first_of("*?") != std::string::npos;
+}
+
+bool TopicMatcher::Matches(const std::string &pattern, const std::string &topic) {
+    return Glob(pattern.c_str(), topic.c_str());
+}
+
+bool TopicMatcher::MayMatchPrefix(const std::string &pattern, const std::string &prefix) {
+    for (size_t i = 0; i < prefix.size(); i++) {
+        if (i >= pattern.size()) {
+            return false;
+        }
+        if (pattern[i] == '*') {
+            return true;
+        }
+        if (pattern[i] != '?' && pattern[i] != prefix[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void TopicMatcher::Add(const std::string &pattern, ClientHandle client) {
+    size_t wildcard = pattern.find_first_of("*?");
+    if (wildcard == std::string::npos) {
+        wildcard = pattern.size();
+    }
+
+    Node *node = &root;
+    for (size_t i = 0; i < wildcard; i++) {
+        std::unique_ptr<Node> &child = node->children[pattern[i]];
+        if (!child) {
+            child.reset(new Node());
+        }
+        node = child.get();
+    }
+
+    std::string tail = pattern.substr(wildcard);
+    for (auto &entry : node->entries) {
+        if (entry.tail == tail && entry.client == client) {
+            return;
+        }
+    }
+    node->entries.push_back({tail, client});
+}
+
+void TopicMatcher::Remove(ClientHandle client) {
+    Prune(root, client);
+}
+
+bool TopicMatcher::Prune(Node &node, ClientHandle client) {
+    node.entries.erase(std::remove_if(node.entries.begin(), node.entries.end(),
+                                      [&client](const Entry &e) { return e.client == client; }),
+                       node.entries.end());
+
+    for (auto it = node.children.begin(); it != node.children.end();) {
+        if (Prune(*it->second, client)) {
+            it = node.children.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return node.entries.empty() && node.children.empty();
+}
+
+std::vector<ClientHandle> TopicMatcher::Match(const std::string &topic) const {
+    std::vector<ClientHandle> clients;
+    const Node *node = &root;
+    size_t depth = 0;
+
+    for (;;) {
+        for (auto &entry : node->entries) {
+            if (std::find(clients.begin(), clients.end(), entry.client) == clients.end() &&
+                Glob(entry.tail.c_str(), topic.c_str() + depth)) {
+                clients.push_back(entry.client);
+            }
+        }
+        if (depth == topic.size()) {
+            break;
+        }
+        auto child = node->children.find(topic[depth]);
+        if (child == node->children.end()) {
+            break;
+        }
+        node = child->second.get();
+        depth++;
+    }
+    return clients;
+}
+
+/*
+  Glob():
+                Iterative wildcard match; on a mismatch it backtracks only to
+                the most recent `*`, so it is linear in practice.
+*/
+bool TopicMatcher::Glob(const char *pattern, const char *text) {
+    const char *star = nullptr;
+    const char *resume = nullptr;
+
+    while (*text) {
+        if (*pattern == '*') {
+            star = pattern++;
+            resume = text;
+        } else if (*pattern == '?' || *pattern == *text) {
+            pattern++;
+            text++;
+        } else if (star) {
+            pattern = star + 1;
+            text = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (*pattern == '*') {
+        pattern++;
+    }
+    return *pattern == '\0';
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Net/ClientHandle.h"
+
+/*
+  TopicMatcher:
+                Wildcard subscriptions ("BloodChemistry_*", "HF_*",
+                "Substance_*_Concentration"). Patterns are stored in a trie
+                keyed on their literal prefix, so matching a topic name walks
+                it once and only glob-checks the tails of patterns whose
+                prefix matched. `*` matches any run of characters, `?` any
+                single one. Not thread-safe, the owner serializes access.
+*/
+class TopicMatcher {
+public:
+    static bool IsPattern(const std::string &name);
+
+    static bool Matches(const std::string &pattern, const std::string &topic);
+
+    // Whether the pattern can match some name starting with the prefix
+    static bool MayMatchPrefix(const std::string &pattern, const std::string &prefix);
+
+    void Add(const std::string &pattern, ClientHandle client);
+
+    void Remove(ClientHandle client);
+
+    // Clients with at least one pattern matching the topic, each listed once
+    std::vector<ClientHandle> Match(const std::string &topic) const;
+
+private:
+    struct Entry {
+        // The pattern from its first wildcard on
+        std::string tail;
+        ClientHandle client;
+    };
+
+    struct Node {
+        std::map<char, std::unique_ptr<Node>> children;
+        std::vector<Entry> entries;
+    };
+
+    static bool Glob(const char *pattern, const char *text);
+
+    // Returns true when the node is left with nothing in or below it
+    static bool Prune(Node &node, ClientHandle client);
+
+    Node root;
+};
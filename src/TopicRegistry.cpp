@@ -0,0 +1,49 @@
+#include "TopicRegistry.h"
+
+#include <mutex>
+
+TopicRegistry::State &TopicRegistry::Registry() {
+    static State state;
+    return state;
+}
+
+TopicId TopicRegistry::Intern(const std::string &name) {
+    State &r = Registry();
+    {
+        boost::shared_lock<boost::shared_mutex> lock(r.mutex);
+        auto it = r.ids.find(name);
+        if (it != r.ids.end()) {
+            return it->second;
+        }
+    }
+
+    std::unique_lock<boost::shared_mutex> lock(r.mutex);
+    auto inserted = r.ids.emplace(name, (TopicId) r.names.size());
+    if (inserted.second) {
+        r.names.push_back(name);
+    }
+    return inserted.first->second;
+}
+
+bool TopicRegistry::Find(const std::string &name, TopicId &id) {
+    State &r = Registry();
+    boost::shared_lock<boost::shared_mutex> lock(r.mutex);
+    auto it = r.ids.find(name);
+    if (it == r.ids.end()) {
+        return false;
+    }
+    id = it->second;
+    return true;
+}
+
+const std::string &TopicRegistry::Name(TopicId id) {
+    State &r = Registry();
+    boost::shared_lock<boost::shared_mutex> lock(r.mutex);
+    return r.names.at(id);
+}
+
+size_t TopicRegistry::Size() {
+    State &r = Registry();
+    boost::shared_lock<boost::shared_mutex> lock(r.mutex);
+    return r.names.size();
+}
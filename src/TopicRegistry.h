@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <unordered_map>
+
+#include <boost/thread/shared_mutex.hpp>
+
+typedef uint32_t TopicId;
+
+/*
+  TopicRegistry:
+                Interns topic names into dense integer ids. A name is hashed
+                once, when it is first subscribed to or seen; after that the
+                bridge keys subscriptions and lab slots on the id, and strings
+                only appear at the protocol boundary.
+*/
+class TopicRegistry {
+public:
+    static TopicId Intern(const std::string &name);
+
+    static bool Find(const std::string &name, TopicId &id);
+
+    static const std::string &Name(TopicId id);
+
+    static size_t Size();
+
+private:
+    struct State {
+        std::unordered_map<std::string, TopicId> ids;
+        // deque keeps references returned by Name() valid as it grows
+        std::deque<std::string> names;
+        boost::shared_mutex mutex;
+    };
+
+    // Function-local so topics can be interned during static initialization
+    static State &Registry();
+};
@@ -0,0 +1,130 @@
+#include "WorkerLoad.h"
+
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+int64_t NowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool ProcessGone(uint32_t pid) {
+    return kill((pid_t) pid, 0) < 0 && errno == ESRCH;
+}
+
+}
+
+WorkerLoad::~WorkerLoad() {
+    if (slot) {
+        slot->pid.store(0, std::memory_order_release);
+    }
+    if (segment) {
+        munmap(segment, sizeof(Segment));
+    }
+}
+
+/*
+  Join():
+                Every worker opens the same segment; ftruncate() to the same
+                size is harmless when another worker got there first, and a
+                new segment is zero-filled, so every slot starts free. A slot
+                still holding this pid was left by an earlier process that
+                had it, and is reused first; then free slots, then those of
+                processes that exited without giving theirs back.
+*/
+bool WorkerLoad::Join(const std::string &segmentName) {
+    name = segmentName.empty() || segmentName[0] == '/' ? segmentName : "/" + segmentName;
+    int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0660);
+    if (fd < 0) {
+        cerr << "shm_open " << name << " failed: " << errno << endl;
+        return false;
+    }
+    struct stat st{};
+    if (fstat(fd, &st) < 0 || ((size_t) st.st_size < sizeof(Segment) && ftruncate(fd, sizeof(Segment)) < 0)) {
+        cerr << "ftruncate " << name << " failed: " << errno << endl;
+        close(fd);
+        return false;
+    }
+    void *mapped = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        cerr << "mmap " << name << " failed: " << errno << endl;
+        return false;
+    }
+    segment = static_cast<Segment *>(mapped);
+
+    uint32_t self = (uint32_t) getpid();
+    for (int pass = 0; pass < 3 && !slot; pass++) {
+        for (Slot &candidate : segment->slots) {
+            uint32_t holder = candidate.pid.load(std::memory_order_acquire);
+            bool free = pass == 0 ? holder == self
+                                  : pass == 1 ? holder == 0
+                                              : holder != 0 && ProcessGone(holder);
+            if (free && candidate.pid.compare_exchange_strong(holder, self)) {
+                slot = &candidate;
+                break;
+            }
+        }
+    }
+    if (!slot) {
+        cerr << "No free worker slot in " << name << ", " << maxWorkers << " workers already running" << endl;
+        munmap(segment, sizeof(Segment));
+        segment = nullptr;
+        return false;
+    }
+    Update(0, 0, 0, 0);
+    return true;
+}
+
+void WorkerLoad::Update(size_t clients, size_t outbound, size_t publish, double cpu) {
+    if (!slot) {
+        return;
+    }
+    slot->clients.store(clients, std::memory_order_relaxed);
+    slot->outbound.store(outbound, std::memory_order_relaxed);
+    slot->publish.store(publish, std::memory_order_relaxed);
+    slot->cpuPermille.store((uint32_t) (cpu * 1000), std::memory_order_relaxed);
+    slot->updatedMs.store(NowMs(), std::memory_order_release);
+}
+
+bool WorkerLoad::Live(const Slot &slot, int64_t now) {
+    uint32_t pid = slot.pid.load(std::memory_order_acquire);
+    return pid != 0 && now - slot.updatedMs.load(std::memory_order_acquire) <= staleAfterMs && !ProcessGone(pid);
+}
+
+/*
+  Sum():
+                Counters are read without a lock; a worker refreshing its
+                slot meanwhile contributes a mix of two refreshes, which is
+                close enough for a load hint.
+*/
+int WorkerLoad::Sum(Totals &totals) const {
+    totals = Totals();
+    if (!segment) {
+        return 0;
+    }
+    int workers = 0;
+    int64_t now = NowMs();
+    for (const Slot &candidate : segment->slots) {
+        if (!Live(candidate, now)) {
+            continue;
+        }
+        workers++;
+        totals.clients += candidate.clients.load(std::memory_order_relaxed);
+        totals.outbound += candidate.outbound.load(std::memory_order_relaxed);
+        totals.publish += candidate.publish.load(std::memory_order_relaxed);
+        totals.cpu += candidate.cpuPermille.load(std::memory_order_relaxed) / 1000.0;
+    }
+    return workers;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/*
+  WorkerLoad:
+                Load counters of every bridge process sharing a port with
+                -reuseport, in a small POSIX shared memory segment. The
+                kernel hands a discovery request to any one of them, so each
+                worker refreshes its own slot and the one answering reports
+                the totals for the host.
+
+                Slots are claimed by pid and given back on exit. A slot whose
+                process is gone, or that has not been refreshed for
+                staleAfterMs, is left out of the totals; only the former is
+                taken over by a new worker.
+                The segment is shared by every worker and never unlinked.
+*/
+class WorkerLoad {
+public:
+    static const int maxWorkers = 64;
+    static const int64_t staleAfterMs = 5000;
+
+    struct Totals {
+        uint64_t clients = 0;
+        uint64_t outbound = 0;
+        uint64_t publish = 0;
+        double cpu = 0;
+    };
+
+    WorkerLoad() = default;
+
+    ~WorkerLoad();
+
+    WorkerLoad(const WorkerLoad &) = delete;
+
+    WorkerLoad &operator=(const WorkerLoad &) = delete;
+
+    // Maps the segment, creating it if this is the first worker, and claims a slot
+    bool Join(const std::string &name);
+
+    bool Active() const {
+        return slot != nullptr;
+    }
+
+    void Update(size_t clients, size_t outbound, size_t publish, double cpu);
+
+    // Live workers, this one included; their counters summed into totals
+    int Sum(Totals &totals) const;
+
+private:
+    struct alignas(64) Slot {
+        // 0 while the slot is free
+        std::atomic<uint32_t> pid;
+        std::atomic<uint32_t> cpuPermille;
+        std::atomic<uint64_t> clients;
+        std::atomic<uint64_t> outbound;
+        std::atomic<uint64_t> publish;
+        // steady_clock milliseconds, the same clock in every process on the host
+        std::atomic<int64_t> updatedMs;
+    };
+
+    struct Segment {
+        Slot slots[maxWorkers];
+    };
+
+    static bool Live(const Slot &slot, int64_t now);
+
+    std::string name;
+    Segment *segment = nullptr;
+    Slot *slot = nullptr;
+};
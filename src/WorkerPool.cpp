@@ -0,0 +1,80 @@
+#include "WorkerPool.h"
+
+#include <thread>
+
+WorkerPool::WorkerPool(size_t threads, size_t capacity) : threads(threads), capacity(capacity) {
+}
+
+void WorkerPool::Start() {
+    for (size_t i = 0; i < threads; i++) {
+        std::thread(&WorkerPool::Run, this).detach();
+    }
+}
+
+void WorkerPool::Post(const std::string &key, std::function<void()> job) {
+    std::unique_lock<std::mutex> lock(mutex);
+    notFull.wait(lock, [this] { return pending < capacity; });
+    Enqueue(lock, key, std::move(job));
+}
+
+bool WorkerPool::TryPost(const std::string &key, std::function<void()> &job) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (pending >= capacity) {
+        return false;
+    }
+    Enqueue(lock, key, std::move(job));
+    return true;
+}
+
+void WorkerPool::Enqueue(std::unique_lock<std::mutex> &lock, const std::string &key, std::function<void()> job) {
+    std::deque<Job> &queue = jobs[key];
+    bool idle = queue.empty();
+    queue.push_back(Job{std::move(job), std::chrono::steady_clock::now()});
+    pending++;
+
+    if (idle) {
+        ready.push_back(key);
+        lock.unlock();
+        notEmpty.notify_one();
+        return;
+    }
+    lock.unlock();
+}
+
+size_t WorkerPool::Pending() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pending;
+}
+
+void WorkerPool::Run() {
+    while (true) {
+        std::string key;
+        std::function<void()> run;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            notEmpty.wait(lock, [this] { return !ready.empty(); });
+            key = std::move(ready.front());
+            ready.pop_front();
+
+            Job &job = jobs[key].front();
+            queueWait.Add(std::chrono::steady_clock::now() - job.queued);
+            run = std::move(job.run);
+        }
+
+        run();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = jobs.find(key);
+            it->second.pop_front();
+            pending--;
+            if (it->second.empty()) {
+                jobs.erase(it);
+            } else {
+                ready.push_back(key);
+                notEmpty.notify_one();
+            }
+        }
+        notFull.notify_one();
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "DurationStat.h"
+
+/*
+  WorkerPool:
+                A fixed number of threads running jobs from a bounded queue.
+                Jobs posted under the same key (a client id) run one at a
+                time and in the order they were posted; jobs for different
+                keys run in parallel. A full queue makes Post() wait and
+                TryPost() refuse; neither ever drops a job.
+*/
+class WorkerPool {
+public:
+    WorkerPool(size_t threads, size_t capacity);
+
+    void Start();
+
+    void Post(const std::string &key, std::function<void()> job);
+
+    // Never waits. False, the job left with the caller, when the queue is
+    // full; the job is moved from only when it is queued
+    bool TryPost(const std::string &key, std::function<void()> &job);
+
+    size_t Pending();
+
+    // Time jobs spent queued before a worker picked them up
+    DurationStat queueWait;
+
+private:
+    struct Job {
+        std::function<void()> run;
+        std::chrono::steady_clock::time_point queued;
+    };
+
+    void Run();
+
+    // Called with the lock held and room in the queue; releases the lock
+    void Enqueue(std::unique_lock<std::mutex> &lock, const std::string &key, std::function<void()> job);
+
+    size_t threads;
+    size_t capacity;
+    size_t pending = 0;
+
+    // Per key, the running job stays at the front until it finishes
+    std::unordered_map<std::string, std::deque<Job>> jobs;
+    // Keys with work queued and no job running
+    std::deque<std::string> ready;
+
+    std::mutex mutex;
+    std::condition_variable notEmpty;
+    std::condition_variable notFull;
+};